@@ -0,0 +1,291 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "adc_burst.h"
+
+#ifdef ESP_PLATFORM
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_heap_caps.h"
+#include "soc/soc_caps.h"
+#else
+#include <pthread.h>
+#endif
+
+_Static_assert((BURST_RING_SAMPLES & (BURST_RING_SAMPLES - 1)) == 0, "must be a power of two");
+_Static_assert(BURST_RING_SAMPLES >= BURST_PRE_SAMPLES + ADC_DMA_FRAME, "pre-trigger window (plus a DMA frame) too long for the ring");
+#ifdef ESP_PLATFORM
+_Static_assert(BURST_ADC_SAMPLE_RATE <= SOC_ADC_SAMPLE_FREQ_THRES_HIGH,
+               "ADC sample rate x oversampling above the continuous-mode maximum");
+#endif
+
+#define BURST_SAMPLES (BURST_PRE_SAMPLES + BURST_POST_SAMPLES)
+
+// --- Lock ---
+// Held by burst_feed() for one DMA block and by burst_read() for one chunk copy.
+#ifdef ESP_PLATFORM
+static SemaphoreHandle_t lock;
+#define BURST_LOCK()   xSemaphoreTake(lock, portMAX_DELAY)
+#define BURST_UNLOCK() xSemaphoreGive(lock)
+#else
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+#define BURST_LOCK()   pthread_mutex_lock(&lock)
+#define BURST_UNLOCK() pthread_mutex_unlock(&lock)
+#endif
+
+// Spinlock of the host/GPIO request: burst_request() may run in an ISR or on the
+// other core, and a 64-bit time cannot be written or read atomically on Xtensa.
+#ifdef ESP_PLATFORM
+static portMUX_TYPE request_mux = portMUX_INITIALIZER_UNLOCKED;
+#define REQUEST_LOCK()      portENTER_CRITICAL_SAFE(&request_mux)   // task or ISR
+#define REQUEST_UNLOCK()    portEXIT_CRITICAL_SAFE(&request_mux)
+#else
+static pthread_mutex_t request_lock = PTHREAD_MUTEX_INITIALIZER;
+#define REQUEST_LOCK()      pthread_mutex_lock(&request_lock)
+#define REQUEST_UNLOCK()    pthread_mutex_unlock(&request_lock)
+#endif
+
+typedef enum { ARMED, CAPTURING, READY } burst_state_t;
+
+static uint16_t *ring;              // pre-trigger history
+static uint16_t *burst;             // frozen window
+static uint32_t written;            // conversions fed since boot (wraps, only differences are used)
+static burst_state_t state = ARMED;
+static uint32_t captured;           // samples in `burst`
+static uint32_t target;             // samples the current burst will hold
+static uint32_t upload_pos;
+static burst_info_t info;
+static burst_stats_t stats;
+static uint16_t missed_since_last;
+
+// Timeline anchor of the block being fed: sample `anchor_idx` was taken at `anchor_us`.
+static uint32_t anchor_idx;
+static int64_t anchor_us;
+
+// Threshold trigger state.
+static int32_t baseline_q8;         // EMA of the trigger channel, 8 fractional bits
+static uint32_t baseline_n;         // samples seen, no trigger before the EMA settles
+static bool above;
+
+// Host/GPIO requests: written by burst_request() (possibly from an ISR), consumed by
+// burst_feed(), both under request_mux. One request waits at a time; later ones are
+// counted in request_overrun and reported as missed.
+static int64_t request_us;
+static uint8_t request_source;
+static uint16_t request_overrun;
+static bool pending;
+static uint32_t pending_idx;
+static uint8_t pending_source;
+static int64_t pending_us;
+
+static uint32_t decim_sum[16];
+static uint32_t decim_count[16];
+
+bool burst_init(void)
+{
+    size_t bytes = (BURST_RING_SAMPLES + BURST_SAMPLES) * sizeof(uint16_t);
+#ifdef ESP_PLATFORM
+    lock = xSemaphoreCreateMutex();
+    ring = heap_caps_malloc(bytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    stats.in_psram = ring != NULL;
+    if (!ring) {
+        ring = heap_caps_malloc(bytes, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    }
+#else
+    ring = malloc(bytes);
+#endif
+    if (!ring) return false;
+    burst = ring + BURST_RING_SAMPLES;
+    return true;
+}
+
+static int64_t time_of(uint32_t idx)
+{
+    int64_t behind = (int32_t)(anchor_idx - idx);
+    return anchor_us - behind * 1000000 / BURST_ADC_SAMPLE_RATE;
+}
+
+// Freeze [idx - BURST_PRE_SAMPLES, idx + BURST_POST_SAMPLES). Everything fed so far
+// (up to `written`) is copied from the ring; the rest is appended by burst_feed().
+static void start_burst(uint32_t idx, burst_trigger_t trigger, uint8_t channel, int64_t requested)
+{
+    uint32_t history = written < BURST_RING_SAMPLES ? written : BURST_RING_SAMPLES;
+    uint32_t oldest = written - history;
+    if ((int32_t)(idx - oldest) < 0) idx = oldest;
+    // A request far in the past: the samples already fed must fit in the post window.
+    if (written - idx > BURST_POST_SAMPLES) idx = written - BURST_POST_SAMPLES;
+    uint32_t start = (idx - oldest) > BURST_PRE_SAMPLES ? idx - BURST_PRE_SAMPLES : oldest;
+
+    captured = 0;
+    for (uint32_t i = start; i != written; i++) {
+        burst[captured++] = ring[i & (BURST_RING_SAMPLES - 1)];
+    }
+    target = (idx - start) + BURST_POST_SAMPLES;
+
+    info.id = stats.bursts;
+    info.rate_hz = BURST_ADC_SAMPLE_RATE;
+    info.pre = idx - start;
+    info.total = target;
+    info.trigger_us = time_of(idx);
+    info.first_us = time_of(start);
+    info.request_us = trigger == BURST_TRIGGER_THRESHOLD ? info.trigger_us : requested;
+    info.trigger = trigger;
+    info.channel = channel;
+    info.missed = missed_since_last;
+    missed_since_last = 0;
+    pending = false;
+    state = CAPTURING;
+}
+
+static void count_missed(void)
+{
+    stats.missed++;
+    if (missed_since_last < UINT16_MAX) missed_since_last++;
+}
+
+// Place a host/GPIO request on the sample timeline of the block being fed.
+static void take_request(void)
+{
+    REQUEST_LOCK();
+    uint8_t source = request_source;
+    int64_t t_us = request_us;
+    uint16_t overrun = request_overrun;
+    request_source = 0;
+    request_overrun = 0;
+    REQUEST_UNLOCK();
+    while (overrun--) count_missed();
+    if (source == 0) return;
+    if (state != ARMED || pending) {
+        count_missed();
+        return;
+    }
+    // Nearest sample: truncation would put requests before the anchor one sample late.
+    int64_t delta = (t_us - anchor_us) * BURST_ADC_SAMPLE_RATE;
+    int64_t ahead = (delta + (delta >= 0 ? 500000 : -500000)) / 1000000;
+    pending = true;
+    pending_idx = anchor_idx + (int32_t)ahead;
+    pending_source = source;
+    pending_us = t_us;
+}
+
+void burst_feed(const uint16_t *samples, int n, int64_t t_last_us)
+{
+    if (!ring || n <= 0) return;
+    BURST_LOCK();
+    anchor_idx = written + n - 1;
+    anchor_us = t_last_us;
+    take_request();
+    for (int i = 0; i < n; i++) {
+        uint16_t v = samples[i];
+        uint32_t idx = written++;
+        ring[idx & (BURST_RING_SAMPLES - 1)] = v;
+
+        if (state == CAPTURING) {
+            burst[captured++] = v;
+            if (captured == target) {
+                state = READY;
+                upload_pos = 0;
+                stats.bursts++;
+            }
+        } else if (state == ARMED && pending && (int32_t)(idx - pending_idx) >= 0) {
+            start_burst(pending_idx, pending_source, 0, pending_us);
+        }
+
+        if ((v >> 12) != BURST_TRIGGER_CHANNEL) continue;
+        int32_t value_q8 = (int32_t)(v & 0x0FFF) << 8;
+        if (baseline_n == 0) baseline_q8 = value_q8;
+        bool was_above = above;
+        above = abs(value_q8 - baseline_q8) >= (BURST_THRESHOLD << 8);
+        baseline_q8 += (value_q8 - baseline_q8) >> BURST_BASELINE_SHIFT;
+        if (baseline_n < (1u << BURST_BASELINE_SHIFT)) {
+            baseline_n++;
+            above = false;
+            continue;
+        }
+        if (above && !was_above) {
+            if (state == ARMED) {
+                start_burst(idx, BURST_TRIGGER_THRESHOLD, BURST_TRIGGER_CHANNEL, 0);
+            } else {
+                count_missed();
+            }
+        }
+    }
+    // A request for a sample not fed yet stays pending for the next block.
+    BURST_UNLOCK();
+}
+
+int burst_decimate(const uint16_t *in, int n, uint16_t *out)
+{
+    int produced = 0;
+    for (int i = 0; i < n; i++) {
+        uint32_t ch = in[i] >> 12;
+        decim_sum[ch] += in[i] & 0x0FFF;
+        if (++decim_count[ch] == BURST_DECIMATION) {
+            out[produced++] = (ch << 12) | ((decim_sum[ch] + BURST_DECIMATION / 2) / BURST_DECIMATION);
+            decim_sum[ch] = 0;
+            decim_count[ch] = 0;
+        }
+    }
+    return produced;
+}
+
+void burst_request(burst_trigger_t source, int64_t t_us)
+{
+    REQUEST_LOCK();
+    if (request_source != 0) {
+        if (request_overrun < UINT16_MAX) request_overrun++;
+    } else {
+        request_us = t_us;
+        request_source = source;
+    }
+    REQUEST_UNLOCK();
+}
+
+bool burst_upload_pending(burst_info_t *out)
+{
+    if (!ring) return false;
+    BURST_LOCK();
+    bool ready = state == READY;
+    if (ready) *out = info;
+    BURST_UNLOCK();
+    return ready;
+}
+
+int burst_read(void *out, int max, uint32_t *offset)
+{
+    if (!ring) return 0;
+    int n = 0;
+    BURST_LOCK();
+    if (state == READY) {
+        n = (int)(captured - upload_pos);
+        if (n > max) n = max;
+        memcpy(out, burst + upload_pos, n * sizeof(uint16_t));
+        *offset = upload_pos;
+        upload_pos += n;
+        if (upload_pos == captured) {
+            state = ARMED;
+            stats.uploaded++;
+        }
+    }
+    BURST_UNLOCK();
+    return n;
+}
+
+void burst_rewind(void)
+{
+    if (!ring) return;
+    BURST_LOCK();
+    upload_pos = 0;
+    BURST_UNLOCK();
+}
+
+void burst_get_stats(burst_stats_t *out)
+{
+    if (!ring) {
+        memset(out, 0, sizeof(*out));
+        return;
+    }
+    BURST_LOCK();
+    *out = stats;
+    BURST_UNLOCK();
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "stream_config.h"
+
+// --- ADC Burst Capture ---
+// The ADC runs at BURST_ADC_SAMPLE_RATE (two channels interleaved, close to the
+// continuous-mode maximum). Every conversion goes through burst_feed():
+//   - it is written to a small pre-trigger ring (BURST_PRE_SAMPLES of history),
+//   - burst_decimate() averages BURST_DECIMATION conversions per channel into the
+//     ADC_SAMPLE_RATE stream. Rate and packet format are kept, the signal is not:
+//     a stream sample used to be one conversion and is now the mean over one output
+//     period, so the top of the band is attenuated (about -3.9 dB at the per-channel
+//     Nyquist frequency), less is aliased, and uncorrelated noise drops by about
+//     sqrt(BURST_DECIMATION),
+//   - on a trigger, the pre-trigger history plus the next BURST_POST_SAMPLES are
+//     frozen into the burst buffer, which the outbound task then uploads in chunks
+//     (SOURCE_BURST packets after one SOURCE_BURST_INFO packet) whenever the live
+//     stream leaves room on the link.
+// Triggers: the raw value of BURST_TRIGGER_CHANNEL leaving its slow moving
+// baseline by BURST_THRESHOLD, a host command, or a GPIO edge. While a burst is
+// being captured or uploaded, further triggers are only counted (`missed`).
+//
+// Samples are packed like the ADC stream: upper 4 bits channel, lower 12 bits value.
+// Timestamps are esp_timer microseconds. Each burst_feed() call anchors its last
+// sample at `t_last_us`; sample times inside a block follow the nominal rate, so the
+// trigger time is exact to one sample period (12.5 us at 80 kHz) plus the DMA frame jitter.
+//
+// Like capture_ring.c, the file builds on the host (pthread lock) so the trigger
+// and window logic can be checked there.
+
+// Rates, windows, threshold and trigger GPIO come from menuconfig (stream_config.h).
+// Pre-trigger history: BURST_PRE_SAMPLES plus one DMA frame, rounded up to a power of two
+// (8192 with the defaults, 65536 at most: 80 ms at 400 kHz).
+#define BURST_RING_NEEDED       (BURST_PRE_SAMPLES + ADC_DMA_FRAME)
+#define BURST_RING_SAMPLES      (BURST_RING_NEEDED <= 4096 ? 4096 : BURST_RING_NEEDED <= 8192 ? 8192 : \
+                                 BURST_RING_NEEDED <= 16384 ? 16384 : BURST_RING_NEEDED <= 32768 ? 32768 : 65536)
+#define BURST_BASELINE_SHIFT    12      // baseline EMA over ~4096 samples of the trigger channel
+
+typedef enum {
+    BURST_TRIGGER_THRESHOLD = 1,
+    BURST_TRIGGER_HOST = 2,
+    BURST_TRIGGER_GPIO_EDGE = 3,
+} burst_trigger_t;
+
+// Payload of the SOURCE_BURST_INFO packet (little endian, sent as 16-bit words).
+typedef struct __attribute__((packed)) {
+    uint32_t id;                // burst number since boot
+    uint32_t rate_hz;           // BURST_ADC_SAMPLE_RATE
+    uint32_t pre;               // samples before the trigger sample
+    uint32_t total;             // samples in the burst
+    int64_t trigger_us;         // time of the trigger sample
+    int64_t first_us;           // time of the first sample
+    int64_t request_us;         // host/GPIO: time the trigger was requested, else trigger_us
+    uint8_t trigger;            // burst_trigger_t
+    uint8_t channel;            // trigger channel (threshold triggers)
+    uint16_t missed;            // triggers ignored since the previous burst
+} burst_info_t;
+
+typedef struct {
+    uint32_t bursts;            // bursts frozen since boot
+    uint32_t missed;            // triggers ignored since boot (busy)
+    uint32_t uploaded;          // bursts fully handed to the outbound task
+    bool in_psram;
+} burst_stats_t;
+
+// Allocate the pre-trigger ring and the burst buffer. Returns false if out of memory
+// (burst capture is then disabled, burst_decimate() still works).
+bool burst_init(void);
+
+// Push a block of raw conversions; t_last_us is the time of the last one.
+void burst_feed(const uint16_t *samples, int n, int64_t t_last_us);
+
+// Average BURST_DECIMATION conversions per channel. Returns the number of samples
+// written to out (at most n / BURST_DECIMATION + number of channels).
+int burst_decimate(const uint16_t *in, int n, uint16_t *out);
+
+// Request a burst around t_us (esp_timer time). ISR-safe: only stores the request
+// (under a spinlock), burst_feed() places it on the sample timeline. A request made
+// while another one waits for burst_feed() is counted as missed.
+void burst_request(burst_trigger_t source, int64_t t_us);
+
+// True while a frozen burst waits for upload; fills info.
+bool burst_upload_pending(burst_info_t *info);
+
+// Copy the next chunk of the frozen burst (at most max samples). *offset receives the
+// index of its first sample. The burst is released (and triggers re-armed) once the
+// last chunk is taken. Returns 0 when there is nothing to upload.
+int burst_read(void *out, int max, uint32_t *offset);
+
+// Restart the upload of the current burst from its first sample (client changed).
+void burst_rewind(void);
+
+void burst_get_stats(burst_stats_t *stats);
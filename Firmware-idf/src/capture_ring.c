@@ -0,0 +1,190 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "capture_ring.h"
+
+#ifdef ESP_PLATFORM
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_heap_caps.h"
+#else
+#include <pthread.h>
+#endif
+
+// --- Lock ---
+// Producers and the consumer copy whole packets under one lock. A packet is ~0.5 kB,
+// so the critical section is a few microseconds even in PSRAM, and an overwrite
+// can never race with the consumer reading the same packet.
+#ifdef ESP_PLATFORM
+static SemaphoreHandle_t lock;
+static SemaphoreHandle_t available;   // given on every push, taken by cring_pop
+#define RING_LOCK()   xSemaphoreTake(lock, portMAX_DELAY)
+#define RING_UNLOCK() xSemaphoreGive(lock)
+#else
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+#define RING_LOCK()   pthread_mutex_lock(&lock)
+#define RING_UNLOCK() pthread_mutex_unlock(&lock)
+#endif
+
+typedef uint16_t record_len_t;        // prefix of every packet
+
+static uint8_t *storage;
+static uint32_t capacity;             // power of two, so `pos & mask` stays continuous when the counters wrap
+static uint32_t head;                 // next byte to write
+static uint32_t tail;                 // first byte of the oldest packet
+static uint32_t lost;                 // packets overwritten since the last pop
+static cring_stats_t stats;
+
+static size_t floor_pow2(size_t n)
+{
+    size_t p = 1;
+    while (p <= n / 2) p <<= 1;
+    return n ? p : 0;
+}
+
+uint32_t cring_init(size_t psram_bytes, size_t internal_bytes)
+{
+    psram_bytes = floor_pow2(psram_bytes);
+    internal_bytes = floor_pow2(internal_bytes);
+    memset(&stats, 0, sizeof(stats));
+#ifdef ESP_PLATFORM
+    lock = xSemaphoreCreateMutex();
+    available = xSemaphoreCreateBinary();
+    storage = heap_caps_malloc(psram_bytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (storage) {
+        capacity = psram_bytes;
+        stats.in_psram = true;
+    } else {
+        storage = heap_caps_malloc(internal_bytes, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        capacity = storage ? internal_bytes : 0;
+    }
+#else
+    (void)internal_bytes;
+    free(storage);                    // tests re-initialise the ring
+    storage = malloc(psram_bytes);
+    capacity = storage ? psram_bytes : 0;
+#endif
+    head = tail = lost = 0;
+    stats.bytes = capacity;
+    return capacity;
+}
+
+// Copies across the end of the storage in two parts.
+static void copy_in(uint32_t pos, const void *src, size_t n)
+{
+    uint32_t at = pos & (capacity - 1);
+    size_t first = capacity - at < n ? capacity - at : n;
+    memcpy(storage + at, src, first);
+    memcpy(storage, (const uint8_t *)src + first, n - first);
+}
+
+static void copy_out(uint32_t pos, void *dst, size_t n)
+{
+    uint32_t at = pos & (capacity - 1);
+    size_t first = capacity - at < n ? capacity - at : n;
+    memcpy(dst, storage + at, first);
+    memcpy((uint8_t *)dst + first, storage, n - first);
+}
+
+static record_len_t oldest_size(void)
+{
+    record_len_t size;
+    copy_out(tail, &size, sizeof(size));
+    return size;
+}
+
+bool cring_push(const void *item, size_t size)
+{
+    size_t need = sizeof(record_len_t) + size;
+    if (capacity == 0 || need > capacity || size > UINT16_MAX) return false;
+    bool kept_all = true;
+    RING_LOCK();
+    while (head - tail + need > capacity) {
+        // Full: drop the oldest packets until the new one fits.
+        tail += sizeof(record_len_t) + oldest_size();
+        stats.count--;
+        stats.overwritten++;
+        lost++;
+        kept_all = false;
+    }
+    record_len_t len = size;
+    copy_in(head, &len, sizeof(len));
+    copy_in(head + sizeof(len), item, size);
+    head += need;
+    stats.pushed++;
+    stats.count++;
+    stats.used = head - tail;
+    if (stats.used > stats.high_water) stats.high_water = stats.used;
+    RING_UNLOCK();
+#ifdef ESP_PLATFORM
+    xSemaphoreGive(available);
+#endif
+    return kept_all;
+}
+
+static size_t try_pop(void *item, size_t max_size, uint32_t *lost_out)
+{
+    size_t got = 0;
+    RING_LOCK();
+    if (head != tail) {
+        record_len_t size = oldest_size();
+        if (size <= max_size) {
+            copy_out(tail + sizeof(size), item, size);
+            got = size;
+        } else {
+            lost++;                    // a packet larger than the caller's buffer is dropped
+        }
+        tail += sizeof(size) + size;
+        stats.count--;
+        stats.used = head - tail;
+    }
+    if (got) {
+        // The overwritten packets were all older than this one: the gap ends here.
+        if (lost_out) *lost_out = lost;
+        lost = 0;
+    }
+    RING_UNLOCK();
+    return got;
+}
+
+size_t cring_pop(void *item, size_t max_size, uint32_t timeout_ms, uint32_t *lost)
+{
+    if (lost) *lost = 0;
+    if (capacity == 0) return 0;
+    size_t got = try_pop(item, max_size, lost);
+    if (got) return got;
+#ifdef ESP_PLATFORM
+    // `available` may be stale (given for a packet already popped), so re-check after waking.
+    if (xSemaphoreTake(available, pdMS_TO_TICKS(timeout_ms)) == pdTRUE) {
+        return try_pop(item, max_size, lost);
+    }
+#else
+    (void)timeout_ms;
+#endif
+    return 0;
+}
+
+void cring_reset(void)
+{
+    RING_LOCK();
+    tail = head;
+    lost = 0;
+    stats.count = 0;
+    stats.used = 0;
+    RING_UNLOCK();
+}
+
+uint32_t cring_count(void)
+{
+    RING_LOCK();
+    uint32_t count = stats.count;
+    RING_UNLOCK();
+    return count;
+}
+
+void cring_get_stats(cring_stats_t *out)
+{
+    RING_LOCK();
+    *out = stats;
+    RING_UNLOCK();
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "stream_config.h"
+
+// --- Capture Ring ---
+// Bounded buffer between the capture tasks (mic, ADC) and the outbound task.
+// Sampling starts at boot, before Wi-Fi is up or any client is attached, so the
+// ring holds the most recent packets: when it is full the oldest packets are
+// overwritten (and counted), and a client that connects later receives the
+// whole backlog first, in order. Capture never waits, so the ring also overwrites
+// while a client is attached but too slow; cring_pop() then reports how many
+// packets were lost just before the one it returns, and the outbound task tells
+// the host (SOURCE_GAP).
+//
+// Packets are stored back to back with their exact size (a 2-byte length, then
+// header + samples), so each stream only takes the room of its own message type.
+// The storage is taken from PSRAM when available (CAPTURE_RING_PSRAM_BYTES,
+// several seconds of audio + ADC), otherwise from internal RAM
+// (CAPTURE_RING_INTERNAL_BYTES). Both sizes are set in menuconfig.
+//
+// Like deferred_log.c, the file builds on the host (pthread lock instead of a
+// FreeRTOS mutex, no blocking in pop) so the overwrite logic can be checked there.
+
+typedef struct {
+    uint32_t bytes;          // capacity
+    uint32_t used;           // bytes waiting
+    uint32_t count;          // packets waiting
+    uint32_t high_water;     // max bytes waiting since boot
+    uint32_t pushed;         // packets captured since boot
+    uint32_t overwritten;    // oldest packets lost because the ring was full
+    bool in_psram;
+} cring_stats_t;
+
+// Allocate the ring (sizes are rounded down to a power of two). Returns the capacity
+// in bytes (0 if no memory at all).
+uint32_t cring_init(size_t psram_bytes, size_t internal_bytes);
+
+// Copy one packet of `size` bytes in. Never blocks on the consumer: returns false if
+// older packets were overwritten to make room.
+bool cring_push(const void *item, size_t size);
+
+// Copy the oldest packet out (at most max_size bytes). Waits up to timeout_ms for one
+// on target (host: never waits). Returns its size, 0 if none. If `lost` is not NULL
+// it receives the number of packets overwritten since the previous pop (or reset),
+// i.e. the gap right before this packet; it is only cleared when a packet is returned.
+size_t cring_pop(void *item, size_t max_size, uint32_t timeout_ms, uint32_t *lost);
+
+// Discard everything waiting (and the pending lost count).
+void cring_reset(void);
+
+uint32_t cring_count(void);
+void cring_get_stats(cring_stats_t *stats);
@@ -0,0 +1,41 @@
+#include <stdbool.h>
+
+#include "core_load.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+static uint32_t last_idle[CORE_LOAD_MAX_CORES];
+static int64_t last_us;
+
+int core_load_sample(uint16_t *permille, int max_cores)
+{
+    int cores = portNUM_PROCESSORS < max_cores ? portNUM_PROCESSORS : max_cores;
+    if (cores > CORE_LOAD_MAX_CORES) cores = CORE_LOAD_MAX_CORES;
+    int64_t now = esp_timer_get_time();
+    int64_t elapsed = now - last_us;
+    bool first = last_us == 0;
+    last_us = now;
+    for (int core = 0; core < cores; core++) {
+        // The run time counter ticks in esp_timer microseconds and wraps (32 bits):
+        // only differences between two samples are used.
+        uint32_t idle = ulTaskGetRunTimeCounter(xTaskGetIdleTaskHandleForCore(core));
+        uint32_t idle_us = idle - last_idle[core];
+        last_idle[core] = idle;
+        if (elapsed > 0) {
+            int64_t busy = 1000 - (int64_t)idle_us * 1000 / elapsed;
+            permille[core] = busy < 0 ? 0 : (busy > 1000 ? 1000 : busy);
+        }
+    }
+    return first ? 0 : cores;
+}
+#else
+int core_load_sample(uint16_t *permille, int max_cores)
+{
+    (void)permille;
+    (void)max_cores;
+    return 0;
+}
+#endif
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stdint.h>
+
+// --- Core Load ---
+// Per-core utilisation, from the run time FreeRTOS accounts to each core's idle
+// task: busy = 1 - idle time / elapsed time since the previous call. It shows the
+// headroom left on the capture/network core and on the DSP core (dsp_offload.h).
+//
+// Needs CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS (enabled in the project sdkconfig).
+// Without it, core_load_sample() reports no cores.
+
+#define CORE_LOAD_MAX_CORES 2
+
+// Busy share of every core since the previous call, in permille. Returns the number
+// of cores written (0 if run time stats are disabled or on the first call).
+int core_load_sample(uint16_t *permille, int max_cores);
@@ -0,0 +1,213 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#include "deferred_log.h"
+
+#ifdef ESP_PLATFORM
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#else
+#include <time.h>
+#endif
+
+_Static_assert((DLOG_RING_SIZE & (DLOG_RING_SIZE - 1)) == 0, "DLOG_RING_SIZE must be a power of two");
+
+// --- Ring ---
+// Bounded multi-producer / single-consumer ring. Each slot carries a sequence
+// number: producers claim a slot by advancing `head` with a CAS and publish it by
+// bumping the slot sequence; the consumer only ever touches `tail`.
+typedef struct {
+    atomic_uint seq;
+    dlog_record_t rec;
+} dlog_slot_t;
+
+static dlog_slot_t ring[DLOG_RING_SIZE];
+static atomic_uint ring_head;
+static unsigned int ring_tail;
+static atomic_uint ring_dropped;
+static unsigned int reported_dropped;
+static uint32_t dropped_report_ms;
+
+// --- Rate limiter (consumer side only) ---
+typedef struct {
+    const char *fmt;
+    const char *tag;
+    uint32_t window_start_ms;
+    uint32_t passed;
+    uint32_t suppressed;
+} dlog_site_t;
+
+static dlog_site_t sites[DLOG_MAX_SITES];
+static dlog_sink_t out_sink;
+
+static uint32_t dlog_now_ms(void)
+{
+#ifdef ESP_PLATFORM
+    return (uint32_t)(esp_timer_get_time() / 1000);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+#endif
+}
+
+static void default_sink(int level, const char *tag, uint32_t ts_ms, const char *msg)
+{
+#ifdef ESP_PLATFORM
+    esp_log_write((esp_log_level_t)level, tag, "%c (%lu) %s: %s\n",
+                  level == DLOG_ERROR ? 'E' : level == DLOG_WARN ? 'W' : 'I',
+                  (unsigned long)ts_ms, tag, msg);
+#else
+    printf("%d (%lu) %s: %s\n", level, (unsigned long)ts_ms, tag, msg);
+#endif
+}
+
+void dlog_init(dlog_sink_t sink)
+{
+    out_sink = sink ? sink : default_sink;
+    for (int i = 0; i < DLOG_RING_SIZE; i++) {
+        atomic_store_explicit(&ring[i].seq, i, memory_order_relaxed);
+    }
+    atomic_store_explicit(&ring_head, 0, memory_order_relaxed);
+    atomic_store_explicit(&ring_dropped, 0, memory_order_relaxed);
+    ring_tail = 0;
+    reported_dropped = 0;
+    dropped_report_ms = dlog_now_ms();
+    memset(sites, 0, sizeof(sites));
+}
+
+bool dlog_write(int level, const char *tag, const char *fmt, const int *args)
+{
+    unsigned int pos = atomic_load_explicit(&ring_head, memory_order_relaxed);
+    dlog_slot_t *slot;
+    for (;;) {
+        slot = &ring[pos & (DLOG_RING_SIZE - 1)];
+        unsigned int seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        int diff = (int)(seq - pos);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&ring_head, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // Ring full: never wait, just account for the loss.
+            atomic_fetch_add_explicit(&ring_dropped, 1, memory_order_relaxed);
+            return false;
+        } else {
+            pos = atomic_load_explicit(&ring_head, memory_order_relaxed);
+        }
+    }
+    slot->rec.tag = tag;
+    slot->rec.fmt = fmt;
+    slot->rec.ts_ms = dlog_now_ms();
+    slot->rec.level = (uint8_t)level;
+    memcpy(slot->rec.args, args, sizeof(slot->rec.args));
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+    return true;
+}
+
+static bool dlog_pop(dlog_record_t *out)
+{
+    dlog_slot_t *slot = &ring[ring_tail & (DLOG_RING_SIZE - 1)];
+    unsigned int seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+    if ((int)(seq - (ring_tail + 1)) < 0) {
+        return false;
+    }
+    *out = slot->rec;
+    atomic_store_explicit(&slot->seq, ring_tail + DLOG_RING_SIZE, memory_order_release);
+    ring_tail++;
+    return true;
+}
+
+static dlog_site_t *find_site(const dlog_record_t *rec)
+{
+    dlog_site_t *free_site = NULL;
+    for (int i = 0; i < DLOG_MAX_SITES; i++) {
+        if (sites[i].fmt == rec->fmt) return &sites[i];
+        if (sites[i].fmt == NULL && free_site == NULL) free_site = &sites[i];
+    }
+    if (free_site) {
+        free_site->fmt = rec->fmt;
+        free_site->tag = rec->tag;
+        free_site->window_start_ms = rec->ts_ms;
+    }
+    return free_site;  // NULL: table full, the record bypasses rate limiting
+}
+
+static void report_suppressed(dlog_site_t *site, uint32_t now_ms)
+{
+    char msg[DLOG_MSG_MAX];
+    snprintf(msg, sizeof(msg), "suppressed %lu x \"%s\"", (unsigned long)site->suppressed, site->fmt);
+    out_sink(DLOG_WARN, site->tag, now_ms, msg);
+    site->suppressed = 0;
+}
+
+int dlog_drain(void)
+{
+    dlog_record_t rec;
+    char msg[DLOG_MSG_MAX];
+    int consumed = 0;
+
+    while (dlog_pop(&rec)) {
+        consumed++;
+        dlog_site_t *site = find_site(&rec);
+        if (site) {
+            if (rec.ts_ms - site->window_start_ms >= DLOG_WINDOW_MS) {
+                if (site->suppressed) report_suppressed(site, rec.ts_ms);
+                site->window_start_ms = rec.ts_ms;
+                site->passed = 0;
+            }
+            if (site->passed >= DLOG_BURST) {
+                site->suppressed++;
+                continue;
+            }
+            site->passed++;
+        }
+        snprintf(msg, sizeof(msg), rec.fmt, rec.args[0], rec.args[1]);
+        out_sink(rec.level, rec.tag, rec.ts_ms, msg);
+    }
+
+    // Report windows that expired without a new record to trigger them.
+    uint32_t now = dlog_now_ms();
+    for (int i = 0; i < DLOG_MAX_SITES; i++) {
+        if (sites[i].suppressed && now - sites[i].window_start_ms >= DLOG_WINDOW_MS) {
+            report_suppressed(&sites[i], now);
+            sites[i].window_start_ms = now;
+            sites[i].passed = 0;
+        }
+    }
+
+    unsigned int dropped = atomic_load_explicit(&ring_dropped, memory_order_relaxed);
+    if (dropped != reported_dropped && now - dropped_report_ms >= DLOG_WINDOW_MS) {
+        snprintf(msg, sizeof(msg), "dropped %u log records (ring full)", dropped - reported_dropped);
+        out_sink(DLOG_WARN, "DLOG", now, msg);
+        reported_dropped = dropped;
+        dropped_report_ms = now;
+    }
+    return consumed;
+}
+
+uint32_t dlog_dropped(void)
+{
+    return atomic_load_explicit(&ring_dropped, memory_order_relaxed);
+}
+
+#ifdef ESP_PLATFORM
+static void dlog_task(void *arg)
+{
+    for (;;) {
+        dlog_drain();
+        vTaskDelay(pdMS_TO_TICKS(DLOG_DRAIN_PERIOD_MS));
+    }
+    vTaskDelete(NULL);
+}
+
+void dlog_start_task(void)
+{
+    if (out_sink == NULL) dlog_init(NULL);
+    xTaskCreate(dlog_task, "dlog", 4096, NULL, 1, NULL);
+}
+#endif
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// --- Deferred Logging ---
+// Hot paths (send loop, capture callbacks) must never block on the UART logger.
+// DLOGx() pushes a compact binary record into a lock-free ring and returns
+// immediately; a low-priority drain task formats the records, rate-limits them
+// per call site and reports how many were suppressed or dropped.
+//
+// Format strings must be string literals (the pointer is stored, not the text)
+// and may reference at most DLOG_MAX_ARGS integer arguments.
+//
+// The ring and the rate limiter have no FreeRTOS dependency, so this file can be
+// compiled on the host with a custom sink to measure producer latency.
+
+#define DLOG_RING_SIZE         64     // records, must be a power of two
+#define DLOG_MAX_ARGS          2
+#define DLOG_MAX_SITES         16     // distinct format strings tracked by the rate limiter
+#define DLOG_BURST             5      // records let through per site and window
+#define DLOG_WINDOW_MS         1000
+#define DLOG_DRAIN_PERIOD_MS   50
+#define DLOG_MSG_MAX           128
+
+// Same values as esp_log_level_t so records can be handed to esp_log_write as is.
+#define DLOG_ERROR 1
+#define DLOG_WARN  2
+#define DLOG_INFO  3
+
+typedef struct {
+    const char *tag;
+    const char *fmt;
+    uint32_t ts_ms;
+    uint8_t level;
+    int args[DLOG_MAX_ARGS];
+} dlog_record_t;
+
+// Receives every formatted line (including suppression reports).
+typedef void (*dlog_sink_t)(int level, const char *tag, uint32_t ts_ms, const char *msg);
+
+// Install the output sink. NULL selects the default (esp_log_write on target, stdout on host).
+void dlog_init(dlog_sink_t sink);
+
+// Non-blocking, safe from any task. Returns false if the ring was full (the record is counted as dropped).
+bool dlog_write(int level, const char *tag, const char *fmt, const int *args);
+
+// Format and emit everything queued so far, then flush expired suppression windows.
+// Must only be called from one consumer at a time. Returns the number of records consumed.
+int dlog_drain(void);
+
+// Records lost because the ring was full since boot.
+uint32_t dlog_dropped(void);
+
+#ifdef ESP_PLATFORM
+// Spawn the low-priority task that calls dlog_drain() every DLOG_DRAIN_PERIOD_MS.
+void dlog_start_task(void);
+#endif
+
+#define DLOGE(tag, fmt, ...) dlog_write(DLOG_ERROR, tag, fmt, (const int[DLOG_MAX_ARGS]){ __VA_ARGS__ })
+#define DLOGW(tag, fmt, ...) dlog_write(DLOG_WARN,  tag, fmt, (const int[DLOG_MAX_ARGS]){ __VA_ARGS__ })
+#define DLOGI(tag, fmt, ...) dlog_write(DLOG_INFO,  tag, fmt, (const int[DLOG_MAX_ARGS]){ __VA_ARGS__ })
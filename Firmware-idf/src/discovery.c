@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/param.h>
+#include <sys/unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include "lwip/sockets.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_netif.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+
+#include "deferred_log.h"
+#include "discovery.h"
+
+static const char *TAG = "DISCOVERY";
+
+static int stream_port;
+static const char *streams;
+static volatile bool client_attached = false;
+
+void discovery_set_client(bool attached)
+{
+    client_attached = attached;
+}
+
+// Returns the beacon length, 0 while the station has no IP yet.
+static int format_beacon(char *out, size_t size, const char *id)
+{
+    esp_netif_ip_info_t ip_info;
+    esp_netif_t *netif = esp_netif_get_handle_from_ifkey("WIFI_STA_DEF");
+    if (netif == NULL || esp_netif_get_ip_info(netif, &ip_info) != ESP_OK || ip_info.ip.addr == 0) {
+        return 0;
+    }
+    int n = snprintf(out, size,
+                     "{\"dev\":\"murmurator\",\"id\":\"%s\",\"ip\":\"" IPSTR "\",\"port\":%d,"
+                     "\"client\":%d,\"uptime_ms\":%lld,\"streams\":%s}\n",
+                     id, IP2STR(&ip_info.ip), stream_port, client_attached ? 1 : 0,
+                     (long long)(esp_timer_get_time() / 1000), streams);
+    return (n > 0 && n < (int)size) ? n : 0;
+}
+
+static void send_beacon(int sock, const char *id, uint32_t to_addr)
+{
+    char beacon[DISCOVERY_BEACON_MAX];
+    int len = format_beacon(beacon, sizeof(beacon), id);
+    if (len == 0) return;
+    struct sockaddr_in dest = {
+        .sin_family = AF_INET,
+        .sin_port = htons(DISCOVERY_BEACON_PORT),
+        .sin_addr.s_addr = to_addr,
+    };
+    if (sendto(sock, beacon, len, 0, (struct sockaddr *)&dest, sizeof(dest)) < 0) {
+        DLOGW(TAG, "Beacon send failed: errno %d", errno);
+    }
+}
+
+static void discovery_task(void *arg)
+{
+    uint8_t mac[6];
+    char id[13];
+    esp_wifi_get_mac(WIFI_IF_STA, mac);
+    snprintf(id, sizeof(id), "%02X%02X%02X%02X%02X%02X", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0) {
+        ESP_LOGE(TAG, "Unable to create socket: errno %d", errno);
+        vTaskDelete(NULL);
+        return;
+    }
+    int on = 1;
+    setsockopt(sock, SOL_SOCKET, SO_BROADCAST, &on, sizeof(on));
+    struct sockaddr_in probe_addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(DISCOVERY_PROBE_PORT),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    if (bind(sock, (struct sockaddr *)&probe_addr, sizeof(probe_addr)) < 0) {
+        ESP_LOGE(TAG, "Socket unable to bind: errno %d", errno);
+        close(sock);
+        vTaskDelete(NULL);
+        return;
+    }
+    ESP_LOGI(TAG, "Announcing %s on UDP %d (probes on %d)", id, DISCOVERY_BEACON_PORT, DISCOVERY_PROBE_PORT);
+
+    int64_t next_beacon_us = 0;
+    while (1) {
+        int64_t now = esp_timer_get_time();
+        if (now >= next_beacon_us) {
+            send_beacon(sock, id, htonl(INADDR_BROADCAST));
+            next_beacon_us = now + 1000LL * (client_attached ? DISCOVERY_BUSY_PERIOD_MS : DISCOVERY_IDLE_PERIOD_MS);
+        }
+        int64_t wait_us = MAX(next_beacon_us - esp_timer_get_time(), 0);
+        struct timeval timeout = {
+            .tv_sec = wait_us / 1000000,
+            .tv_usec = wait_us % 1000000,
+        };
+        fd_set read_fds;
+        FD_ZERO(&read_fds);
+        FD_SET(sock, &read_fds);
+        if (select(sock + 1, &read_fds, NULL, NULL, &timeout) <= 0) continue;
+
+        char probe[32];
+        struct sockaddr_in from;
+        socklen_t from_len = sizeof(from);
+        int n = recvfrom(sock, probe, sizeof(probe) - 1, 0, (struct sockaddr *)&from, &from_len);
+        if (n <= 0) continue;
+        probe[n] = '\0';
+        if (strncmp(probe, DISCOVERY_PROBE, strlen(DISCOVERY_PROBE)) == 0) {
+            // Unicast answer: the prober hears it even if broadcasts are filtered.
+            send_beacon(sock, id, from.sin_addr.s_addr);
+        }
+    }
+    close(sock);
+    vTaskDelete(NULL);
+}
+
+void discovery_start(int port, const char *streams_json)
+{
+    stream_port = port;
+    streams = streams_json;
+    xTaskCreate(discovery_task, "discovery", 4096, NULL, 3, NULL);
+}
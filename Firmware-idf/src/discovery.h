@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdbool.h>
+
+// --- Device Discovery ---
+// The device announces itself on the LAN so hosts do not need its IP:
+//   - a UDP beacon is broadcast to DISCOVERY_BEACON_PORT every
+//     DISCOVERY_IDLE_PERIOD_MS while no client is attached (DISCOVERY_BUSY_PERIOD_MS
+//     otherwise),
+//   - a host can broadcast DISCOVERY_PROBE to DISCOVERY_PROBE_PORT. The device
+//     answers at once with a beacon sent to the prober's DISCOVERY_BEACON_PORT,
+//     so discovery does not have to wait for the next period.
+// The beacon is one line of JSON:
+//   {"dev":"murmurator","id":"<MAC>","ip":"a.b.c.d","port":5000,"client":0,"streams":[...]}
+// where "streams" is the capability string passed to discovery_start().
+
+#define DISCOVERY_BEACON_PORT     5001   // host side: beacons are sent here
+#define DISCOVERY_PROBE_PORT      5002   // device side: probes are received here
+#define DISCOVERY_PROBE           "MURMUR?"
+#define DISCOVERY_IDLE_PERIOD_MS  250
+#define DISCOVERY_BUSY_PERIOD_MS  2000
+#define DISCOVERY_BEACON_MAX      512
+
+// Start the beacon task. Call after the network stack is up (the task waits for an IP).
+// streams_json must stay valid (a string literal): it is embedded in every beacon.
+void discovery_start(int stream_port, const char *streams_json);
+
+// Tell the beacon whether a client is attached (slower beacon, "client":1).
+void discovery_set_client(bool attached);
@@ -0,0 +1,172 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#include "dsp_offload.h"
+
+#ifdef ESP_PLATFORM
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#else
+#include <time.h>
+#endif
+
+#define DSP_MAX_WORKERS DSP_LANES   // more workers than lanes would have nothing to do
+
+// --- Lanes ---
+// Single-producer / single-consumer: the capture task only writes `head`, the worker
+// only writes `tail`. A slot is published by the release store of `head` and handed
+// back by the release store of `tail`, so no slot is ever touched by both sides.
+typedef struct {
+    uint32_t size;
+    uint8_t data[];
+} dsp_slot_t;
+
+typedef struct {
+    uint8_t *slots;
+    atomic_uint head;          // next slot to fill (producer)
+    atomic_uint tail;          // next slot to process (consumer)
+    dsp_stage_t stage;
+    dsp_lane_stats_t stats;
+} dsp_lane_t;
+
+static dsp_lane_t lanes[DSP_LANES];
+static size_t slot_stride;
+static size_t slot_capacity;   // payload bytes per slot
+static uint32_t slot_count;    // power of two
+static dsp_sink_t out_sink;
+static int worker_count = 1;
+
+#ifdef ESP_PLATFORM
+static TaskHandle_t workers[DSP_MAX_WORKERS];
+#endif
+
+static uint32_t dsp_now_us(void)
+{
+#ifdef ESP_PLATFORM
+    return (uint32_t)esp_timer_get_time();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+#endif
+}
+
+static dsp_slot_t *slot_at(dsp_lane_t *lane, unsigned int pos)
+{
+    return (dsp_slot_t *)(lane->slots + (pos & (slot_count - 1)) * slot_stride);
+}
+
+bool dsp_init(size_t slot_bytes, uint32_t slots, dsp_sink_t sink)
+{
+    if (slots == 0 || (slots & (slots - 1)) != 0) return false;
+    // Keep every slot 4-byte aligned so stages can work on int16/int32 views of it.
+    slot_stride = (sizeof(dsp_slot_t) + slot_bytes + 3) & ~(size_t)3;
+    slot_capacity = slot_bytes;
+    slot_count = slots;
+    out_sink = sink;
+    for (int i = 0; i < DSP_LANES; i++) {
+        dsp_lane_t *lane = &lanes[i];
+        lane->slots = malloc(slot_stride * slots);
+        if (lane->slots == NULL) {
+            // All or nothing: no lane is left with slots but no worker to drain them.
+            for (int j = 0; j < i; j++) {
+                free(lanes[j].slots);
+                lanes[j].slots = NULL;
+            }
+            return false;
+        }
+        atomic_store_explicit(&lane->head, 0, memory_order_relaxed);
+        atomic_store_explicit(&lane->tail, 0, memory_order_relaxed);
+        memset(&lane->stats, 0, sizeof(lane->stats));
+        lane->stats.slots = slots;
+    }
+    return true;
+}
+
+void dsp_set_stage(int lane, dsp_stage_t stage)
+{
+    lanes[lane].stage = stage;
+}
+
+bool dsp_submit(int index, const void *packet, size_t size)
+{
+    dsp_lane_t *lane = &lanes[index];
+    unsigned int head = atomic_load_explicit(&lane->head, memory_order_relaxed);
+    unsigned int tail = atomic_load_explicit(&lane->tail, memory_order_acquire);
+    uint32_t waiting = head - tail;
+    if (lane->slots == NULL || waiting >= slot_count || size > slot_capacity) {
+        lane->stats.dropped++;
+        return false;
+    }
+    dsp_slot_t *slot = slot_at(lane, head);
+    slot->size = size;
+    memcpy(slot->data, packet, size);
+    atomic_store_explicit(&lane->head, head + 1, memory_order_release);
+    lane->stats.submitted++;
+    if (waiting + 1 > lane->stats.high_water) lane->stats.high_water = waiting + 1;
+#ifdef ESP_PLATFORM
+    TaskHandle_t worker = workers[index % worker_count];
+    if (worker) xTaskNotifyGive(worker);
+#endif
+    return true;
+}
+
+static int drain_lane(dsp_lane_t *lane)
+{
+    int taken = 0;
+    unsigned int tail = atomic_load_explicit(&lane->tail, memory_order_relaxed);
+    while (tail != atomic_load_explicit(&lane->head, memory_order_acquire)) {
+        dsp_slot_t *slot = slot_at(lane, tail);
+        uint32_t start = dsp_now_us();
+        size_t size = lane->stage ? lane->stage(slot->data, slot->size, slot_capacity) : slot->size;
+        if (size > 0) {
+            out_sink(slot->data, size);
+            lane->stats.processed++;
+        } else {
+            lane->stats.discarded++;
+        }
+        lane->stats.busy_us += dsp_now_us() - start;
+        atomic_store_explicit(&lane->tail, ++tail, memory_order_release);
+        taken++;
+    }
+    return taken;
+}
+
+int dsp_service(int worker)
+{
+    int taken = 0;
+    for (int i = worker; i < DSP_LANES; i += worker_count) {
+        taken += drain_lane(&lanes[i]);
+    }
+    return taken;
+}
+
+void dsp_get_stats(int lane, dsp_lane_stats_t *stats)
+{
+    // Each counter has a single writer; a report may mix values a few packets apart.
+    *stats = lanes[lane].stats;
+}
+
+#ifdef ESP_PLATFORM
+static void dsp_worker_task(void *arg)
+{
+    int worker = (int)(intptr_t)arg;
+    for (;;) {
+        // Woken by dsp_submit(); the timeout only bounds the cost of a missed notification.
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100));
+        dsp_service(worker);
+    }
+    vTaskDelete(NULL);
+}
+
+void dsp_start_workers(int count, int core, int priority)
+{
+    worker_count = count < 1 ? 1 : (count > DSP_MAX_WORKERS ? DSP_MAX_WORKERS : count);
+    for (int i = 0; i < worker_count; i++) {
+        xTaskCreatePinnedToCore(dsp_worker_task, "dsp_worker", 4096, (void *)(intptr_t)i,
+                                priority, &workers[i], core);
+    }
+}
+#endif
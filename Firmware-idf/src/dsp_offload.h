@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// --- DSP Offload ---
+// Processing stage between the capture tasks and the capture ring, running on the
+// core the capture and network tasks leave idle (DSP_CORE, menuconfig).
+//
+// Every capture task owns one lane: a lock-free single-producer / single-consumer
+// ring of fixed-size packet slots. dsp_submit() copies a finished packet into the
+// lane and returns at once (a full lane drops the packet and counts it, capture
+// never waits). A pool of DSP_WORKERS worker tasks pinned to DSP_CORE drains the
+// lanes, lane i being served by worker i % DSP_WORKERS only, so each lane keeps a
+// single consumer and its packets stay in order. The worker runs the lane's stage
+// (filter, features, compression, ...) in place on the slot, then hands the result
+// to the sink (cring_push in main.c).
+//
+// A stage sees the whole packet (header + samples) and may rewrite it, shrink it or
+// grow it up to max_size bytes. It returns the new size, 0 to drop the packet.
+// Without a stage the worker just forwards the packet.
+//
+// Like capture_ring.c, the file builds on the host: the rings use C11 atomics, and
+// dsp_service() is the worker loop body, so lanes can be driven from test threads.
+
+#define DSP_LANE_MIC  0
+#define DSP_LANE_ADC  1
+#define DSP_LANES     2
+
+typedef size_t (*dsp_stage_t)(void *packet, size_t size, size_t max_size);
+typedef void (*dsp_sink_t)(const void *packet, size_t size);
+
+typedef struct {
+    uint32_t slots;          // capacity in packets
+    uint32_t submitted;      // packets accepted since boot
+    uint32_t dropped;        // packets lost because the lane was full
+    uint32_t discarded;      // packets the stage dropped (returned 0)
+    uint32_t processed;      // packets handed to the sink
+    uint32_t high_water;     // max packets waiting since boot
+    uint32_t busy_us;        // time spent in the stage and the sink (wraps, use differences)
+} dsp_lane_stats_t;
+
+// Allocate `slots` slots of `slot_bytes` per lane (slots: power of two). Returns false,
+// with nothing allocated, if out of memory. sink receives every processed packet, from
+// the worker tasks.
+bool dsp_init(size_t slot_bytes, uint32_t slots, dsp_sink_t sink);
+
+// Install (or remove with NULL) the processing stage of a lane. Call before capture starts.
+void dsp_set_stage(int lane, dsp_stage_t stage);
+
+// Producer side, one task per lane. Never blocks: returns false if the lane was full
+// or the packet larger than a slot (the packet is counted as dropped).
+bool dsp_submit(int lane, const void *packet, size_t size);
+
+// Process everything waiting in the lanes of `worker`. Returns the number of packets
+// taken. Only one caller per worker at a time.
+int dsp_service(int worker);
+
+void dsp_get_stats(int lane, dsp_lane_stats_t *stats);
+
+#ifdef ESP_PLATFORM
+// Spawn `workers` worker tasks pinned to `core`, below the capture priority.
+void dsp_start_workers(int workers, int core, int priority);
+#endif
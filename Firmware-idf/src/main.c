@@ -5,11 +5,13 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <errno.h>
+#include "lwip/sockets.h"
 // #include <sys/uio.h>
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
+#include "freertos/event_groups.h"
 
 #include "esp_log.h"
 #include "esp_wifi.h"
@@ -18,20 +20,31 @@
 #include "nvs_flash.h"
 
 #include "driver/i2s_std.h"
+#include "driver/i2s_tdm.h"
 #include "driver/adc.h"
 #include "esp_adc/adc_continuous.h"
 #include "esp_timer.h"
 // #include "driver/adc_continuous.h"  // ADC continuous mode (requires ESP-IDF v4.3+)
 
+#include "adc_burst.h"
+#include "capture_ring.h"
+#include "core_load.h"
+#include "deferred_log.h"
+#include "discovery.h"
+#include "dsp_offload.h"
+#include "mic_channels.h"
+#include "stream_config.h"
 #include "secrets.h" // Must define: #define SSID "MLdev" and #define PWORD "wifi_password"
 
 static const char *TAG = "MURMURATOR";
 
-// --- Microphone (I2S) Settings ---
-#define I2S_MIC_SAMPLE_RATE    48000
-#define ADC_SAMPLE_RATE        8000
-#define MIC_BUFFER_SIZE        256    // number of 16-bit samples in a pa
-#define ADC_BUFFER_SIZE        256    // number of raw samples
+// --- Stream Settings ---
+// Rates, packet sizes, channels and encodings come from menuconfig, see stream_config.h.
+// The ADC hardware runs at BURST_ADC_SAMPLE_RATE in ADC_DMA_FRAME blocks; the
+// ADC_SAMPLE_RATE stream is decimated from it (see adc_burst.h).
+#define BURST_UPLOAD_MAX_BACKLOG  8   // burst chunks are sent only while the live backlog is below this
+#define BURST_COMMAND          'B'    // host -> device: trigger a burst now
+#define BURST_CHUNK_SAMPLES    256    // samples per SOURCE_BURST packet
 
 
 // --- Packet Header Definition ---
@@ -40,6 +53,11 @@ static const char *TAG = "MURMURATOR";
 // 2 bytes: length (number of 16-bit samples in the packet)
 #define SOURCE_MIC 0
 #define SOURCE_ADC 1
+#define SOURCE_BURST_INFO 2   // payload: burst_info_t, metadata: burst id & 0xFF
+#define SOURCE_BURST 3        // payload: burst samples, timestamp: time of the first one
+#define SOURCE_MIC_MULTI 4    // payload: interleaved mic frames, metadata: number of channels
+#define SOURCE_GAP 5          // payload: uint32 packets lost, timestamp: the next packet's
+// SOURCE_MIC packets carry the mic index in metadata (0 = the primary mic).
 typedef struct __attribute__((packed)) {
     uint8_t source;
     uint8_t metadata;
@@ -47,25 +65,77 @@ typedef struct __attribute__((packed)) {
     uint64_t timestamp;
 } packet_header_t;
 
-typedef struct __attribute__((packed)) {
-    int16_t data[MAX(MIC_BUFFER_SIZE, ADC_BUFFER_SIZE)];
-    size_t end;
-} buffer_t;
+// One message type per stream, sized exactly for it: the header followed by the
+// samples, as sent on the wire and stored in the capture ring.
+#define STREAM_MSG(samples) struct __attribute__((packed)) { \
+    packet_header_t header; \
+    int16_t data[samples]; \
+}
+typedef STREAM_MSG(MIC_PACKET_SAMPLES) mic_msg_t;
+typedef STREAM_MSG(ADC_BUFFER_SIZE) adc_msg_t;
+typedef STREAM_MSG(BURST_CHUNK_SAMPLES) burst_msg_t;
+typedef STREAM_MSG(2) gap_msg_t;
+_Static_assert(sizeof(mic_msg_t) == sizeof(packet_header_t) + MIC_PACKET_SAMPLES * sizeof(int16_t), "mic_msg_t must be packed");
+_Static_assert(sizeof(burst_info_t) <= sizeof(((burst_msg_t *)0)->data), "burst_info_t must fit a burst packet");
+_Static_assert(MIC_REFERENCE_CHANNEL < MIC_CHANNELS, "the reference mic must be one of the configured channels");
 
-typedef struct {
-    packet_header_t header;
-    buffer_t buffer;
-} msg_t;
+#define MAX_MSG_SIZE MAX(MAX(sizeof(mic_msg_t), sizeof(adc_msg_t)), sizeof(burst_msg_t))
+#define MSG_SIZE(msg) (sizeof(packet_header_t) + (msg)->header.length * sizeof(int16_t))
 
 
 // --- WiFi & TCP Server Settings ---
 #define SERVER_PORT 5000
+// While streaming, a dead peer is detected by the send path: the socket buffer
+// fills in a few tens of ms, then a send blocked SEND_TIMEOUT_MS ends the link.
+// Keepalive only covers a connection that carries no data. Its timers are whole
+// seconds in lwIP, so it cannot detect a dead peer in under a second.
+#define SEND_TIMEOUT_MS            300    // a send blocked this long means the peer is gone
+#define KEEPALIVE_IDLE_S           1
+#define KEEPALIVE_INTERVAL_S       1
+#define KEEPALIVE_COUNT            1
+#define FLUSH_QUEUE_ON_DISCONNECT  1      // 0: keep unsent packets and deliver them to the next client
+
+#define CLIENT_CONNECTED_BIT BIT0
+
+#define MIC_SLOT_BITS (MIC_SLOT_WORDS == 2 ? I2S_SLOT_BIT_WIDTH_32BIT : I2S_SLOT_BIT_WIDTH_16BIT)
+
+// Stream capabilities announced in the discovery beacon (see discovery.h), filled
+// from the configuration by format_streams_json().
+#if MIC_INTERLEAVED
+#define MIC_STREAM_SOURCE SOURCE_MIC_MULTI
+#else
+#define MIC_STREAM_SOURCE SOURCE_MIC
+#endif
+static char streams_json[DISCOVERY_BEACON_MAX / 2];
+
+// --- Client Connection ---
+// tcp_server_task accepts clients and detects dead ones; OutBoundTask is the only
+// task that sends. A client socket is closed by the task that sends on it:
+// drop_client() only shuts it down (a send blocked on it returns at once) and
+// publishes the change; the outbound task closes the old fd when it sees a new
+// generation. Until then the fd stays allocated, so lwIP cannot hand the same
+// number to the next accept() while a stale send is still in flight.
+// The socket and its generation are published and read together under client_mux.
 static int server_socket = -1;
-static int client_socket = -1;
-
-QueueHandle_t outbound_queue;
+static portMUX_TYPE client_mux = portMUX_INITIALIZER_UNLOCKED;
+static int client_socket = -1;           // -1: no client
+static uint32_t client_generation = 0;   // bumped on every accept and drop
+static EventGroupHandle_t conn_events;
+static int64_t link_lost_us = 0;
+
+// --- Startup Timings ---
+// esp_timer counts from boot, so these are boot-relative. Each capture task only
+// writes its own first_sample_us entry.
+static int64_t first_sample_us[2] = {0, 0};
+static int64_t client_connected_us = 0;
+static uint32_t backlog_at_connect = 0;
 
 // --- WiFi Initialization (Station Mode) ---
+static void on_got_ip(void *arg, esp_event_base_t base, int32_t id, void *data)
+{
+    ESP_LOGI(TAG, "Boot to IP: %lld ms", (long long)(esp_timer_get_time() / 1000));
+}
+
 static void wifi_init_sta(void)
 {
     esp_err_t ret = nvs_flash_init();
@@ -81,7 +151,11 @@ static void wifi_init_sta(void)
 
     wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
     ESP_ERROR_CHECK(esp_wifi_init(&cfg));
-    
+    // The credentials come from secrets.h on every boot: keep them in RAM instead
+    // of rewriting the NVS copy (a flash write) in esp_wifi_set_config.
+    ESP_ERROR_CHECK(esp_wifi_set_storage(WIFI_STORAGE_RAM));
+    ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT, IP_EVENT_STA_GOT_IP, on_got_ip, NULL, NULL));
+
     
     wifi_config_t wifi_config = {
         .sta = {
@@ -99,7 +173,62 @@ static void wifi_init_sta(void)
 }
 
 // --- TCP Server Task ---
-// Creates a listening socket on SERVER_PORT and waits for a client connection.
+// Creates a listening socket on SERVER_PORT and multiplexes it with the client
+// socket through select(): a new connection is accepted immediately (replacing a
+// stale client), and a FIN/RST or keepalive failure on the client wakes the task
+// at once instead of waiting for the send path to fail repeatedly.
+static void configure_client_socket(int sock)
+{
+    int on = 1;
+    int idle = KEEPALIVE_IDLE_S;
+    int interval = KEEPALIVE_INTERVAL_S;
+    int count = KEEPALIVE_COUNT;
+    struct timeval send_timeout = {
+        .tv_sec = SEND_TIMEOUT_MS / 1000,
+        .tv_usec = (SEND_TIMEOUT_MS % 1000) * 1000,
+    };
+    setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on));
+    setsockopt(sock, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+    setsockopt(sock, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval));
+    setsockopt(sock, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof(count));
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout));
+}
+
+static void publish_client(int sock)
+{
+    taskENTER_CRITICAL(&client_mux);
+    client_socket = sock;
+    client_generation++;
+    taskEXIT_CRITICAL(&client_mux);
+}
+
+static int current_client(uint32_t *generation)
+{
+    taskENTER_CRITICAL(&client_mux);
+    int sock = client_socket;
+    *generation = client_generation;
+    taskEXIT_CRITICAL(&client_mux);
+    return sock;
+}
+
+// Only called from tcp_server_task, which stops selecting on the socket here.
+// The outbound task closes it (see Client Connection).
+static void drop_client(const char *reason)
+{
+    xEventGroupClearBits(conn_events, CLIENT_CONNECTED_BIT);
+    discovery_set_client(false);
+    int sock = client_socket;
+    publish_client(-1);
+    shutdown(sock, SHUT_RDWR);
+#if FLUSH_QUEUE_ON_DISCONNECT
+    cring_reset();
+#endif
+    // A burst being uploaded is kept and sent again, from its start, to the next client.
+    link_lost_us = esp_timer_get_time();
+    ESP_LOGI(TAG, "Client disconnected (%s).", reason);
+}
+
 static void tcp_server_task(void *arg)
 {
     struct sockaddr_in server_addr;
@@ -110,6 +239,8 @@ static void tcp_server_task(void *arg)
         vTaskDelete(NULL);
         return;
     }
+    int reuse = 1;
+    setsockopt(server_socket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
     server_addr.sin_family = AF_INET;
     server_addr.sin_addr.s_addr = htonl(INADDR_ANY);
     server_addr.sin_port = htons(SERVER_PORT);
@@ -127,96 +258,276 @@ static void tcp_server_task(void *arg)
     }
     ESP_LOGI(TAG, "TCP server listening on port %d", SERVER_PORT);
     while (1) {
-        struct sockaddr_in client_addr;
-        socklen_t addr_len = sizeof(client_addr);
-        client_socket = accept(server_socket, (struct sockaddr *)&client_addr, &addr_len);
-        if (client_socket < 0) {
-            ESP_LOGE(TAG, "Unable to accept connection: errno %d", errno);
+        fd_set read_fds;
+        FD_ZERO(&read_fds);
+        FD_SET(server_socket, &read_fds);
+        int max_fd = server_socket;
+        int sock = client_socket;
+        if (sock >= 0) {
+            FD_SET(sock, &read_fds);
+            max_fd = MAX(max_fd, sock);
+        }
+        if (select(max_fd + 1, &read_fds, NULL, NULL, NULL) < 0) {
+            ESP_LOGE(TAG, "select failed: errno %d", errno);
             break;
         }
-        ESP_LOGI(TAG, "Client connected.");
-        // Keep the client socket open.
-        while (client_socket >= 0) {
-            vTaskDelay(pdMS_TO_TICKS(100));
+
+        if (sock >= 0 && FD_ISSET(sock, &read_fds)) {
+            // The host only sends BURST_COMMAND; otherwise readability means FIN, RST,
+            // a keepalive timeout or a shutdown() issued by the outbound task after a failed send.
+            char discard[32];
+            int n = recv(sock, discard, sizeof(discard), MSG_DONTWAIT);
+            if (n > 0 && memchr(discard, BURST_COMMAND, n)) {
+                burst_request(BURST_TRIGGER_HOST, esp_timer_get_time());
+            } else if (n == 0) {
+                drop_client("closed by peer");
+            } else if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+                drop_client("socket error");
+            }
+        }
+
+        if (FD_ISSET(server_socket, &read_fds)) {
+            struct sockaddr_in client_addr;
+            socklen_t addr_len = sizeof(client_addr);
+            int new_sock = accept(server_socket, (struct sockaddr *)&client_addr, &addr_len);
+            if (new_sock < 0) {
+                ESP_LOGE(TAG, "Unable to accept connection: errno %d", errno);
+                continue;
+            }
+            if (client_socket >= 0) {
+                drop_client("replaced by new client");
+            }
+            configure_client_socket(new_sock);
+            client_connected_us = esp_timer_get_time();
+            backlog_at_connect = cring_count();
+            publish_client(new_sock);
+            if (link_lost_us) {
+                ESP_LOGI(TAG, "Client connected, link recovered after %lld ms.",
+                         (long long)((esp_timer_get_time() - link_lost_us) / 1000));
+            } else {
+                ESP_LOGI(TAG, "Client connected.");
+            }
+            discovery_set_client(true);
+            xEventGroupSetBits(conn_events, CLIENT_CONNECTED_BIT);
         }
     }
     close(server_socket);
     vTaskDelete(NULL);
 }
 
-static void send_msg(msg_t *msg)
+// --- Outbound Connection ---
+// The outbound task's view of the client: the socket it sends on and its generation.
+static int out_socket = -1;
+static uint32_t out_generation = 0;
+static bool out_failed = false;     // a send failed, skip sends until tcp_server_task drops it
+
+// Adopts the published client. The previous socket was shut down by drop_client()
+// and is closed here, once no send can be using it any more.
+static void sync_client(void)
 {
-    static int errors = 0;
-    if (client_socket < 0) return;
-    int ret = send(client_socket, &(msg->header), sizeof(packet_header_t), 0);
-    if (ret < 0) {
-        if (errors++ > 10) {
-            close(client_socket);
-            client_socket = -1;
-            ESP_LOGI(TAG, "Client disconnected.");
+    uint32_t generation;
+    int sock = current_client(&generation);
+    if (generation == out_generation) return;
+    if (out_socket >= 0) close(out_socket);
+    out_socket = sock;
+    out_generation = generation;
+    out_failed = false;
+}
+
+// Sends one packet (header + samples) of any stream type. Outbound task only.
+static void send_msg(const void *packet)
+{
+    const packet_header_t *header = packet;
+    static uint32_t timed_generation = 0;
+    if (out_socket < 0 || out_failed) return;
+
+    // A short send means the stream is no longer aligned on packet boundaries,
+    // so any failure (including a SO_SNDTIMEO expiry) ends the connection.
+    // Header and samples are contiguous in every message type: one send per packet.
+    size_t size = sizeof(packet_header_t) + header->length * sizeof(int16_t);
+    int ret = send(out_socket, packet, size, 0);
+    if (ret == (int)size) {
+        if (out_generation != timed_generation) {
+            timed_generation = out_generation;
+            DLOGI("TIMING", "Connect to first byte: %d us (backlog %d packets)",
+                  (int)(esp_timer_get_time() - client_connected_us), (int)backlog_at_connect);
         }
-        ESP_LOGE("SEND MSG", "Error sending header: errno %d", errno);
         return;
     }
-    ret = send(client_socket, &(msg->buffer), msg->buffer.end * sizeof(int16_t), 0);
-    if (ret < 0) {
-        if (errors++ > 10) {
-            close(client_socket);
-            client_socket = -1;
-            ESP_LOGI(TAG, "Client disconnected.");
-        }
-        ESP_LOGE("SEND MSG", "Error sending data: errno %d", errno);
+    DLOGE("SEND MSG", "Error sending packet: ret %d errno %d", ret, errno);
+    out_failed = true;
+    // Wakes the select() in tcp_server_task, which drops the client.
+    shutdown(out_socket, SHUT_RDWR);
+}
+
+// Sends the next piece of a frozen burst: its burst_info_t first, then the samples.
+// Called after every live packet (and when the live stream is idle), so bursts
+// only use the link capacity the live stream leaves.
+static void send_burst_chunk(void)
+{
+    static burst_msg_t chunk;
+    static uint32_t generation = UINT32_MAX;   // connection the info packet went to
+    static uint32_t info_id = UINT32_MAX;
+    burst_info_t info;
+    if (cring_count() >= BURST_UPLOAD_MAX_BACKLOG || !burst_upload_pending(&info)) return;
+
+    if (generation != out_generation || info_id != info.id) {
+        // New burst or new client: (re)start with the description.
+        if (generation != out_generation) burst_rewind();
+        generation = out_generation;
+        info_id = info.id;
+        chunk.header.source = SOURCE_BURST_INFO;
+        chunk.header.metadata = info.id & 0xFF;
+        chunk.header.length = (sizeof(info) + 1) / 2;
+        chunk.header.timestamp = info.trigger_us;
+        memcpy(chunk.data, &info, sizeof(info));
+        send_msg(&chunk);
         return;
     }
-    errors = 0;
+    uint32_t offset;
+    int n = burst_read(chunk.data, BURST_CHUNK_SAMPLES, &offset);
+    if (n == 0) return;
+    chunk.header.source = SOURCE_BURST;
+    chunk.header.metadata = info.id & 0xFF;
+    chunk.header.length = n;
+    chunk.header.timestamp = info.first_us + (int64_t)offset * 1000000 / info.rate_hz;
+    send_msg(&chunk);
+}
+
+// Tells the host that `lost` packets were overwritten in the capture ring (the client
+// could not keep up) right before the packet stamped `next_ts`.
+static void send_gap(uint32_t lost, uint64_t next_ts)
+{
+    gap_msg_t gap;
+    gap.header.source = SOURCE_GAP;
+    gap.header.metadata = 0;
+    gap.header.length = sizeof(lost) / sizeof(int16_t);
+    gap.header.timestamp = next_ts;
+    memcpy(gap.data, &lost, sizeof(lost));
+    send_msg(&gap);
+    DLOGW("RING", "Client too slow: %d packets overwritten", (int)lost);
 }
 
 void OutBoundTask(void *arg){
-    outbound_queue = xQueueCreate(256, sizeof(msg_t));
-    msg_t sample;
+    static uint8_t packet[MAX_MSG_SIZE] __attribute__((aligned(4)));
+    uint32_t streamed_generation = UINT32_MAX;   // connection that already got a packet
     for(;;) {
-        if(xQueueReceive(outbound_queue, &sample, portMAX_DELAY)){
-            send_msg(&sample);
+        sync_client();
+        if (out_socket < 0) {
+            // Park while no client is attached instead of draining the ring into a dead socket.
+            xEventGroupWaitBits(conn_events, CLIENT_CONNECTED_BIT, pdFALSE, pdTRUE, portMAX_DELAY);
+            continue;
+        }
+        uint32_t lost;
+        if(cring_pop(packet, sizeof(packet), 10, &lost)){
+            // Overwrites before a client's first packet are older than its stream, not a gap in it.
+            if (lost && streamed_generation == out_generation) {
+                send_gap(lost, ((const packet_header_t *)packet)->timestamp);
+            }
+            streamed_generation = out_generation;
+            send_msg(packet);
         }
+        send_burst_chunk();
     }
     vTaskDelete(NULL);
 }
 
 
-void QI2Smsg(int16_t *buffer, int size) {
-    if (client_socket < 0) return;
+// Capture never waits for a client: packets go into the capture ring, which keeps
+// the most recent ones until the outbound task can send them.
+static void note_first_sample(int source)
+{
+    if (first_sample_us[source] == 0) {
+        first_sample_us[source] = esp_timer_get_time();
+        if (source == SOURCE_MIC) {
+            DLOGI("TIMING", "Boot to first mic sample: %d ms", (int)(first_sample_us[source] / 1000));
+        } else {
+            DLOGI("TIMING", "Boot to first ADC sample: %d ms", (int)(first_sample_us[source] / 1000));
+        }
+    }
+}
 
-    int num_samples = size/2;
-    assert(num_samples <= MIC_BUFFER_SIZE);
-    
-    msg_t sample;
-    sample.header.source = SOURCE_MIC;
-    sample.header.metadata = 0;
-    sample.header.length = num_samples;  // Number of 16-bit samples produced
-    sample.header.timestamp = esp_timer_get_time();
-    sample.buffer.end = num_samples;
-    // int skipFirst = (buffer[0] == 0);
-    int skipFirst = 1;
-    for (int j = 0; j < num_samples; j++) {
-        sample.buffer.data[j] = buffer[2 * j + skipFirst];
+// --- Stream Output ---
+// Finished packets of a lane with a processing stage go to the DSP workers
+// (dsp_offload.h), which push them to the capture ring after the stage. Every other
+// packet goes straight to the ring: lanes without a stage, offload disabled in
+// menuconfig, or dsp_init() out of memory.
+#if DSP_OFFLOAD
+static const dsp_stage_t dsp_stages[DSP_LANES] = {
+    [DSP_LANE_MIC] = NULL,   // no stage yet
+    [DSP_LANE_ADC] = NULL,
+};
+#endif
+static bool dsp_lane_active[DSP_LANES];
+
+static void ring_sink(const void *packet, size_t size)
+{
+    cring_push(packet, size);
+}
+
+static inline void stream_out(int lane, const void *packet, size_t size)
+{
+    if (DSP_OFFLOAD && dsp_lane_active[lane]) {
+        dsp_submit(lane, packet, size);
+    } else {
+        ring_sink(packet, size);
     }
-    xQueueSend(outbound_queue, &sample, portMAX_DELAY);
-    // vTaskDelay(pdMS_TO_TICKS(10));
 }
 
+// --- Mic Capture Cost ---
+// Time spent in QI2Smsg (split + hand-off to the DSP lane or ring), summed by the mic task and reported
+// by periodiclogger against the real-time budget of one DMA read.
+static volatile uint32_t mic_cost_us = 0;
+static volatile uint32_t mic_cost_blocks = 0;
 
-void QADCmsg(uint8_t * buffer, int size){
-    if (client_socket < 0) return;
+// One DMA read of MIC_FRAMES frames: a single pass writes every channel straight into
+// its packet (per channel, or interleaved), reference subtraction included. Every
+// layout argument of mic_split() is a configuration constant, see mic_channels.h.
+void QI2Smsg(int16_t *buffer, int size) {
+#if MIC_INTERLEAVED
+    static mic_msg_t samples[1] __attribute__((aligned(4)));
+    #define MIC_OUT(c) (samples[0].data + (c))
+    #define MIC_STRIDE MIC_CHANNELS
+#else
+    static mic_msg_t samples[MIC_CHANNELS] __attribute__((aligned(4)));
+    #define MIC_OUT(c) (samples[c].data)
+    #define MIC_STRIDE 1
+#endif
+    int64_t start = esp_timer_get_time();
+    int frames = size / (MIC_CHANNELS * MIC_SLOT_WORDS);
+    assert(frames <= MIC_FRAMES);
+
+    void *out[MIC_CHANNELS];
+    for (int c = 0; c < MIC_CHANNELS; c++) {
+        out[c] = MIC_OUT(c);
+    }
+    mic_split(buffer, frames, out, MIC_CHANNELS, MIC_SLOT_WORDS, MIC_SLOT_WORD, MIC_STRIDE,
+              MIC_REFERENCE_CHANNEL, MIC_REFERENCE_GAIN_Q15);
+
+    for (int c = 0; c < (int)(sizeof(samples) / sizeof(samples[0])); c++) {
+        mic_msg_t *sample = &samples[c];
+        sample->header.source = MIC_INTERLEAVED ? SOURCE_MIC_MULTI : SOURCE_MIC;
+        sample->header.metadata = MIC_INTERLEAVED ? MIC_CHANNELS : c;
+        sample->header.length = frames * MIC_STRIDE;  // Number of 16-bit samples produced
+        sample->header.timestamp = start;
+        stream_out(DSP_LANE_MIC, sample, MSG_SIZE(sample));
+    }
+    note_first_sample(SOURCE_MIC);
+    mic_cost_us += (uint32_t)(esp_timer_get_time() - start);
+    mic_cost_blocks++;
+}
 
-    int num_conv = size / SOC_ADC_DIGI_RESULT_BYTES;
-    assert(num_conv <= ADC_BUFFER_SIZE);
 
-    msg_t sample;
-    sample.header.source = SOURCE_ADC;
-    sample.header.metadata = 0;
-    sample.header.length = num_conv;
-    sample.header.timestamp = esp_timer_get_time();
-    sample.buffer.end = num_conv;
+// One DMA frame of BURST_ADC_SAMPLE_RATE conversions: all of it goes to the burst
+// capture, and its decimated ADC_SAMPLE_RATE version fills the continuous packets.
+void QADCmsg(uint8_t * buffer, int size){
+    static uint16_t raw[ADC_DMA_FRAME];
+    static uint16_t decimated[ADC_DMA_FRAME / BURST_DECIMATION + 16];
+    static adc_msg_t sample;
+    static int filled = 0;
+    int64_t now = esp_timer_get_time();
+    int num_conv = size / SOC_ADC_DIGI_RESULT_BYTES;
+    assert(num_conv <= ADC_DMA_FRAME);
 
     for (int i = 0; i < num_conv; i++) {
         // Each conversion result occupies SOC_ADC_DIGI_RESULT_BYTES (likely 4 bytes for TYPE2).
@@ -225,11 +536,23 @@ void QADCmsg(uint8_t * buffer, int size){
         // uint32_t data = p->type2.data;
         uint32_t data = p->val;
         // Format into 16 bits: upper 4 bits for channel, lower 12 bits for ADC data.
-        sample.buffer.data[i] = ((chan & 0xF) << 12) | (data & 0x0FFF);
+        raw[i] = ((chan & 0xF) << 12) | (data & 0x0FFF);
+    }
+    burst_feed(raw, num_conv, now);
+
+    int n = burst_decimate(raw, num_conv, decimated);
+    for (int i = 0; i < n; i++) {
+        sample.data[filled++] = decimated[i];
+        if (filled == ADC_BUFFER_SIZE) {
+            sample.header.source = SOURCE_ADC;
+            sample.header.metadata = 0;
+            sample.header.length = ADC_BUFFER_SIZE;
+            sample.header.timestamp = now;
+            note_first_sample(SOURCE_ADC);
+            stream_out(DSP_LANE_ADC, &sample, sizeof(sample));
+            filled = 0;
+        }
     }
-    // ESP_LOGI("ADC", "SENT %d", num_conv);
-    xQueueSend(outbound_queue, &sample, portMAX_DELAY);
-    // vTaskDelay(pdMS_TO_TICKS(10));
 }
 
 
@@ -245,9 +568,11 @@ static void mic_task(void *arg)
     i2s_new_channel(&chan_cfg, NULL, &rx_handle);
 
     /* Setting the configurations, the slot configuration and clock configuration can be generated by the macros*/
+#if MIC_CHANNELS <= 2
     i2s_std_config_t std_cfg = {
         .clk_cfg = I2S_STD_CLK_DEFAULT_CONFIG(I2S_MIC_SAMPLE_RATE),
-        .slot_cfg = I2S_STD_MSB_SLOT_DEFAULT_CONFIG(I2S_DATA_BIT_WIDTH_16BIT, I2S_SLOT_MODE_MONO),
+        .slot_cfg = I2S_STD_MSB_SLOT_DEFAULT_CONFIG(I2S_DATA_BIT_WIDTH_16BIT,
+                                                    MIC_CHANNELS == 1 ? I2S_SLOT_MODE_MONO : I2S_SLOT_MODE_STEREO),
         .gpio_cfg = {
             .mclk = I2S_GPIO_UNUSED,
             .bclk = GPIO_NUM_9,
@@ -263,7 +588,30 @@ static void mic_task(void *arg)
     };
 
     /* Initialize the channel */
+    std_cfg.slot_cfg.slot_bit_width = MIC_SLOT_BITS;
     i2s_channel_init_std_mode(rx_handle, &std_cfg);
+#else
+    // TDM: one slot per mic on the same data line, in slot order.
+    i2s_tdm_config_t tdm_cfg = {
+        .clk_cfg = I2S_TDM_CLK_DEFAULT_CONFIG(I2S_MIC_SAMPLE_RATE),
+        .slot_cfg = I2S_TDM_MSB_SLOT_DEFAULT_CONFIG(I2S_DATA_BIT_WIDTH_16BIT, I2S_SLOT_MODE_STEREO,
+                                                    (1 << MIC_CHANNELS) - 1),
+        .gpio_cfg = {
+            .mclk = I2S_GPIO_UNUSED,
+            .bclk = GPIO_NUM_9,
+            .ws = GPIO_NUM_7,
+            .dout = I2S_GPIO_UNUSED,
+            .din = GPIO_NUM_8,
+            .invert_flags = {
+                .mclk_inv = false,
+                .bclk_inv = false,
+                .ws_inv = false,
+            },
+        },
+    };
+    tdm_cfg.slot_cfg.slot_bit_width = MIC_SLOT_BITS;
+    i2s_channel_init_tdm_mode(rx_handle, &tdm_cfg);
+#endif
 
     /* Before reading data, start the RX channel first */
     i2s_channel_enable(rx_handle);
@@ -272,8 +620,8 @@ static void mic_task(void *arg)
     gpio_set_level(GPIO_NUM_44, 0);
 
     size_t bytes_read = 0;
-    // Temporary buffer for raw I2S data (each sample is 32 bits)
-    int16_t i2s_read_buf[MIC_BUFFER_SIZE*2];
+    // Temporary buffer for raw I2S data (one slot of MIC_SLOT_WORDS words per mic)
+    static int16_t i2s_read_buf[MIC_FRAMES*MIC_SLOT_WORDS*MIC_CHANNELS];
     while (1) {
         esp_err_t ret = i2s_channel_read(rx_handle, i2s_read_buf, sizeof(i2s_read_buf), &bytes_read, portMAX_DELAY);
         if (ret == ESP_OK && bytes_read > 0) {
@@ -292,28 +640,28 @@ static void adc_task(void *arg)
 {
     adc_continuous_handle_t adc_handle = NULL;
     adc_continuous_handle_cfg_t adc_config = {
-        .max_store_buf_size = ADC_BUFFER_SIZE*SOC_ADC_DIGI_RESULT_BYTES*4,
-        .conv_frame_size = ADC_BUFFER_SIZE*SOC_ADC_DIGI_RESULT_BYTES,
+        .max_store_buf_size = ADC_DMA_FRAME*SOC_ADC_DIGI_RESULT_BYTES*4,
+        .conv_frame_size = ADC_DMA_FRAME*SOC_ADC_DIGI_RESULT_BYTES,
     };
     ESP_ERROR_CHECK(adc_continuous_new_handle(&adc_config, &adc_handle));
 
     // Configure ADC continuous mode for two channels.
     adc_continuous_config_t adc_cont_config = {
         .pattern_num = 2,
-        .sample_freq_hz = ADC_SAMPLE_RATE,     // ADC sampling frequency in Hz  // SOC_ADC_SAMPLE_FREQ_THRES_HIGH
+        .sample_freq_hz = BURST_ADC_SAMPLE_RATE,  // decimated to ADC_SAMPLE_RATE in QADCmsg  // SOC_ADC_SAMPLE_FREQ_THRES_HIGH
         .conv_mode = ADC_CONV_SINGLE_UNIT_1,   // Using ADC1
         .format = ADC_DIGI_OUTPUT_FORMAT_TYPE2,
     }; 
     adc_digi_pattern_config_t adc_pattern[2] = {
         {
             .atten = ADC_ATTEN_DB_12,//ADC_ATTEN_DB_0,
-            .channel = ADC1_CHANNEL_1,
+            .channel = ADC_CHANNEL_A,
             .unit = ADC_UNIT_1,
             .bit_width = SOC_ADC_DIGI_MIN_BITWIDTH,
         },
         {
             .atten = ADC_ATTEN_DB_12,
-            .channel = ADC1_CHANNEL_3,
+            .channel = ADC_CHANNEL_B,
             .unit = ADC_UNIT_1,
             .bit_width = SOC_ADC_DIGI_MIN_BITWIDTH,
         },
@@ -323,7 +671,7 @@ static void adc_task(void *arg)
     ESP_ERROR_CHECK(adc_continuous_config(adc_handle, &adc_cont_config));
     ESP_ERROR_CHECK(adc_continuous_start(adc_handle));
     
-    uint8_t adc_dma_buf[ADC_BUFFER_SIZE*SOC_ADC_DIGI_RESULT_BYTES];
+    static uint8_t adc_dma_buf[ADC_DMA_FRAME*SOC_ADC_DIGI_RESULT_BYTES];
     uint32_t adc_bytes_read = 0;
     while (1) {
         esp_err_t ret = adc_continuous_read(adc_handle, adc_dma_buf, sizeof(adc_dma_buf), &adc_bytes_read, pdMS_TO_TICKS(1000));
@@ -334,6 +682,37 @@ static void adc_task(void *arg)
     vTaskDelete(NULL);
 }
 
+// Busy share of each core, and how much of the DSP core the workers take, since the
+// previous report. Lane drops mean the workers fell behind the capture tasks.
+static void log_core_load(void)
+{
+    uint16_t load[CORE_LOAD_MAX_CORES];
+    int cores = core_load_sample(load, CORE_LOAD_MAX_CORES);
+    if (cores == 2) {
+        ESP_LOGI(TAG, "Cores: 0 %d.%d%% busy, 1 %d.%d%% busy",
+                 load[0] / 10, load[0] % 10, load[1] / 10, load[1] % 10);
+    }
+#if DSP_OFFLOAD
+    static int64_t last_us;
+    static uint32_t last_busy_us[DSP_LANES];
+    int64_t now = esp_timer_get_time();
+    uint32_t elapsed = (uint32_t)(now - last_us);
+    last_us = now;
+    for (int i = 0; i < DSP_LANES; i++) {
+        if (!dsp_lane_active[i]) continue;
+        dsp_lane_stats_t lane;
+        dsp_get_stats(i, &lane);
+        uint32_t busy = lane.busy_us - last_busy_us[i];
+        last_busy_us[i] = lane.busy_us;
+        ESP_LOGI(TAG, "DSP lane %s: %lu processed, %lu dropped, peak %lu/%lu, %lu.%lu%% of core %d",
+                 i == DSP_LANE_MIC ? "mic" : "adc", (unsigned long)lane.processed, (unsigned long)lane.dropped,
+                 (unsigned long)lane.high_water, (unsigned long)lane.slots,
+                 (unsigned long)((uint64_t)busy * 100 / elapsed), (unsigned long)((uint64_t)busy * 1000 / elapsed % 10),
+                 DSP_CORE);
+    }
+#endif
+}
+
 void periodiclogger(void *arg)
 {
     while (1) {
@@ -346,27 +725,143 @@ void periodiclogger(void *arg)
             ESP_LOGI(TAG, "Failed to get network interface");
         }
 
-        int outBoundmsgs = uxQueueMessagesWaiting(outbound_queue);
-        if (outBoundmsgs > 0 ){
-            ESP_LOGI(TAG, "Outbound messages in queue: %d", outBoundmsgs);
+        uint32_t blocks = mic_cost_blocks, cost = mic_cost_us;
+        mic_cost_blocks = 0;
+        mic_cost_us = 0;
+        if (blocks > 0) {
+            // Real-time budget of one block: MIC_FRAMES frames at I2S_MIC_SAMPLE_RATE.
+            uint32_t per_block = cost / blocks;
+            uint32_t budget = (uint32_t)(1000000ULL * MIC_FRAMES / I2S_MIC_SAMPLE_RATE);
+            ESP_LOGI(TAG, "Mic: %d channel(s), %lu us per %d-frame block (%lu.%lu%% of %lu us), %lu B/s",
+                     MIC_CHANNELS, (unsigned long)per_block, MIC_FRAMES,
+                     (unsigned long)(per_block * 100 / budget), (unsigned long)(per_block * 1000 / budget % 10),
+                     (unsigned long)budget,
+                     (unsigned long)(I2S_MIC_SAMPLE_RATE * MIC_CHANNELS * sizeof(int16_t)
+                                     + sizeof(packet_header_t) * I2S_MIC_SAMPLE_RATE / MIC_FRAMES
+                                       * (MIC_INTERLEAVED ? 1 : MIC_CHANNELS)));
+        }
+
+        cring_stats_t ring;
+        cring_get_stats(&ring);
+        if (ring.count > 0 || ring.overwritten > 0) {
+            ESP_LOGI(TAG, "Outbound messages in ring: %lu (%lu/%lu bytes, peak %lu, overwritten %lu)",
+                     (unsigned long)ring.count, (unsigned long)ring.used, (unsigned long)ring.bytes,
+                     (unsigned long)ring.high_water, (unsigned long)ring.overwritten);
+        }
+
+        log_core_load();
+
+        burst_stats_t bursts;
+        burst_get_stats(&bursts);
+        if (bursts.bursts > 0 || bursts.missed > 0) {
+            ESP_LOGI(TAG, "Bursts: %lu captured, %lu uploaded, %lu triggers missed",
+                     (unsigned long)bursts.bursts, (unsigned long)bursts.uploaded, (unsigned long)bursts.missed);
         }
         vTaskDelay(pdMS_TO_TICKS(3000));
     }
 }
 
-void app_main(void)
+// Stream capabilities for the discovery beacon, from the configuration.
+static const char *format_streams_json(void)
+{
+    snprintf(streams_json, sizeof(streams_json),
+             "[{\"src\":%d,\"kind\":\"mic\",\"rate\":%d,\"samples\":%d,\"channels\":%d},"
+             "{\"src\":%d,\"kind\":\"adc\",\"rate\":%d,\"samples\":%d,\"channels\":[%d,%d],\"bits\":12},"
+             "{\"src\":%d,\"kind\":\"adc_burst\",\"rate\":%d,\"pre\":%d,\"post\":%d,\"channels\":[%d,%d],\"bits\":12}]",
+             MIC_STREAM_SOURCE, I2S_MIC_SAMPLE_RATE, MIC_BUFFER_SIZE, MIC_CHANNELS,
+             SOURCE_ADC, ADC_SAMPLE_RATE, ADC_BUFFER_SIZE, ADC_CHANNEL_A, ADC_CHANNEL_B,
+             SOURCE_BURST, BURST_ADC_SAMPLE_RATE, BURST_PRE_SAMPLES, BURST_POST_SAMPLES, ADC_CHANNEL_A, ADC_CHANNEL_B);
+    return streams_json;
+}
+
+// What the configured streams cost on the link and how long the ring holds them.
+// The build prints the same figures (CMakeLists.txt).
+static void log_stream_budget(uint32_t ring_bytes)
+{
+    uint32_t mic_packets = I2S_MIC_SAMPLE_RATE * (MIC_INTERLEAVED ? 1 : MIC_CHANNELS) / MIC_FRAMES;
+    uint32_t adc_packets = ADC_SAMPLE_RATE / ADC_BUFFER_SIZE;
+    uint32_t mic_rate = mic_packets * (sizeof(mic_msg_t) + sizeof(uint16_t));  // ring records
+    uint32_t adc_rate = adc_packets * (sizeof(adc_msg_t) + sizeof(uint16_t));
+    ESP_LOGI(TAG, "Streams: mic %d Hz x%d in %d-byte packets (%lu/s), adc %d Hz in %d-byte packets (%lu/s)",
+             I2S_MIC_SAMPLE_RATE, MIC_CHANNELS, (int)sizeof(mic_msg_t), (unsigned long)mic_packets,
+             ADC_SAMPLE_RATE, (int)sizeof(adc_msg_t), (unsigned long)adc_packets);
+    ESP_LOGI(TAG, "Streams: %lu B/s, ring holds %lu ms",
+             (unsigned long)(mic_rate + adc_rate),
+             (unsigned long)((uint64_t)ring_bytes * 1000 / (mic_rate + adc_rate)));
+}
+
+#if BURST_TRIGGER_GPIO >= 0
+static void IRAM_ATTR burst_gpio_isr(void *arg)
+{
+    burst_request(BURST_TRIGGER_GPIO_EDGE, esp_timer_get_time());
+}
+#endif
+
+// --- Network Bring-up ---
+// NVS, Wi-Fi association and DHCP take seconds; they run here, in parallel with the
+// capture tasks, instead of in front of them.
+static void net_init_task(void *arg)
 {
-    ESP_LOGI(TAG, "Starting streaming application");
     wifi_init_sta();
-    
+    discovery_start(SERVER_PORT, format_streams_json());
     // Create the TCP server task.
     xTaskCreate(tcp_server_task, "tcp_server", 4096, NULL, 5, NULL);
-    xTaskCreate(OutBoundTask, "outBound", 4096*4, NULL, 7, NULL);
     // Create periodic logger task.
     xTaskCreate(periodiclogger, "periodiclogger", 4096, NULL, 1, NULL);
-    // Create microphone task.
+    vTaskDelete(NULL);
+}
+
+void app_main(void)
+{
+    ESP_LOGI(TAG, "Starting streaming application");
+    // Deferred logger first: the capture and send paths log through it.
+    dlog_start_task();
+    conn_events = xEventGroupCreate();
+    uint32_t bytes = cring_init(CAPTURE_RING_PSRAM_BYTES, CAPTURE_RING_INTERNAL_BYTES);
+    cring_stats_t ring;
+    cring_get_stats(&ring);
+    ESP_LOGI(TAG, "Capture ring: %lu bytes in %s", (unsigned long)bytes, ring.in_psram ? "PSRAM" : "internal RAM");
+    log_stream_budget(bytes);
+    if (burst_init()) {
+        burst_stats_t bursts;
+        burst_get_stats(&bursts);
+        ESP_LOGI(TAG, "Burst capture: %d+%d samples at %d Hz in %s", BURST_PRE_SAMPLES, BURST_POST_SAMPLES,
+                 BURST_ADC_SAMPLE_RATE, bursts.in_psram ? "PSRAM" : "internal RAM");
+    } else {
+        ESP_LOGE(TAG, "Burst capture disabled: out of memory");
+    }
+#if BURST_TRIGGER_GPIO >= 0
+    gpio_set_direction(BURST_TRIGGER_GPIO, GPIO_MODE_INPUT);
+    gpio_set_intr_type(BURST_TRIGGER_GPIO, GPIO_INTR_POSEDGE);
+    gpio_install_isr_service(0);
+    gpio_isr_handler_add(BURST_TRIGGER_GPIO, burst_gpio_isr, NULL);
+#endif
+
+#if DSP_OFFLOAD
+    // Workers before the capture tasks, so the lanes are drained from the first packet.
+    // They run below the capture priority: heavy processing can lag, never starve capture.
+    // Without any stage the lanes would only add a copy and a task hop, so they are skipped.
+    bool any_stage = false;
+    for (int i = 0; i < DSP_LANES; i++) any_stage |= dsp_stages[i] != NULL;
+    if (!any_stage) {
+        ESP_LOGI(TAG, "DSP offload: no stage installed, packets go straight to the capture ring");
+    } else if (dsp_init(MAX(sizeof(mic_msg_t), sizeof(adc_msg_t)), DSP_LANE_SLOTS, ring_sink)) {
+        for (int i = 0; i < DSP_LANES; i++) {
+            dsp_set_stage(i, dsp_stages[i]);
+            dsp_lane_active[i] = dsp_stages[i] != NULL;
+        }
+        dsp_start_workers(DSP_WORKERS, DSP_CORE, 4);
+        ESP_LOGI(TAG, "DSP offload: %d worker(s) on core %d, %d packets per lane",
+                 DSP_WORKERS, DSP_CORE, DSP_LANE_SLOTS);
+    } else {
+        ESP_LOGE(TAG, "DSP offload: out of memory, packets go straight to the capture ring");
+    }
+#endif
+
+    // Capture starts right away; packets wait in the capture ring until a client connects.
     xTaskCreate(mic_task, "mic_task", 4096*2, NULL, 5, NULL);
-    // Create ADC task.
     xTaskCreate(adc_task, "adc_task", 4096*2, NULL, 5, NULL);
+    xTaskCreate(OutBoundTask, "outBound", 4096*4, NULL, 7, NULL);
+    xTaskCreate(net_init_task, "net_init", 4096, NULL, 4, NULL);
     ESP_LOGI(TAG, "Application started");
 }
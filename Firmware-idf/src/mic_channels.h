@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdint.h>
+
+// --- Multi-Microphone Capture ---
+// Splits I2S DMA frames (stereo or TDM, one slot per mic) into packet buffers in a
+// single pass: every DMA word is read once and written straight to its place in
+// the outgoing message, either one buffer per channel (stride 1) or one interleaved
+// buffer (stride = channels). The optional reference subtraction (an ambient-noise
+// mic removed from channel 0) is applied while channel 0 is copied, not as an extra pass.
+//
+// mic_split() is always inlined and main.c calls it with the menuconfig values
+// (stream_config.h), so every layout parameter is a compile-time constant: the
+// compiler emits one straight strided copy per channel for the configured slot
+// encoding, layout and reference, with no per-sample branches or lookups.
+// The header builds on the host, where the split can be checked and timed.
+
+#define MIC_MAX_CHANNELS 4
+
+typedef struct __attribute__((packed)) {
+    int16_t value;
+} mic_sample_t;  // packet buffers are packed: no alignment assumption on writes
+
+static inline int16_t mic_saturate16(int32_t v)
+{
+    return v > INT16_MAX ? INT16_MAX : (v < INT16_MIN ? INT16_MIN : (int16_t)v);
+}
+
+// Write `frames` frames of `dma` to out[c][j * stride] (channel c, frame j).
+// A frame is `channels` slots of `slot_words` int16 words; a mic's sample is word
+// `slot_word` of its slot. reference > 0 subtracts that channel (gain in Q15) from channel 0.
+static inline __attribute__((always_inline))
+void mic_split(const int16_t *dma, int frames, void *const *out,
+               const int channels, const int slot_words, const int slot_word, const int stride,
+               const int reference, const int32_t reference_gain_q15)
+{
+    const int words = channels * slot_words;
+    // Channel-major: each channel is one strided copy, which keeps the loop free of
+    // per-sample channel lookups. Each DMA word is still read once (the reference
+    // twice when it is subtracted).
+    for (int c = 0; c < channels; c++) {
+        const int16_t *src = dma + c * slot_words + slot_word;
+        mic_sample_t *d = out[c];
+        if (c == 0 && reference > 0 && reference < channels) {
+            const int16_t *ref = dma + reference * slot_words + slot_word;
+            for (int j = 0; j < frames; j++) {
+                d[j * stride].value = mic_saturate16(src[j * words] - ((ref[j * words] * reference_gain_q15) >> 15));
+            }
+        } else {
+            for (int j = 0; j < frames; j++) {
+                d[j * stride].value = src[j * words];
+            }
+        }
+    }
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+// --- Stream Configuration ---
+// Rates, packet sizes, channel patterns and encodings are set in menuconfig
+// ("Murmurator streams", Kconfig.projbuild). Every stream gets a message type
+// sized exactly for it from these values (main.c), and the build prints the
+// resulting RAM and link budget (CMakeLists.txt).
+// The fallbacks below are the Kconfig defaults, for host builds of the modules.
+
+#ifdef ESP_PLATFORM
+#include "sdkconfig.h"
+#endif
+
+#ifndef CONFIG_MURMUR_MIC_SAMPLE_RATE
+#define CONFIG_MURMUR_MIC_SAMPLE_RATE       48000
+#define CONFIG_MURMUR_MIC_PACKET_SAMPLES    256
+#define CONFIG_MURMUR_MIC_CHANNELS          1
+#define CONFIG_MURMUR_MIC_REFERENCE_CHANNEL -1
+#define CONFIG_MURMUR_MIC_REFERENCE_GAIN_Q15 32768
+#define CONFIG_MURMUR_ADC_SAMPLE_RATE       8000
+#define CONFIG_MURMUR_ADC_PACKET_SAMPLES    256
+#define CONFIG_MURMUR_ADC_CHANNEL_A         1
+#define CONFIG_MURMUR_ADC_CHANNEL_B         3
+#define CONFIG_MURMUR_ADC_OVERSAMPLING      10
+#define CONFIG_MURMUR_BURST_PRE_MS          50
+#define CONFIG_MURMUR_BURST_POST_MS         150
+#define CONFIG_MURMUR_BURST_THRESHOLD       400
+#define CONFIG_MURMUR_BURST_TRIGGER_GPIO    -1
+#define CONFIG_MURMUR_RING_PSRAM_KB         2048
+#define CONFIG_MURMUR_RING_INTERNAL_KB      128
+#define CONFIG_MURMUR_DSP_WORKERS           1
+#define CONFIG_MURMUR_DSP_CORE              1
+#define CONFIG_MURMUR_DSP_LANE_SLOTS        16
+#endif
+
+// --- Microphone ---
+#define I2S_MIC_SAMPLE_RATE    CONFIG_MURMUR_MIC_SAMPLE_RATE
+#define MIC_BUFFER_SIZE        CONFIG_MURMUR_MIC_PACKET_SAMPLES   // samples per packet
+#define MIC_CHANNELS           CONFIG_MURMUR_MIC_CHANNELS         // 1: mono, 2: stereo (std mode), 3-4: TDM
+#ifdef CONFIG_MURMUR_MIC_INTERLEAVED
+#define MIC_INTERLEAVED        1      // SOURCE_MIC_MULTI packets, frames interleaved
+#else
+#define MIC_INTERLEAVED        0      // one SOURCE_MIC packet per channel
+#endif
+#define MIC_REFERENCE_CHANNEL  CONFIG_MURMUR_MIC_REFERENCE_CHANNEL  // >0: subtracted from channel 0
+#define MIC_REFERENCE_GAIN_Q15 CONFIG_MURMUR_MIC_REFERENCE_GAIN_Q15
+// DMA encoding: a mic slot is one 32-bit word (keep its upper 16 bits) or one 16-bit word.
+#if defined(CONFIG_MURMUR_MIC_SLOT_32BIT) && MIC_CHANNELS > 1   // mono keeps the 16-bit slots
+#define MIC_SLOT_WORDS         2
+#define MIC_SLOT_WORD          1
+#else
+#define MIC_SLOT_WORDS         1
+#define MIC_SLOT_WORD          0
+#endif
+// Frames per DMA read: one full packet per channel, or one full interleaved packet.
+#define MIC_FRAMES             (MIC_INTERLEAVED ? MIC_BUFFER_SIZE / MIC_CHANNELS : MIC_BUFFER_SIZE)
+#define MIC_PACKET_SAMPLES     (MIC_INTERLEAVED ? MIC_FRAMES * MIC_CHANNELS : MIC_FRAMES)
+
+// --- ADC ---
+#define ADC_SAMPLE_RATE        CONFIG_MURMUR_ADC_SAMPLE_RATE      // continuous stream, both channels
+#define ADC_BUFFER_SIZE        CONFIG_MURMUR_ADC_PACKET_SAMPLES
+#define ADC_CHANNEL_A          CONFIG_MURMUR_ADC_CHANNEL_A        // conversion pattern: A, B, A, B, ...
+#define ADC_CHANNEL_B          CONFIG_MURMUR_ADC_CHANNEL_B
+
+// --- ADC Bursts (adc_burst.h) ---
+// The hardware runs BURST_DECIMATION times faster than the stream; bursts keep the full rate.
+#define BURST_DECIMATION       CONFIG_MURMUR_ADC_OVERSAMPLING
+#define BURST_ADC_SAMPLE_RATE  (ADC_SAMPLE_RATE * BURST_DECIMATION)   // checked against the SoC limit in adc_burst.c
+#define ADC_DMA_FRAME          (ADC_BUFFER_SIZE * BURST_DECIMATION / 4)   // conversions per DMA frame: a quarter stream packet
+#define BURST_PRE_SAMPLES      (BURST_ADC_SAMPLE_RATE / 1000 * CONFIG_MURMUR_BURST_PRE_MS)
+#define BURST_POST_SAMPLES     (BURST_ADC_SAMPLE_RATE / 1000 * CONFIG_MURMUR_BURST_POST_MS)
+#define BURST_TRIGGER_CHANNEL  ADC_CHANNEL_A
+#define BURST_THRESHOLD        CONFIG_MURMUR_BURST_THRESHOLD      // counts away from the baseline (12-bit scale)
+#define BURST_TRIGGER_GPIO     CONFIG_MURMUR_BURST_TRIGGER_GPIO   // rising edge triggers a burst, -1: disabled
+
+// --- Capture Ring (capture_ring.h) ---
+#define CAPTURE_RING_PSRAM_BYTES     (CONFIG_MURMUR_RING_PSRAM_KB * 1024)
+#define CAPTURE_RING_INTERNAL_BYTES  (CONFIG_MURMUR_RING_INTERNAL_KB * 1024)
+
+// --- Processing Offload (dsp_offload.h) ---
+#ifdef CONFIG_MURMUR_DSP_OFFLOAD
+#define DSP_OFFLOAD            1
+#define DSP_WORKERS            CONFIG_MURMUR_DSP_WORKERS
+#define DSP_CORE               CONFIG_MURMUR_DSP_CORE             // Wi-Fi and lwIP run on core 0
+#define DSP_LANE_SLOTS         CONFIG_MURMUR_DSP_LANE_SLOTS
+#else
+#define DSP_OFFLOAD            0
+#endif
@@ -0,0 +1,236 @@
+// ADC bursts on the host: the threshold trigger (only once the baseline has
+// settled), the window placed around threshold and host triggers, the upload in
+// chunks, and the triggers counted as missed while a burst is busy or while an
+// earlier request waits.
+//
+// The feed emulates the ADC driver: DMA frames of interleaved A/B conversions at
+// BURST_ADC_SAMPLE_RATE, each stamped with the time of its last conversion.
+// Channel B carries the conversion index, so every burst sample can be traced
+// back to the conversion it came from.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "adc_burst.h"
+#include "host_test.h"
+
+#define FRAME        1000                   // conversions per burst_feed() call
+#define T0_US        1000000
+#define BASE         2000                   // trigger channel level at rest
+#define STEP         (BURST_THRESHOLD + 50)
+#define SAMPLE_US    (1000000 / BURST_ADC_SAMPLE_RATE + 1)
+#define BURST_TOTAL  (BURST_PRE_SAMPLES + BURST_POST_SAMPLES)
+
+static uint32_t fed;                        // conversions fed so far
+static uint32_t pulses[16][2];              // trigger channel at BASE + STEP in [from, to)
+static int n_pulses;
+
+static int64_t time_of_sample(uint32_t i)
+{
+    return T0_US + (int64_t)i * 1000000 / BURST_ADC_SAMPLE_RATE;
+}
+
+static uint16_t sample_at(uint32_t i)
+{
+    if (i % 2) return (uint16_t)((ADC_CHANNEL_B << 12) | ((i / 2) & 0x0FFF));
+    int level = BASE;
+    for (int p = 0; p < n_pulses; p++) {
+        if (i >= pulses[p][0] && i < pulses[p][1]) level = BASE + STEP;
+    }
+    return (uint16_t)((BURST_TRIGGER_CHANNEL << 12) | level);
+}
+
+static void feed(uint32_t n)
+{
+    static uint16_t frame[FRAME];
+    while (n > 0) {
+        uint32_t len = n < FRAME ? n : FRAME;
+        for (uint32_t k = 0; k < len; k++) frame[k] = sample_at(fed + k);
+        burst_feed(frame, (int)len, time_of_sample(fed + len - 1));
+        fed += len;
+        n -= len;
+    }
+}
+
+// A pulse on the trigger channel, starting at the first A conversion `after` from now.
+static uint32_t pulse(uint32_t after, uint32_t length)
+{
+    CHECK(n_pulses < 16);
+    uint32_t from = (fed + after + 1) & ~1u;
+    pulses[n_pulses][0] = from;
+    pulses[n_pulses][1] = from + length;
+    n_pulses++;
+    return from;
+}
+
+// Conversion index of the first sample of the frozen burst: channel B carries
+// idx / 2, which repeats every 8192 conversions, so the candidate nearest `near` wins.
+static uint32_t first_index(uint32_t near)
+{
+    uint16_t head[2];
+    uint32_t offset;
+    CHECK_EQ(burst_read(head, 2, &offset), 2);
+    burst_rewind();
+    int b = (head[0] >> 12) == ADC_CHANNEL_B ? 0 : 1;
+    int64_t idx = 2 * (int64_t)(head[b] & 0x0FFF) + 1 - b;
+    int64_t period = 2 * 4096;
+    idx += ((int64_t)near - idx + period / 2) / period * period;
+    return (uint32_t)idx;
+}
+
+// Uploads the frozen burst in 256-sample chunks and checks that it is the window
+// [trigger - pre, trigger - pre + total) of the fed conversions.
+static void upload_and_check(const burst_info_t *info, uint32_t trigger_idx)
+{
+    static uint16_t chunk[256];
+    uint32_t first = trigger_idx - info->pre, expected_offset = 0, offset;
+    int n;
+    burst_stats_t before, after;
+    burst_get_stats(&before);
+    while ((n = burst_read(chunk, 256, &offset)) > 0) {
+        CHECK_EQ(offset, expected_offset);
+        for (int k = 0; k < n; k++) CHECK_EQ(chunk[k], sample_at(first + offset + k));
+        expected_offset += n;
+    }
+    CHECK_EQ(expected_offset, info->total);
+    burst_get_stats(&after);
+    CHECK_EQ(after.uploaded, before.uploaded + 1);
+    burst_info_t none;
+    CHECK(!burst_upload_pending(&none));   // re-armed
+}
+
+// --- Baseline settling ---
+// No threshold trigger before 2^BURST_BASELINE_SHIFT trigger-channel samples.
+static void test_settling(void)
+{
+    burst_info_t info;
+    pulse(100, 400);
+    feed(2 * (1u << BURST_BASELINE_SHIFT) - 200);
+    CHECK(!burst_upload_pending(&info));
+    feed(BURST_TOTAL);
+    CHECK(!burst_upload_pending(&info));
+    burst_stats_t stats;
+    burst_get_stats(&stats);
+    CHECK_EQ(stats.bursts, 0);
+}
+
+// --- Threshold trigger ---
+static void test_threshold(void)
+{
+    burst_info_t info;
+    uint32_t trigger_idx = pulse(FRAME / 3, 400);
+    // The window is frozen with the trigger sample and the BURST_POST_SAMPLES - 1 after it.
+    feed(trigger_idx + BURST_POST_SAMPLES - 1 - fed);
+    CHECK(!burst_upload_pending(&info));
+    feed(1);
+    CHECK(burst_upload_pending(&info));
+    CHECK_EQ(info.trigger, BURST_TRIGGER_THRESHOLD);
+    CHECK_EQ(info.channel, BURST_TRIGGER_CHANNEL);
+    CHECK_EQ(info.rate_hz, BURST_ADC_SAMPLE_RATE);
+    CHECK_EQ(info.pre, BURST_PRE_SAMPLES);
+    CHECK_EQ(info.total, BURST_TOTAL);
+    CHECK(llabs(info.trigger_us - time_of_sample(trigger_idx)) <= SAMPLE_US);
+    CHECK(llabs(info.first_us - time_of_sample(trigger_idx - BURST_PRE_SAMPLES)) <= SAMPLE_US);
+    CHECK_EQ(info.request_us, info.trigger_us);
+    CHECK_EQ(info.missed, 0);
+    printf("threshold: trigger at conversion %u, %u + %u samples, %lld us off\n",
+           (unsigned)trigger_idx, (unsigned)info.pre, (unsigned)(info.total - info.pre),
+           (long long)(info.trigger_us - time_of_sample(trigger_idx)));
+    upload_and_check(&info, trigger_idx);
+}
+
+// --- Host request ---
+// The request time is placed on the sample timeline: in a later block, in the block
+// being fed, or in the past (history from the pre-trigger ring).
+static void test_host_request(void)
+{
+    const int32_t leads[] = { 3 * FRAME / 2, FRAME / 4, -(int32_t)(FRAME / 2) };
+    for (size_t k = 0; k < sizeof(leads) / sizeof(leads[0]); k++) {
+        burst_info_t info;
+        uint32_t target = fed + leads[k];
+        int64_t t_us = time_of_sample(target);
+        burst_request(BURST_TRIGGER_HOST, t_us);
+        feed(2 * FRAME + BURST_POST_SAMPLES);
+        CHECK(burst_upload_pending(&info));
+        CHECK_EQ(info.trigger, BURST_TRIGGER_HOST);
+        CHECK_EQ(info.request_us, t_us);
+        CHECK_EQ(info.pre, BURST_PRE_SAMPLES);
+        CHECK_EQ(info.total, BURST_TOTAL);
+        CHECK(llabs(info.trigger_us - t_us) <= SAMPLE_US);
+        // The trigger sample is the conversion nearest the request time.
+        uint32_t trigger_idx = first_index(target - info.pre) + info.pre;
+        CHECK_EQ(trigger_idx, target);
+        printf("host request %+d conversions ahead: trigger at conversion %+d, %lld us off\n",
+               (int)leads[k], (int)(trigger_idx - target), (long long)(info.trigger_us - t_us));
+        upload_and_check(&info, trigger_idx);
+    }
+}
+
+// --- Missed triggers ---
+// While a burst is being captured or waits for upload, triggers are only counted,
+// and the next burst reports them.
+static void test_missed(void)
+{
+    burst_info_t info;
+    uint32_t trigger_idx = pulse(100, 400);
+    feed(2 * FRAME);
+    pulse(100, 400);                          // during the capture
+    feed(BURST_POST_SAMPLES);
+    CHECK(burst_upload_pending(&info));
+    burst_request(BURST_TRIGGER_HOST, time_of_sample(fed));   // while waiting for upload
+    feed(FRAME);
+    burst_stats_t stats;
+    burst_get_stats(&stats);
+    CHECK_EQ(stats.missed, 2);
+    upload_and_check(&info, trigger_idx);
+
+    trigger_idx = pulse(100, 400);
+    feed(2 * FRAME + BURST_POST_SAMPLES);
+    CHECK(burst_upload_pending(&info));
+    CHECK_EQ(info.missed, 2);
+    upload_and_check(&info, trigger_idx);
+}
+
+// --- Request overrun ---
+// Two requests before the next block: the first one is placed, the second is missed.
+static void test_request_overrun(void)
+{
+    burst_info_t info;
+    uint32_t target = fed + FRAME / 2;
+    burst_request(BURST_TRIGGER_HOST, time_of_sample(target));
+    burst_request(BURST_TRIGGER_GPIO_EDGE, time_of_sample(target + FRAME));
+    feed(2 * FRAME + BURST_POST_SAMPLES);
+    CHECK(burst_upload_pending(&info));
+    CHECK_EQ(info.trigger, BURST_TRIGGER_HOST);
+    CHECK_EQ(info.missed, 1);
+    uint32_t trigger_idx = first_index(target - info.pre) + info.pre;
+    CHECK_EQ(trigger_idx, target);
+    upload_and_check(&info, trigger_idx);
+}
+
+// --- Decimation ---
+static void test_decimate(void)
+{
+    uint16_t in[4 * BURST_DECIMATION], out[8];
+    for (int i = 0; i < 4 * BURST_DECIMATION; i++) {
+        in[i] = (i % 2) ? (uint16_t)((ADC_CHANNEL_B << 12) | (1000 + i)) : (uint16_t)((ADC_CHANNEL_A << 12) | 3000);
+    }
+    int n = burst_decimate(in, 4 * BURST_DECIMATION, out);
+    CHECK_EQ(n, 4);
+    CHECK_EQ(out[0], (ADC_CHANNEL_A << 12) | 3000);
+    // Channel B: mean of 1001, 1003, ... over its first BURST_DECIMATION conversions.
+    CHECK_EQ(out[1], (ADC_CHANNEL_B << 12) | (1000 + BURST_DECIMATION));
+}
+
+int main(void)
+{
+    CHECK(burst_init());
+    test_settling();
+    test_threshold();
+    test_host_request();
+    test_missed();
+    test_request_overrun();
+    test_decimate();
+    printf("adc_burst: ok\n");
+    return 0;
+}
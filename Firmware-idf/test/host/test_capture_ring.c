@@ -0,0 +1,201 @@
+// Capture ring on the host: packets of mixed sizes across the end of the storage,
+// overwrite of the oldest packets when full, and the lost counts cring_pop()
+// reports for the outbound task's gap packets.
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+
+#include "capture_ring.h"
+#include "host_test.h"
+
+#define RING_BYTES  1024
+#define MAX_PACKET  200
+
+// A packet is its sequence number followed by filler derived from it.
+static size_t make_packet(uint8_t *buf, uint32_t seq)
+{
+    size_t size = sizeof(seq) + 1 + (seq * 37) % (MAX_PACKET - sizeof(seq));
+    memcpy(buf, &seq, sizeof(seq));
+    for (size_t i = sizeof(seq); i < size; i++) buf[i] = (uint8_t)(seq + i);
+    return size;
+}
+
+static uint32_t check_packet(const uint8_t *buf, size_t size)
+{
+    uint32_t seq;
+    memcpy(&seq, buf, sizeof(seq));
+    uint8_t expected[MAX_PACKET];
+    CHECK_EQ(size, make_packet(expected, seq));
+    CHECK(memcmp(buf, expected, size) == 0);
+    return seq;
+}
+
+// --- Wrap ---
+// A consumer a few packets behind the producer: every packet comes back intact and
+// in order while the positions go round the storage many times.
+static void test_wrap(void)
+{
+    CHECK_EQ(cring_init(RING_BYTES, 0), RING_BYTES);
+    uint8_t in[MAX_PACKET], out[MAX_PACKET];
+    uint32_t lost, expected = 0;
+    for (uint32_t seq = 0; seq < 10000; seq++) {
+        CHECK(cring_push(in, make_packet(in, seq)));
+        if (cring_count() <= 3) continue;
+        size_t got = cring_pop(out, sizeof(out), 0, &lost);
+        CHECK_EQ(lost, 0);
+        CHECK_EQ(check_packet(out, got), expected++);
+    }
+    size_t got;
+    while ((got = cring_pop(out, sizeof(out), 0, &lost)) > 0) {
+        CHECK_EQ(check_packet(out, got), expected++);
+    }
+    CHECK_EQ(expected, 10000);
+    cring_stats_t stats;
+    cring_get_stats(&stats);
+    CHECK_EQ(stats.count, 0);
+    CHECK_EQ(stats.used, 0);
+    CHECK_EQ(stats.overwritten, 0);
+}
+
+// --- Overwrite ---
+static void test_overwrite(void)
+{
+    cring_init(RING_BYTES, 0);
+    cring_stats_t stats;
+    uint8_t in[MAX_PACKET], out[MAX_PACKET];
+    uint32_t seq = 0, lost;
+
+    // Fill until the first overwrite, then a few more.
+    while (cring_push(in, make_packet(in, seq))) seq++;
+    seq++;
+    for (int i = 0; i < 20; i++, seq++) cring_push(in, make_packet(in, seq));
+    cring_get_stats(&stats);
+    CHECK(stats.overwritten > 0);
+    CHECK(stats.used <= RING_BYTES);
+
+    // The survivors are the newest packets, in order, and the first pop reports
+    // every overwritten packet as the gap in front of it.
+    size_t got = cring_pop(out, sizeof(out), 0, &lost);
+    uint32_t oldest = check_packet(out, got);
+    CHECK_EQ(lost, oldest);
+    CHECK_EQ(lost, stats.overwritten);
+    uint32_t next = oldest + 1;
+    while ((got = cring_pop(out, sizeof(out), 0, &lost)) > 0) {
+        CHECK_EQ(lost, 0);
+        CHECK_EQ(check_packet(out, got), next++);
+    }
+    CHECK_EQ(next, seq);
+    printf("overwrite: %u packets pushed, %u overwritten, newest %u kept\n",
+           (unsigned)seq, (unsigned)stats.overwritten, (unsigned)(seq - oldest));
+
+    // A gap in the middle of a stream: pop some, overflow, pop again.
+    cring_init(RING_BYTES, 0);
+    seq = 0;
+    for (int i = 0; i < 4; i++, seq++) cring_push(in, make_packet(in, seq));
+    for (int i = 0; i < 2; i++) {
+        got = cring_pop(out, sizeof(out), 0, &lost);
+        CHECK_EQ(lost, 0);
+        check_packet(out, got);
+    }
+    for (int i = 0; i < 40; i++, seq++) cring_push(in, make_packet(in, seq));
+    got = cring_pop(out, sizeof(out), 0, &lost);
+    CHECK(lost > 0);
+    CHECK_EQ(check_packet(out, got), 2 + lost);   // packets 2 .. 2 + lost - 1 are gone
+
+    // A reset discards the backlog and its pending gap.
+    for (int i = 0; i < 40; i++, seq++) cring_push(in, make_packet(in, seq));
+    cring_reset();
+    CHECK_EQ(cring_pop(out, sizeof(out), 0, &lost), 0);
+    CHECK_EQ(lost, 0);
+    cring_push(in, make_packet(in, seq));
+    CHECK(cring_pop(out, sizeof(out), 0, &lost) > 0);
+    CHECK_EQ(lost, 0);
+}
+
+// --- Oversize ---
+// A packet larger than the caller's buffer is dropped and counted in the next gap.
+static void test_oversize(void)
+{
+    cring_init(RING_BYTES, 0);
+    uint8_t in[MAX_PACKET], out[MAX_PACKET];
+    uint32_t lost;
+    size_t big = make_packet(in, 4);             // the largest of the first few
+    cring_push(in, big);
+    cring_push(in, make_packet(in, 1));
+    CHECK_EQ(cring_pop(out, big - 1, 0, &lost), 0);
+    size_t got = cring_pop(out, sizeof(out), 0, &lost);
+    CHECK_EQ(check_packet(out, got), 1);
+    CHECK_EQ(lost, 1);
+    // Too large for the ring at all: refused without touching what is stored.
+    static uint8_t huge[RING_BYTES];
+    CHECK(!cring_push(huge, sizeof(huge)));
+    CHECK_EQ(cring_count(), 0);
+}
+
+// --- Concurrent ---
+// Two producers (mic, ADC) and a consumer that falls behind: every packet is either
+// received or reported lost, and each producer's packets arrive in order.
+#define PRODUCERS     2
+#define PER_PRODUCER  200000
+
+static atomic_int finished;
+
+static void *producer(void *arg)
+{
+    uint32_t id = (uint32_t)(uintptr_t)arg;
+    uint8_t buf[MAX_PACKET];
+    for (uint32_t i = 0; i < PER_PRODUCER; i++) {
+        // The top bit of the sequence number is the producer.
+        cring_push(buf, make_packet(buf, (id << 31) | i));
+    }
+    atomic_fetch_add(&finished, 1);
+    return NULL;
+}
+
+static void test_concurrent(void)
+{
+    cring_init(16 * 1024, 0);
+    atomic_store(&finished, 0);
+    pthread_t threads[PRODUCERS];
+    for (uintptr_t i = 0; i < PRODUCERS; i++) pthread_create(&threads[i], NULL, producer, (void *)i);
+
+    uint8_t out[MAX_PACKET];
+    uint32_t next[PRODUCERS] = {0};
+    uint64_t received = 0, lost_total = 0;
+    for (;;) {
+        bool done = atomic_load(&finished) == PRODUCERS;   // read before the pop: no push after it
+        uint32_t lost;
+        size_t got = cring_pop(out, sizeof(out), 0, &lost);
+        lost_total += lost;
+        if (got == 0) {
+            if (done) break;
+            continue;
+        }
+        uint32_t seq = check_packet(out, got);
+        uint32_t id = seq >> 31, index = seq & 0x7FFFFFFF;
+        CHECK(index >= next[id]);
+        next[id] = index + 1;
+        if (++received % 64 == 0) host_sleep_us(1);
+    }
+    for (int i = 0; i < PRODUCERS; i++) pthread_join(threads[i], NULL);
+
+    cring_stats_t stats;
+    cring_get_stats(&stats);
+    printf("concurrent: %u pushed, %llu received, %llu reported lost, %u overwritten\n",
+           (unsigned)stats.pushed, (unsigned long long)received, (unsigned long long)lost_total,
+           (unsigned)stats.overwritten);
+    CHECK_EQ(stats.pushed, PRODUCERS * PER_PRODUCER);
+    CHECK_EQ(received + lost_total, (uint64_t)stats.pushed);
+    CHECK_EQ(lost_total, (uint64_t)stats.overwritten);
+}
+
+int main(void)
+{
+    test_wrap();
+    test_overwrite();
+    test_oversize();
+    test_concurrent();
+    printf("capture_ring: ok\n");
+    return 0;
+}
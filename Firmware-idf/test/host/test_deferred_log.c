@@ -0,0 +1,204 @@
+// Deferred logger on the host: rate limiting, ring overflow accounting, and the
+// latency a send loop sees while it and other tasks flood the logger.
+//
+// The sink emulates the UART console (115200 baud: ~87 us per character), so the
+// blocking baseline is what ESP_LOGE costs the outbound task on the device.
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+
+#include "deferred_log.h"
+#include "host_test.h"
+
+#define UART_US_PER_CHAR   87
+#define STORM_MS           300
+#define STORM_THREADS      3
+#define MAX_SAMPLES        (1 << 22)
+
+static const char *SEND_FMT = "send failed: ret %d errno %d";
+static const char *STORM_FMT[STORM_THREADS] = {
+    "storm a: %d %d", "storm b: %d %d", "storm c: %d %d",
+};
+
+// --- Sinks ---
+static atomic_uint lines;          // formatted records
+static atomic_uint suppressed;     // sum of the "suppressed N x" reports
+static atomic_uint send_lines;
+
+static void count_line(int level, const char *tag, const char *msg)
+{
+    (void)level;
+    unsigned long n;
+    if (sscanf(msg, "suppressed %lu x", &n) == 1) {
+        atomic_fetch_add(&suppressed, (unsigned)n);
+    } else if (strcmp(tag, "DLOG") != 0) {
+        atomic_fetch_add(&lines, 1);
+        if (strncmp(msg, "send failed", 11) == 0) atomic_fetch_add(&send_lines, 1);
+    }
+}
+
+static void counting_sink(int level, const char *tag, uint32_t ts_ms, const char *msg)
+{
+    (void)ts_ms;
+    count_line(level, tag, msg);
+}
+
+static void uart_sink(int level, const char *tag, uint32_t ts_ms, const char *msg)
+{
+    (void)ts_ms;
+    host_sleep_us((uint32_t)(strlen(tag) + strlen(msg) + 16) * UART_US_PER_CHAR);
+    count_line(level, tag, msg);
+}
+
+static void reset_counts(void)
+{
+    atomic_store(&lines, 0);
+    atomic_store(&suppressed, 0);
+    atomic_store(&send_lines, 0);
+}
+
+// --- Rate limiting ---
+static void test_rate_limit(void)
+{
+    dlog_init(counting_sink);
+    reset_counts();
+    for (int i = 0; i < 20; i++) {
+        CHECK(DLOGE("TEST", SEND_FMT, -1, i));
+    }
+    CHECK_EQ(dlog_drain(), 20);
+    CHECK_EQ(atomic_load(&lines), DLOG_BURST);
+    CHECK_EQ(atomic_load(&suppressed), 0);
+
+    // The window expires without new records: the drain reports what it held back.
+    host_sleep_us((DLOG_WINDOW_MS + 50) * 1000);
+    CHECK_EQ(dlog_drain(), 0);
+    CHECK_EQ(atomic_load(&suppressed), 20 - DLOG_BURST);
+    printf("rate limit: %u of 20 records printed, %u reported as suppressed\n",
+           atomic_load(&lines), atomic_load(&suppressed));
+}
+
+// --- Overflow ---
+static void test_overflow(void)
+{
+    dlog_init(counting_sink);
+    reset_counts();
+    int accepted = 0;
+    for (int i = 0; i < DLOG_RING_SIZE + 10; i++) {
+        accepted += DLOGW("TEST", STORM_FMT[0], i, 0);
+    }
+    CHECK_EQ(accepted, DLOG_RING_SIZE);
+    CHECK_EQ(dlog_dropped(), 10);
+    CHECK_EQ(dlog_drain(), DLOG_RING_SIZE);
+    // Room again once drained.
+    CHECK(DLOGW("TEST", STORM_FMT[0], 0, 0));
+    dlog_drain();
+}
+
+// --- Storm ---
+static atomic_bool storming;
+static atomic_uint written;        // dlog_write calls, accepted or not
+static atomic_uint consumed;
+
+static void *storm_thread(void *arg)
+{
+    const char *fmt = arg;
+    int i = 0;
+    while (atomic_load_explicit(&storming, memory_order_relaxed)) {
+        DLOGW("STORM", fmt, i++, 0);
+        atomic_fetch_add_explicit(&written, 1, memory_order_relaxed);
+    }
+    return NULL;
+}
+
+static void *drain_thread(void *arg)
+{
+    (void)arg;
+    // dlog_task on the device: drain, then sleep DLOG_DRAIN_PERIOD_MS.
+    while (atomic_load(&storming)) {
+        atomic_fetch_add(&consumed, dlog_drain());
+        host_sleep_us(DLOG_DRAIN_PERIOD_MS * 1000);
+    }
+    return NULL;
+}
+
+// Every iteration of the send loop fails and logs, like send_msg with a dead peer.
+static size_t send_loop(uint32_t *samples, bool deferred, uint64_t duration_ns)
+{
+    size_t n = 0;
+    uint64_t end = host_now_ns() + duration_ns;
+    while (n < MAX_SAMPLES && host_now_ns() < end) {
+        uint64_t start = host_now_ns();
+        if (deferred) {
+            DLOGE("SEND MSG", SEND_FMT, -1, (int)n);
+            atomic_fetch_add_explicit(&written, 1, memory_order_relaxed);
+        } else {
+            char msg[DLOG_MSG_MAX];
+            snprintf(msg, sizeof(msg), SEND_FMT, -1, (int)n);
+            uart_sink(DLOG_ERROR, "SEND MSG", 0, msg);
+        }
+        samples[n++] = (uint32_t)(host_now_ns() - start);
+    }
+    return n;
+}
+
+static void test_storm_latency(void)
+{
+    static uint32_t samples[MAX_SAMPLES];
+
+    // Baseline: the send loop writes to the console itself.
+    size_t n = send_loop(samples, false, 100 * 1000000ull);
+    uint32_t blocking_p50 = host_percentile(samples, n, 50);
+    printf("blocking log: p50 %u us per failed send (%zu sends)\n", blocking_p50 / 1000, n);
+
+    dlog_init(uart_sink);
+    reset_counts();
+    atomic_store(&written, 0);
+    atomic_store(&consumed, 0);
+    atomic_store(&storming, true);
+    pthread_t drainer, storms[STORM_THREADS];
+    pthread_create(&drainer, NULL, drain_thread, NULL);
+    for (int i = 0; i < STORM_THREADS; i++) {
+        pthread_create(&storms[i], NULL, storm_thread, (void *)STORM_FMT[i]);
+    }
+    n = send_loop(samples, true, STORM_MS * 1000000ull);
+    atomic_store(&storming, false);
+    for (int i = 0; i < STORM_THREADS; i++) {
+        pthread_join(storms[i], NULL);
+    }
+    pthread_join(drainer, NULL);
+
+    // Flush the ring and the suppression windows still open.
+    atomic_fetch_add(&consumed, dlog_drain());
+    host_sleep_us((DLOG_WINDOW_MS + 50) * 1000);
+    atomic_fetch_add(&consumed, dlog_drain());
+
+    uint32_t p50 = host_percentile(samples, n, 50);
+    uint32_t p99 = host_percentile(samples, n, 99);
+    uint32_t max = samples[n - 1];
+    printf("deferred log under a %d-thread storm: %zu sends, p50 %u ns, p99 %u ns, max %u us\n",
+           STORM_THREADS, n, p50, p99, max / 1000);
+    printf("records: %u written, %u consumed, %u dropped (ring full), %u printed, %u suppressed\n",
+           atomic_load(&written), atomic_load(&consumed), dlog_dropped(),
+           atomic_load(&lines), atomic_load(&suppressed));
+
+    // Every record is accounted for: consumed or dropped, then printed or suppressed.
+    CHECK_EQ(atomic_load(&written), atomic_load(&consumed) + dlog_dropped());
+    CHECK_EQ(atomic_load(&consumed), atomic_load(&lines) + atomic_load(&suppressed));
+    // At most DLOG_BURST lines per window for the send loop's call site.
+    uint32_t windows = (STORM_MS + DLOG_WINDOW_MS - 1) / DLOG_WINDOW_MS + 1;
+    CHECK(atomic_load(&send_lines) <= DLOG_BURST * windows);
+    // The send loop never waits for the console. The bound is loose for loaded CI
+    // machines: a few microseconds against milliseconds for the blocking logger.
+    CHECK(p99 < 50000);
+    CHECK(p99 * 50 < blocking_p50);
+}
+
+int main(void)
+{
+    test_rate_limit();
+    test_overflow();
+    test_storm_latency();
+    printf("deferred_log: ok\n");
+    return 0;
+}
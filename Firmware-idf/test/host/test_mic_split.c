@@ -0,0 +1,127 @@
+// mic_split() on the host: the per-channel and interleaved layouts for 16- and
+// 32-bit slots, the reference subtraction with saturation, and the cost per sample
+// for 1-4 channels.
+//
+// The timings are host figures (the README's estimate for the device is derived from
+// them); the device reports its own per-block time through periodiclogger.
+
+#include <string.h>
+
+#include "host_test.h"
+#include "mic_channels.h"
+
+#define FRAMES      256          // frames per DMA block, like MIC_FRAMES
+#define BENCH_MS    200
+
+static int16_t dma[FRAMES * MIC_MAX_CHANNELS * 2];
+static mic_sample_t out_buf[MIC_MAX_CHANNELS][FRAMES];
+static mic_sample_t interleaved[FRAMES * MIC_MAX_CHANNELS];
+
+// Word w of slot c in frame j: distinct for every position, so misplaced copies show.
+static int16_t word_at(int j, int c, int w)
+{
+    return (int16_t)(j * 64 + c * 8 + w - 8000);
+}
+
+static void fill_dma(int channels, int slot_words)
+{
+    for (int j = 0; j < FRAMES; j++) {
+        for (int c = 0; c < channels; c++) {
+            for (int w = 0; w < slot_words; w++) {
+                dma[(j * channels + c) * slot_words + w] = word_at(j, c, w);
+            }
+        }
+    }
+}
+
+// --- Layouts ---
+// Arguments are literals at every call site, like the menuconfig constants in main.c.
+#define CHECK_LAYOUT(channels, slot_words, slot_word) do { \
+    fill_dma(channels, slot_words); \
+    void *out[MIC_MAX_CHANNELS]; \
+    for (int c = 0; c < channels; c++) out[c] = out_buf[c]; \
+    mic_split(dma, FRAMES, out, channels, slot_words, slot_word, 1, -1, 0); \
+    for (int c = 0; c < channels; c++) { \
+        for (int j = 0; j < FRAMES; j++) CHECK_EQ(out_buf[c][j].value, word_at(j, c, slot_word)); \
+    } \
+    for (int c = 0; c < channels; c++) out[c] = interleaved + c; \
+    mic_split(dma, FRAMES, out, channels, slot_words, slot_word, channels, -1, 0); \
+    for (int j = 0; j < FRAMES; j++) { \
+        for (int c = 0; c < channels; c++) CHECK_EQ(interleaved[j * channels + c].value, word_at(j, c, slot_word)); \
+    } \
+} while (0)
+
+static void test_layouts(void)
+{
+    // 16-bit slots, and 32-bit slots keeping the upper half (word 1, little endian).
+    CHECK_LAYOUT(1, 1, 0);
+    CHECK_LAYOUT(2, 1, 0);
+    CHECK_LAYOUT(4, 1, 0);
+    CHECK_LAYOUT(1, 2, 1);
+    CHECK_LAYOUT(2, 2, 1);
+    CHECK_LAYOUT(3, 2, 1);
+    CHECK_LAYOUT(4, 2, 1);
+}
+
+// --- Reference subtraction ---
+static void test_reference(void)
+{
+    for (int j = 0; j < FRAMES; j++) {
+        dma[2 * j] = (int16_t)(j * 100 - 12800);               // mic 0
+        dma[2 * j + 1] = (int16_t)(j % 2 ? 30000 : -30000);    // reference
+    }
+    void *out[2] = { out_buf[0], out_buf[1] };
+    mic_split(dma, FRAMES, out, 2, 1, 0, 1, 1, 16384);         // gain 0.5
+    for (int j = 0; j < FRAMES; j++) {
+        int32_t expected = dma[2 * j] - ((dma[2 * j + 1] * 16384) >> 15);
+        CHECK_EQ(out_buf[0][j].value, expected);
+        CHECK_EQ(out_buf[1][j].value, dma[2 * j + 1]);         // the reference is still sent
+    }
+    // Full gain saturates instead of wrapping.
+    for (int j = 0; j < FRAMES; j++) {
+        dma[2 * j] = (int16_t)(j % 2 ? 30000 : -30000);
+        dma[2 * j + 1] = (int16_t)(j % 2 ? -30000 : 30000);
+    }
+    mic_split(dma, FRAMES, out, 2, 1, 0, 1, 1, 32768);
+    for (int j = 0; j < FRAMES; j++) CHECK_EQ(out_buf[0][j].value, j % 2 ? INT16_MAX : INT16_MIN);
+}
+
+// --- Cost ---
+// ns per sample per channel: 32-bit slots, per-channel buffers, as configured by default.
+#define BENCH(channels, reference) do { \
+    fill_dma(channels, 2); \
+    void *out[MIC_MAX_CHANNELS]; \
+    for (int c = 0; c < channels; c++) out[c] = out_buf[c]; \
+    uint64_t blocks = 0, start = host_now_ns(), end = start + BENCH_MS * 1000000ull; \
+    while (host_now_ns() < end) { \
+        for (int r = 0; r < 64; r++) { \
+            mic_split(dma, FRAMES, out, channels, 2, 1, 1, reference, 16384); \
+            __asm__ volatile("" : : "r"(out_buf) : "memory"); \
+        } \
+        blocks += 64; \
+    } \
+    double ns = (double)(host_now_ns() - start) / ((double)blocks * FRAMES * channels); \
+    printf("  %d mic%s%s: %.2f ns per sample per channel, %.2f us per %d-frame block\n", \
+           channels, channels > 1 ? "s" : " ", reference > 0 ? " + reference" : "            ", \
+           ns, ns * FRAMES * channels / 1000, FRAMES); \
+} while (0)
+
+static void bench(void)
+{
+    printf("mic_split on this host:\n");
+    BENCH(1, -1);
+    BENCH(2, -1);
+    BENCH(3, -1);
+    BENCH(4, -1);
+    BENCH(2, 1);
+    BENCH(4, 1);
+}
+
+int main(void)
+{
+    test_layouts();
+    test_reference();
+    bench();
+    printf("mic_split: ok\n");
+    return 0;
+}
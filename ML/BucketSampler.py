@@ -0,0 +1,241 @@
+"""
+Length-bucketed batching for the memmap datasets.
+
+With a fixed padded length (or a collate that pads every batch to the longest
+segment), short words waste most of each batch. BucketBatchSampler builds batches
+of segments with similar lengths, while keeping the training randomness:
+  1. shuffle all indices (new permutation every epoch),
+  2. cut the permutation into pools of batch_size * bucket_factor segments,
+  3. sort each pool by length and cut it into batches,
+  4. shuffle the order of all batches.
+Batch composition changes every epoch. Only segments that are close in length
+*and* fall in the same random pool end up together.
+
+Lengths come from the descriptor ("adc_lengths" / "audio_lengths", one entry per
+segment) so no data has to be read to build the batches. Add them once with:
+    python BucketSampler.py -d descriptor.json --store
+
+pad_collate() pads each batch with np.inf only up to its own longest segment, so
+compute_src_key_padding_mask() in the notebooks keeps working unchanged:
+    sampler = BucketBatchSampler(lengths_of(descriptor), 64, indices=train_dataset.indices)
+    loader = DataLoader(dataset, batch_sampler=sampler, collate_fn=pad_collate, num_workers=4)
+
+Padding efficiency report (and a throughput benchmark when torch is installed):
+    python BucketSampler.py -d descriptor.json --batch_size 64 --bench
+The benchmark trains the Transformer.ipynb V1dTransformer (Models.py) on random
+data shaped like the real batches. Only the padding efficiency was measured when
+this was written; no throughput figures have been recorded yet.
+"""
+
+import argparse
+import json
+import math
+import os
+import time
+
+import numpy as np
+
+
+def segment_lengths(descriptor, chunk_rows=512):
+    """Valid (non-inf) length of every segment, for the audio and ADC fields."""
+    dtype = np.dtype([tuple(item) for item in descriptor["dtype"]])
+    memmap = np.memmap(descriptor["memmap_filename"], dtype=dtype, mode="r",
+                       shape=(descriptor["n_segments"],))
+    audio, adc = [], []
+    for start in range(0, descriptor["n_segments"], chunk_rows):
+        rows = memmap[start:start + chunk_rows]
+        audio.append(np.isfinite(rows["audio"]).sum(axis=1))
+        adc.append(np.maximum(np.isfinite(rows["adc1"]).sum(axis=1), np.isfinite(rows["adc2"]).sum(axis=1)))
+    return np.concatenate(audio).tolist(), np.concatenate(adc).tolist()
+
+
+def store_lengths(descriptor_path):
+    with open(descriptor_path, "r") as f:
+        descriptor = json.load(f)
+    descriptor["audio_lengths"], descriptor["adc_lengths"] = segment_lengths(descriptor)
+    tmp = descriptor_path + ".tmp"
+    with open(tmp, "w") as f:
+        json.dump(descriptor, f)
+    os.replace(tmp, descriptor_path)
+    return descriptor
+
+
+def lengths_of(descriptor, field="adc"):
+    """Per-segment lengths stored in a descriptor dict (see store_lengths)."""
+    key = f"{field}_lengths"
+    if key not in descriptor:
+        raise KeyError(f"descriptor has no '{key}', run: python BucketSampler.py -d <descriptor> --store")
+    return descriptor[key]
+
+
+class BucketBatchSampler:
+    """
+    Batch sampler for DataLoader(batch_sampler=...).
+
+    lengths: length of every segment of the *dataset* (index = dataset index).
+    indices: subset to draw from (e.g. random_split(...).indices); default all.
+    bucket_factor: pool size in batches. 1 means random batches, and larger values
+        mean tighter buckets with less mixing.
+    """
+    def __init__(self, lengths, batch_size, indices=None, bucket_factor=50,
+                 shuffle=True, drop_last=False, seed=0):
+        self.lengths = np.asarray(lengths)
+        self.indices = np.arange(len(self.lengths)) if indices is None else np.asarray(indices)
+        self.batch_size = batch_size
+        self.bucket_factor = bucket_factor
+        self.shuffle = shuffle
+        self.drop_last = drop_last
+        self.seed = seed
+        self.epoch = 0
+
+    def set_epoch(self, epoch):
+        self.epoch = epoch
+
+    def batches(self):
+        rng = np.random.default_rng((self.seed, self.epoch))
+        order = rng.permutation(self.indices) if self.shuffle else self.indices
+        pool_size = self.batch_size * self.bucket_factor
+        batches = []
+        for start in range(0, len(order), pool_size):
+            pool = order[start:start + pool_size]
+            pool = pool[np.argsort(self.lengths[pool], kind="stable")]
+            for b in range(0, len(pool), self.batch_size):
+                batch = pool[b:b + self.batch_size]
+                if len(batch) < self.batch_size and self.drop_last:
+                    continue
+                batches.append(batch.tolist())
+        if self.shuffle:
+            batches = [batches[i] for i in rng.permutation(len(batches))]
+        return batches
+
+    def __iter__(self):
+        batches = self.batches()
+        if self.shuffle:
+            self.epoch += 1  # a fresh permutation next time unless set_epoch() is used
+        return iter(batches)
+
+    def __len__(self):
+        if self.drop_last:
+            full = 0
+            n = len(self.indices)
+            pool_size = self.batch_size * self.bucket_factor
+            for start in range(0, n, pool_size):
+                full += min(pool_size, n - start) // self.batch_size
+            return full
+        return math.ceil(len(self.indices) / self.batch_size)
+
+
+def padding_efficiency(batches, lengths):
+    """Real samples / padded samples computed, over a list of batches of indices."""
+    lengths = np.asarray(lengths)
+    real = padded = 0
+    for batch in batches:
+        batch_lengths = lengths[batch]
+        real += int(batch_lengths.sum())
+        padded += int(batch_lengths.max()) * len(batch)
+    return real / padded if padded else 1.0
+
+
+def pad_collate(batch, pad_value=float("inf")):
+    """
+    Collate (id, adc1, adc2, ...) samples of variable length: tensors are padded
+    with pad_value up to the longest one in the batch. Integer ids are stacked.
+    """
+    import torch
+
+    out = []
+    for field in zip(*batch):
+        if isinstance(field[0], torch.Tensor):
+            max_len = max(t.shape[-1] for t in field)
+            padded = field[0].new_full((len(field),) + tuple(field[0].shape[:-1]) + (max_len,), pad_value)
+            for i, t in enumerate(field):
+                padded[i, ..., :t.shape[-1]] = t
+            out.append(padded)
+        else:
+            out.append(torch.as_tensor(field))
+    return tuple(out)
+
+
+def benchmark_throughput(batch_lists, lengths, n_classes=10, max_batches=30, **model_args):
+    """
+    Train-step throughput of the Transformer.ipynb model (Models.V1dTransformer, the
+    notebook configuration unless model_args override it) for the given batches.
+    Each batch is inf-padded by pad_collate and trained like the notebook's
+    train_epoch: padding mask from compute_src_key_padding_mask(), per-token loss
+    masked. Inputs and labels are random; model and optimizer start from the same
+    state for each sampler.
+    """
+    import torch
+    from Models import V1dTransformer, masked_token_loss
+
+    lengths = np.asarray(lengths)
+    rng = np.random.default_rng(0)
+    results = {}
+    for name, batches in batch_lists.items():
+        torch.manual_seed(0)
+        model = V1dTransformer(input_dim=2, output_dim=n_classes, **model_args)
+        model.train()
+        optimizer = torch.optim.Adam(model.parameters(), lr=1e-4)
+        batches = batches[:max_batches]
+        samples = 0
+        start = time.perf_counter()
+        for batch in batches:
+            segments = [(int(rng.integers(n_classes)),
+                         torch.randn(max(int(lengths[i]), model.input_kern)),
+                         torch.randn(max(int(lengths[i]), model.input_kern))) for i in batch]
+            ids, adc1, adc2 = pad_collate(segments)
+            adc = torch.stack((adc1, adc2), dim=1)
+            mask = model.compute_src_key_padding_mask(adc)
+            loss = masked_token_loss(model(adc, mask), ids, mask)
+            optimizer.zero_grad()
+            loss.backward()
+            optimizer.step()
+            samples += len(batch)
+        results[name] = samples / (time.perf_counter() - start)
+    return results
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Length-bucketed batching: store lengths, report padding efficiency.")
+    parser.add_argument("--descriptor", "-d", required=True, help="Descriptor JSON of the memmap dataset.")
+    parser.add_argument("--store", action="store_true", help="Compute segment lengths and save them in the descriptor.")
+    parser.add_argument("--field", default="adc", choices=["adc", "audio"], help="Which lengths to bucket on.")
+    parser.add_argument("--batch_size", type=int, default=64)
+    parser.add_argument("--bucket_factor", type=int, default=50)
+    parser.add_argument("--bench", action="store_true", help="Also measure training throughput (needs torch).")
+    args = parser.parse_args()
+
+    if not os.path.isfile(args.descriptor):
+        print(f"Error: File '{args.descriptor}' does not exist.")
+        raise SystemExit(1)
+    if args.store:
+        descriptor = store_lengths(args.descriptor)
+        print(f"Stored audio_lengths/adc_lengths for {descriptor['n_segments']} segments in {args.descriptor}")
+    else:
+        with open(args.descriptor, "r") as f:
+            descriptor = json.load(f)
+    lengths = np.asarray(lengths_of(descriptor, args.field))
+    max_len = descriptor[f"max_{args.field}_len"]
+
+    random_batches = BucketBatchSampler(lengths, args.batch_size, bucket_factor=1).batches()
+    bucket_batches = BucketBatchSampler(lengths, args.batch_size, bucket_factor=args.bucket_factor).batches()
+    fixed = lengths.sum() / (max_len * len(lengths))
+    print(f"{len(lengths)} segments, {args.field} length {lengths.min()}..{lengths.max()} (padded to {max_len})")
+    print(f"Padding efficiency (real / computed samples), batch size {args.batch_size}:")
+    print(f"  fixed length (padding_handling=inf) : {100 * fixed:5.1f}%")
+    print(f"  random batches, pad to batch max    : {100 * padding_efficiency(random_batches, lengths):5.1f}%")
+    print(f"  bucketed (factor {args.bucket_factor:3d})              : "
+          f"{100 * padding_efficiency(bucket_batches, lengths):5.1f}%")
+
+    if args.bench:
+        try:
+            import torch  # noqa: F401
+        except ImportError:
+            print("torch is not installed, skipping the throughput benchmark.")
+            raise SystemExit(0)
+        n_classes = len(set(descriptor.get("dataset_mapping", {}).values())) or 10
+        rates = benchmark_throughput({"random": random_batches, "bucketed": bucket_batches}, lengths, n_classes)
+        print("Train-step throughput, Transformer.ipynb V1dTransformer:")
+        for name, rate in rates.items():
+            print(f"  {name:9s}: {rate:8.1f} samples/s")
+        print(f"  speedup  : {rates['bucketed'] / rates['random']:.2f}x")
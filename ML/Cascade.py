@@ -0,0 +1,329 @@
+"""
+Two-stage early-exit classifier: cheap ADC features first, the full model only when needed.
+
+Most segments are easy (noise, or a clearly pronounced word), yet a single model
+runs the full transformer on each of them. The cascade puts a cheap stage in front:
+  stage 1   log band-energy features of both ADC channels (SegmentTuner.segment_features)
+            -> standardized -> multinomial logistic regression. The features take
+            about 0.3 ms for 4000 synthetic samples per channel on one desktop core;
+            the full stage has not been timed on the datasets.
+  stage 2   the expensive model (a Compression.py / notebook checkpoint: V1dTransformer,
+            ResNet, or a compressed student), batch 1.
+A segment exits after stage 1 when the stage-1 confidence (max class probability)
+reaches the threshold of the predicted class. Otherwise it goes to stage 2.
+
+Per-class thresholds are calibrated on held-out segments the model has not seen.
+For each class c, the threshold is the lowest confidence such that, among the
+calibration segments stage 1 assigns to c at or above it, stage 1 is at most
+max_drop points less accurate than stage 2 on the same segments (and at least
+min_support segments exit). Every class's exits then cost at most max_drop points,
+so the cascade stays within max_drop of the single model. Classes without a safe
+threshold never exit early.
+
+The held-out segments are split in two: calibration, and a test half that the
+report is measured on. Both stages run on every test segment, one at a time and
+single-threaded by default, and their times are recorded per segment. The
+cascade's latency for a segment is the stage-1 time, plus the stage-2 time when it
+escalates. The report compares mean / p50 / p95 / p99 latency and accuracy with
+the single model, for each max_drop.
+
+Use the --seed / --val_fraction / --max_segments / --filter of the model's training
+(Compression.py), so its validation split is the held-out data here. With --filter,
+the cascade keeps the band-pass settings and applies them to every segment it is
+given, so predict() takes the unfiltered samples and both stages see what they were
+trained on. The filter time is part of both latencies in the report.
+
+No report has been produced yet: the module was written without torch or the
+memmap datasets, so the latency and accuracy figures are unverified (see
+README.md, Pending measurements).
+
+Usage:
+    python Cascade.py -d descriptor.json --kind transformer --model transformer.pt \
+        --max_drop 0.5 0 1 2 --save cascade.pkl --report cascade.json
+At run time:
+    cascade = Cascade.load("cascade.pkl")
+    label, stage, confidence = cascade.predict([adc1, adc2])     # valid samples of one segment
+"""
+
+import argparse
+import json
+import os
+import pickle
+import time
+from concurrent.futures import ThreadPoolExecutor
+
+import numpy as np
+import torch
+from sklearn.linear_model import LogisticRegression
+from sklearn.preprocessing import StandardScaler
+
+from Compression import (TEACHERS, adc_normalization, build_model, count_classes, is_sequence, load_segments,
+                         load_teacher, model_input, segment_logits)
+from Filters import BPfilter
+from SegmentTuner import segment_features
+
+FEATURES = dict(n_fft=256, hop=128, n_bands=16)
+MIN_SUPPORT = 20             # calibration segments a class needs to exit early
+QUANTILES = (50, 95, 99)
+
+
+def band_pass(segment, band):
+    """The (adc1, adc2) samples band-passed with band = (fs, lowcut, highcut), unchanged if band is None."""
+    if band is None:
+        return segment
+    return [BPfilter(np.asarray(values, dtype=np.float64), *band) for values in segment]
+
+
+# --- Stage 1 ---
+
+class FeatureStage:
+    """Standardized band-energy features -> logistic regression."""
+    def __init__(self, n_classes, feature_params=FEATURES, C=1.0):
+        self.n_classes = n_classes
+        self.feature_params = dict(feature_params)
+        self.scaler = StandardScaler()
+        self.model = LogisticRegression(C=C, max_iter=2000)
+
+    def features(self, segment):
+        return segment_features(segment, **self.feature_params)
+
+    def features_batch(self, segments, workers=None):
+        # numpy releases the GIL in the FFTs.
+        with ThreadPoolExecutor(max_workers=workers or os.cpu_count()) as pool:
+            return np.stack(list(pool.map(self.features, segments)))
+
+    def fit(self, features, labels):
+        self.model.fit(self.scaler.fit_transform(features), labels)
+        return self
+
+    def proba(self, features):
+        """Class probabilities [N, n_classes] (classes absent from training get 0)."""
+        out = np.zeros((len(features), self.n_classes))
+        out[:, self.model.classes_] = self.model.predict_proba(self.scaler.transform(features))
+        return out
+
+    def predict_one(self, segment):
+        """(class, confidence) of one segment. This is the timed stage-1 path."""
+        # The transform and softmax by hand: sklearn's per-call validation costs more than the maths.
+        scaled = (self.features(segment) - self.scaler.mean_) / self.scaler.scale_
+        scores = self.model.coef_ @ scaled + self.model.intercept_
+        if len(self.model.classes_) == 2:
+            scores = np.array([0.0, scores[0]])
+        p = np.exp(scores - scores.max())
+        p /= p.sum()
+        k = int(p.argmax())
+        return int(self.model.classes_[k]), float(p[k])
+
+
+# --- Calibration ---
+
+def calibrate_thresholds(confidence, predicted, stage1_correct, stage2_correct, n_classes, max_drop,
+                         min_support=MIN_SUPPORT):
+    """
+    Per-class confidence thresholds (np.inf: never exit). For class c, the lowest threshold
+    whose exits are at most max_drop points less accurate with stage 1 than with stage 2.
+    """
+    thresholds = np.full(n_classes, np.inf)
+    for c in range(n_classes):
+        idx = np.nonzero(predicted == c)[0]
+        if len(idx) < min_support:
+            continue
+        order = idx[np.argsort(-confidence[idx], kind="stable")]
+        conf = confidence[order]
+        k = np.arange(1, len(order) + 1)
+        loss = np.cumsum(stage2_correct[order].astype(float) - stage1_correct[order].astype(float))
+        ok = (100 * loss <= max_drop * k) & (k >= min_support)
+        ok[:-1] &= conf[:-1] > conf[1:]     # a threshold exits every tie, so cut between distinct values
+        if ok.any():
+            thresholds[c] = conf[np.nonzero(ok)[0][-1]]
+    return thresholds
+
+
+def exits(thresholds, predicted, confidence):
+    return confidence >= thresholds[predicted]
+
+
+# --- Cascade ---
+
+class Cascade:
+    def __init__(self, stage1, thresholds, model, length, sequence, mean, std, band=None, threads=1):
+        self.stage1 = stage1
+        self.thresholds = thresholds
+        self.model = model.eval()
+        self.length = length
+        self.sequence = sequence
+        self.mean = mean
+        self.std = std
+        self.band = band           # (fs, lowcut, highcut) of the training band-pass, or None
+        self.threads = threads
+
+    def prepare(self, segment):
+        """The segment as the stages were trained on it (band-passed with --filter)."""
+        return band_pass(segment, self.band)
+
+    @torch.inference_mode()
+    def stage2(self, segment):
+        x, valid_length = model_input(segment, self.length, self.sequence, self.mean, self.std)
+        logits = segment_logits(self.model, torch.from_numpy(x)[None], torch.tensor([valid_length]))
+        p = torch.softmax(logits[0].float(), dim=-1)
+        return int(p.argmax()), float(p.max())
+
+    def predict(self, segment):
+        """(class, stage that decided, confidence) of one segment: its (adc1, adc2) valid samples."""
+        segment = self.prepare(segment)
+        label, confidence = self.stage1.predict_one(segment)
+        if confidence >= self.thresholds[label]:
+            return label, 1, confidence
+        if torch.get_num_threads() != self.threads:
+            torch.set_num_threads(self.threads)
+        label, confidence = self.stage2(segment)
+        return label, 2, confidence
+
+    def save(self, filename):
+        with open(filename, "wb") as f:
+            pickle.dump(self, f)
+
+    @staticmethod
+    def load(filename):
+        with open(filename, "rb") as f:
+            return pickle.load(f)
+
+
+def run_stages(cascade, data):
+    """
+    Both stages on every segment, one at a time: predictions, stage-1 confidences and per-segment
+    times (ms). data.raw holds the unfiltered samples; the band-pass time counts in prepare_ms.
+    """
+    n = len(data)
+    out = {name: np.zeros(n) for name in ("prepare_ms", "stage1_ms", "stage2_ms", "confidence")}
+    out["stage1"] = np.zeros(n, dtype=np.int64)
+    out["stage2"] = np.zeros(n, dtype=np.int64)
+    torch.set_num_threads(cascade.threads)
+    for i, raw in enumerate(data.raw):
+        start = time.perf_counter()
+        segment = cascade.prepare(raw)
+        prepared = time.perf_counter()
+        out["stage1"][i], out["confidence"][i] = cascade.stage1.predict_one(segment)
+        middle = time.perf_counter()
+        out["stage2"][i] = cascade.stage2(segment)[0]
+        end = time.perf_counter()
+        out["prepare_ms"][i] = 1000 * (prepared - start)
+        out["stage1_ms"][i] = 1000 * (middle - prepared)
+        out["stage2_ms"][i] = 1000 * (end - middle)
+    return out
+
+
+def latency_summary(times):
+    row = {"latency_ms_mean": float(np.mean(times))}
+    row.update({f"latency_ms_p{q}": float(np.percentile(times, q)) for q in QUANTILES})
+    return row
+
+
+def report(labels, result, thresholds_by_drop, n_classes):
+    baseline = {"name": "single model", "accuracy": 100 * float(np.mean(result["stage2"] == labels)), "exit_rate": 0.0}
+    baseline.update(latency_summary(result["prepare_ms"] + result["stage2_ms"]))
+    rows = [baseline]
+    for max_drop, thresholds in thresholds_by_drop.items():
+        early = exits(thresholds, result["stage1"], result["confidence"])
+        predicted = np.where(early, result["stage1"], result["stage2"])
+        row = {"name": f"cascade (max_drop {max_drop:g})", "max_drop": max_drop,
+               "accuracy": 100 * float(np.mean(predicted == labels)), "exit_rate": float(np.mean(early)),
+               "exit_rate_per_class": {int(c): float(np.mean(early[labels == c])) for c in range(n_classes)
+                                       if np.any(labels == c)},
+               "thresholds": [None if np.isinf(t) else float(t) for t in thresholds]}
+        row.update(latency_summary(result["prepare_ms"] + result["stage1_ms"] + np.where(early, 0.0, result["stage2_ms"])))
+        rows.append(row)
+
+    stage1_alone = 100 * float(np.mean(result["stage1"] == labels))
+    print(f"Stage 1 alone: {stage1_alone:.2f}%, {np.mean(result['stage1_ms']):.3f} ms mean "
+          f"(+ {np.mean(result['prepare_ms']):.3f} ms band-pass)")
+    print(f"{'':26s} {'accuracy':>9s} {'exits':>6s} {'mean ms':>8s} " +
+          " ".join(f"{'p' + str(q) + ' ms':>8s}" for q in QUANTILES) + f" {'speed-up':>9s}")
+    for row in rows:
+        print(f"{row['name']:26s} {row['accuracy']:8.2f}% {100 * row['exit_rate']:5.1f}% "
+              f"{row['latency_ms_mean']:8.2f} " + " ".join(f"{row[f'latency_ms_p{q}']:8.2f}" for q in QUANTILES) +
+              f" {baseline['latency_ms_mean'] / row['latency_ms_mean']:8.2f}x")
+    return rows
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Calibrate a feature / model cascade and compare it with the model alone.")
+    parser.add_argument("--descriptor", "-d", required=True, help="Descriptor JSON of the memmap dataset.")
+    parser.add_argument("--kind", choices=sorted(TEACHERS), default="transformer", help="Stage-2 architecture.")
+    parser.add_argument("--model", default=None, help="Stage-2 checkpoint (module or state dict).")
+    parser.add_argument("--model_config", default=None, help="JSON overriding the stage-2 constructor arguments.")
+    parser.add_argument("--length", type=int, default=None,
+                        help="Stage-2 input samples (default: 512 for resnet, max_adc_len for transformers).")
+    parser.add_argument("--max_drop", type=float, nargs="+", default=[0.5, 0.0, 1.0, 2.0],
+                        help="Accuracy points stage 1 may lose on its exits. The first one is saved.")
+    parser.add_argument("--min_support", type=int, default=MIN_SUPPORT)
+    parser.add_argument("--C", type=float, default=1.0, help="Inverse regularization of the stage-1 regression.")
+    parser.add_argument("--filter", action="store_true", help="Band-pass the ADC channels (as MemmapDataset(filter=True)).")
+    parser.add_argument("--val_fraction", type=float, default=0.2, help="Held-out share (calibration + test).")
+    parser.add_argument("--max_segments", type=int, default=None)
+    parser.add_argument("--seed", type=int, default=0)
+    parser.add_argument("--threads", type=int, default=1, help="Intra-op threads for stage 2.")
+    parser.add_argument("--workers", type=int, default=None, help="Feature extraction threads (default: all cores).")
+    parser.add_argument("--save", default=None, help="Pickle the calibrated cascade here.")
+    parser.add_argument("--report", default=None, help="Write the results to this JSON file.")
+    args = parser.parse_args()
+
+    if not os.path.isfile(args.descriptor):
+        print(f"Error: File '{args.descriptor}' does not exist.")
+        raise SystemExit(1)
+    with open(args.descriptor, "r") as f:
+        descriptor = json.load(f)
+    spec = dict(TEACHERS[args.kind], **(json.loads(args.model_config) if args.model_config else {}))
+    sequence = is_sequence(spec["kind"])
+    length = args.length or (descriptor["max_adc_len"] if sequence else 512)
+
+    start = time.perf_counter()
+    train_set, held_out = load_segments(descriptor, length, sequence, filter=args.filter, val_fraction=args.val_fraction,
+                                        seed=args.seed, max_segments=args.max_segments, keep_raw=True)
+    half = len(held_out) // 2
+    calib_set, test_set = held_out.subset(np.arange(half)), held_out.subset(np.arange(half, len(held_out)))
+    n_classes = count_classes(descriptor, train_set, held_out)
+    print(f"{len(train_set)} train / {len(calib_set)} calibration / {len(test_set)} test segments, {n_classes} classes "
+          f"({time.perf_counter() - start:.1f} s)")
+
+    if args.model:
+        model = load_teacher(args.model, spec, n_classes, length)
+    else:
+        from Compression import distill
+        print(f"No stage-2 checkpoint: training a {args.kind} for 20 epochs")
+        torch.manual_seed(args.seed)
+        model = build_model(spec, n_classes, length)
+        distill(model, None, train_set, 20)
+
+    # The raw segments are unfiltered; the cascade band-passes them as the stage-2 inputs were.
+    band = (descriptor["adc_sampling_rate"], descriptor["adc_lowcut"], descriptor["adc_highcut"]) if args.filter else None
+    stage1 = FeatureStage(n_classes, C=args.C)
+    stage1.fit(stage1.features_batch([band_pass(s, band) for s in train_set.raw], args.workers),
+               train_set.labels.numpy())
+    mean, std = adc_normalization(descriptor)
+    cascade = Cascade(stage1, None, model, length, sequence, mean, std, band=band, threads=args.threads)
+
+    # Calibration: batched, only the predictions matter.
+    calib_labels = calib_set.labels.numpy()
+    p1 = stage1.proba(stage1.features_batch([band_pass(s, band) for s in calib_set.raw], args.workers))
+    with torch.inference_mode():
+        model.eval()
+        p2 = torch.cat([segment_logits(model, calib_set.x[i:i + 64], calib_set.lengths[i:i + 64])
+                        for i in range(0, len(calib_set), 64)]).argmax(dim=-1).numpy()
+    thresholds_by_drop = {
+        max_drop: calibrate_thresholds(p1.max(axis=1), p1.argmax(axis=1), p1.argmax(axis=1) == calib_labels,
+                                       p2 == calib_labels, n_classes, max_drop, args.min_support)
+        for max_drop in args.max_drop
+    }
+
+    # Test: one segment at a time, as in deployment.
+    result = run_stages(cascade, test_set)
+    print(f"\nTest segments, batch 1, stage 2 on {args.threads} thread{'s' if args.threads > 1 else ''}:")
+    rows = report(test_set.labels.numpy(), result, thresholds_by_drop, n_classes)
+
+    cascade.thresholds = thresholds_by_drop[args.max_drop[0]]
+    if args.save:
+        cascade.save(args.save)
+    if args.report:
+        with open(args.report, "w") as f:
+            json.dump({"kind": args.kind, "length": length, "n_classes": n_classes, "filter": args.filter, "rows": rows}, f, indent=2)
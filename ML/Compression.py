@@ -0,0 +1,644 @@
+"""
+Model compression for real-time inference: distillation, structured pruning and
+an accuracy vs latency / size report.
+
+The notebook models (ResNet in classifier.ipynb, V1dTransformer in
+Transformer_seq_full.ipynb) are sized for accuracy. A trained teacher is
+compressed two ways here, and every model is measured the same way:
+  - distillation into smaller students (STUDENTS presets or a JSON spec): fewer
+    channels, blocks or layers, depthwise-separable convs for the ResNet, local
+    attention for the transformer. The student learns from the teacher's logits
+    softened by a temperature T, mixed with the labels:
+        loss = alpha * T^2 * KL(teacher_T || student_T) + (1 - alpha) * CE(student, label)
+  - structured pruning: the inner channels of every ResNet block, or the
+    feed-forward units of every transformer layer, with the smallest weight
+    magnitude are removed and the layers rebuilt smaller. The speed-up is real
+    on CPU (no masks). Pruning is iterative: each ratio (of the original widths)
+    starts from the previous model, and is fine-tuned with the unpruned model as
+    the teacher,
+  - measurement: validation accuracy, batch-1 CPU latency (p50 / p95, one thread
+    by default, like the inference host), parameters and fp32 size.
+The report marks the Pareto fronts: the models that no other model beats on both
+accuracy and latency, and on both accuracy and size.
+No report has been produced yet: the module was written without torch or the
+memmap datasets, so it is unverified on real data (see README.md, Pending
+measurements).
+
+Data: the memmap dataset of a descriptor JSON, ADC channels only, loaded once into
+memory. ResNet models see both channels interpolated to --length samples and
+normalized (classifier.ipynb). Transformer models see them zero-padded or cut to
+--length and predict one label per token. They are scored on the mean of their
+logits over the tokens of the segment.
+
+Usage:
+    python Compression.py -d descriptor.json --kind resnet --teacher resnet.pt \
+        --students resnet-half resnet-dw resnet-dw-tiny --prune 0.25 0.5 0.75 \
+        --report compression.json --plot pareto.png --out_dir compressed/
+    python Compression.py -d descriptor.json --kind transformer --teacher_epochs 20   # no checkpoint: train one
+In a notebook:
+    teacher = build_model(TEACHERS["resnet"], n_classes, 512)
+    student = build_model({"kind": "resnet", "stem": 16, "widths": [32, 64, 128, 128],
+                           "blocks": [1, 1, 1, 1], "depthwise": True}, n_classes, 512)
+    distill(student, teacher, train_set, epochs=20)
+    pruned = prune_model(teacher, 0.5)
+    print(evaluate(student, val_set), measure_latency(student, val_set.x[:1]))
+Saved models are whole modules (pruned widths are irregular): torch.load(path, weights_only=False).
+"""
+
+import argparse
+import copy
+import io
+import json
+import os
+import time
+
+import numpy as np
+import torch
+from torch import nn
+import torch.nn.functional as F
+from torch.utils.data import DataLoader, Dataset
+
+from Filters import BPfilter_batch
+from LocalAttention import LocalV1dTransformer
+from Models import FullV1dTransformer
+from ShardDataset import open_memmap, valid
+from TrainLoop import train
+
+TEACHERS = {
+    "resnet": {"kind": "resnet"},
+    "transformer": {"kind": "transformer", "input_kern": 16, "nhead": 8, "num_encoder_layers": 6,
+                    "dim_feedforward": 512},
+}
+STUDENTS = {
+    "resnet-half": {"kind": "resnet", "stem": 32, "widths": [64, 128, 256, 256], "blocks": [2, 1, 1, 2]},
+    "resnet-quarter": {"kind": "resnet", "stem": 16, "widths": [32, 64, 128, 128], "blocks": [1, 1, 1, 1]},
+    "resnet-dw": {"kind": "resnet", "stem": 32, "widths": [64, 128, 256, 256], "blocks": [2, 1, 1, 2],
+                  "depthwise": True},
+    "resnet-dw-tiny": {"kind": "resnet", "stem": 16, "widths": [32, 64, 96, 128], "blocks": [1, 1, 1, 1],
+                       "depthwise": True},
+    "transformer-small": {"kind": "transformer", "input_kern": 16, "nhead": 4, "num_encoder_layers": 3,
+                          "dim_feedforward": 256},
+    "transformer-tiny": {"kind": "transformer", "input_kern": 16, "nhead": 4, "num_encoder_layers": 2,
+                         "dim_feedforward": 128},
+    "transformer-local": {"kind": "local", "input_kern": 16, "nhead": 4, "num_encoder_layers": 2,
+                          "dim_feedforward": 128, "window": 32, "downsample": 1},
+}
+SEQUENCE_KINDS = ("transformer", "local")
+TEACHER_CACHE_MB = 512       # precompute the teacher logits of the train set up to this size
+
+
+# --- Models ---
+
+def conv3(in_channels, out_channels, stride, depthwise):
+    """3-tap conv, or depthwise 3-tap + pointwise (about 3x fewer MACs for wide layers)."""
+    if not depthwise:
+        return nn.Conv1d(in_channels, out_channels, kernel_size=3, stride=stride, padding=1, bias=False)
+    return nn.Sequential(
+        nn.Conv1d(in_channels, in_channels, kernel_size=3, stride=stride, padding=1, groups=in_channels, bias=False),
+        nn.Conv1d(in_channels, out_channels, kernel_size=1, bias=False),
+    )
+
+
+class ResNetBlock(nn.Module):
+    """ResNetBlock of classifier.ipynb. Pruning shrinks its inner channels (conv1 out / bn1 / conv2 in)."""
+    def __init__(self, in_channels, out_channels, stride=1, depthwise=False):
+        super(ResNetBlock, self).__init__()
+        self.conv1 = conv3(in_channels, out_channels, stride, depthwise)
+        self.bn1 = nn.BatchNorm1d(out_channels)
+        self.relu = nn.ELU(inplace=True)
+        self.conv2 = conv3(out_channels, out_channels, 1, depthwise)
+        self.bn2 = nn.BatchNorm1d(out_channels)
+        self.shortcut = nn.Sequential()
+        if stride != 1 or in_channels != out_channels:
+            self.shortcut = nn.Sequential(
+                nn.Conv1d(in_channels, out_channels, kernel_size=1, stride=stride, bias=False),
+                nn.BatchNorm1d(out_channels)
+            )
+
+    def forward(self, x):
+        out = self.relu(self.bn1(self.conv1(x)))
+        out = self.bn2(self.conv2(out))
+        out += self.shortcut(x)
+        return self.relu(out)
+
+
+class ResNet(nn.Module):
+    """
+    ResNet of classifier.ipynb: x [B, 2, T] -> logits [B, C]. The defaults build the
+    notebook model with the same parameter names, so its checkpoints load as they are.
+    """
+    def __init__(self, input_length, input_dim, output_length, stem=64, widths=(128, 256, 512, 512),
+                 blocks=(4, 2, 2, 4), depthwise=False):
+        super(ResNet, self).__init__()
+        self.conv1 = nn.Conv1d(input_dim, stem, kernel_size=7, stride=2, padding=3)
+        self.bn1 = nn.BatchNorm1d(stem)
+        self.relu = nn.ELU(inplace=True)
+        self.maxpool = nn.MaxPool1d(kernel_size=3, stride=2, padding=1)
+        in_channels = stem
+        for i, (width, count) in enumerate(zip(widths, blocks)):
+            setattr(self, f"layer{i + 1}", self._make_layer(in_channels, width, count, 1 if i == 0 else 2, depthwise))
+            in_channels = width
+        self.n_layers = len(widths)
+        self.avgpool = nn.AdaptiveAvgPool1d(1)
+        self.fc = nn.Linear(in_channels, output_length)
+
+    def _make_layer(self, in_channels, out_channels, blocks, stride, depthwise):
+        layers = [ResNetBlock(in_channels, out_channels, stride, depthwise)]
+        for _ in range(1, blocks):
+            layers.append(ResNetBlock(out_channels, out_channels, depthwise=depthwise))
+        return nn.Sequential(*layers)
+
+    def forward(self, x):
+        x = self.maxpool(self.relu(self.bn1(self.conv1(x))))
+        for i in range(self.n_layers):
+            x = getattr(self, f"layer{i + 1}")(x)
+        x = torch.flatten(self.avgpool(x), 1)
+        return self.fc(x)
+
+
+def is_sequence(kind):
+    return kind in SEQUENCE_KINDS
+
+
+def build_model(spec, n_classes, length):
+    """Model from a TEACHERS / STUDENTS style spec: {"kind": ..., constructor arguments}."""
+    spec = dict(spec)
+    kind = spec.pop("kind")
+    if kind == "resnet":
+        return ResNet(length, 2, n_classes, **spec)
+    if kind == "transformer":
+        return FullV1dTransformer(2, n_classes, length, **spec)
+    if kind == "local":
+        return LocalV1dTransformer(2, n_classes, length, **spec)
+    raise ValueError(f"unknown model kind '{kind}'")
+
+
+def load_teacher(path, spec, n_classes, length):
+    """A checkpoint is a whole module, a {"state_dict": ...} dict or a bare state dict."""
+    state = torch.load(path, map_location="cpu", weights_only=False)
+    if isinstance(state, nn.Module):
+        return state
+    model = build_model(spec, n_classes, length)
+    model.load_state_dict(state.get("state_dict", state) if isinstance(state, dict) else state)
+    return model
+
+
+# --- Data ---
+
+class SegmentSet(Dataset):
+    """
+    ADC segments in memory: x float32 [N, 2, length], labels [N], valid samples per segment [N],
+    and optionally raw: the (adc1, adc2) samples of every segment before filtering, resizing and
+    normalization.
+    """
+    def __init__(self, x, labels, lengths, raw=None):
+        self.x = torch.from_numpy(x)
+        self.labels = torch.from_numpy(labels)
+        self.lengths = torch.from_numpy(lengths)
+        self.raw = raw
+
+    def __len__(self):
+        return len(self.labels)
+
+    def __getitem__(self, index):
+        return self.x[index], self.labels[index], self.lengths[index], index
+
+    def subset(self, index):
+        index = np.asarray(index)
+        raw = [self.raw[i] for i in index] if self.raw is not None else None
+        return SegmentSet(self.x.numpy()[index], self.labels.numpy()[index], self.lengths.numpy()[index], raw)
+
+
+def interpolate(values, length):
+    """Stretch a segment to `length` samples (MemmapDataset._interpolate_channel)."""
+    if len(values) == 0:
+        return np.zeros(length, dtype=np.float32)
+    return np.interp(np.linspace(0, len(values) - 1, length), np.arange(len(values)), values)
+
+
+def adc_normalization(descriptor):
+    return descriptor.get("adc_mean", 0.0) or 0.0, descriptor.get("adc_std", 1.0) or 1.0
+
+
+def model_input(channels, length, sequence, mean=0.0, std=1.0):
+    """
+    Model input of one segment from the valid samples of its channels: float32 [2, length]
+    (normalized, then interpolated, or zero-padded / cut for sequence models) and the valid length.
+    """
+    x = np.zeros((len(channels), length), dtype=np.float32)
+    valid_length = length
+    for ch, values in enumerate(channels):
+        values = (np.asarray(values, dtype=np.float64) - mean) / std
+        if sequence:
+            valid_length = min(len(values), length)
+            x[ch, :valid_length] = values[:length]
+        else:
+            x[ch] = interpolate(values, length)
+    return x, valid_length
+
+
+def load_segments(descriptor, length, sequence, filter=False, val_fraction=0.2, seed=0, max_segments=None,
+                  chunk_rows=512, keep_raw=False):
+    """Train / validation SegmentSets of the memmap, split at random (seeded)."""
+    memmap = open_memmap(descriptor)
+    n = descriptor["n_segments"] if max_segments is None else min(max_segments, descriptor["n_segments"])
+    order = np.random.default_rng(seed).permutation(descriptor["n_segments"])[:n]
+    mean, std = adc_normalization(descriptor)
+    x = np.zeros((n, 2, length), dtype=np.float32)
+    labels = np.zeros(n, dtype=np.int64)
+    lengths = np.zeros(n, dtype=np.int64)
+    raw = [None] * n if keep_raw else None
+    for start in range(0, n, chunk_rows):
+        chunk = np.sort(order[start:start + chunk_rows])     # read in file order
+        rows = memmap[chunk]
+        channels = raw_channels = [np.asarray(rows["adc1"], dtype=np.float64), np.asarray(rows["adc2"], dtype=np.float64)]
+        if filter:
+            channels = [BPfilter_batch(c, descriptor["adc_sampling_rate"], descriptor["adc_lowcut"],
+                                       descriptor["adc_highcut"]) for c in channels]
+        for k in range(len(chunk)):
+            i = start + k
+            labels[i] = int(rows["id"][k])
+            segment = [valid(values[k]) for values in channels]
+            x[i], lengths[i] = model_input(segment, length, sequence, mean, std)
+            if keep_raw:
+                raw[i] = [valid(values[k]) for values in raw_channels]
+    n_val = int(round(n * val_fraction))
+    split = np.arange(n)
+    full = SegmentSet(x, labels, lengths, raw)
+    return full.subset(split[n_val:]), full.subset(split[:n_val])
+
+
+def count_classes(descriptor, *sets):
+    mapped = len(set(descriptor.get("dataset_mapping", {}).values()))
+    seen = max(int(s.labels.max()) + 1 for s in sets if len(s))
+    return max(mapped, seen)
+
+
+# --- Distillation ---
+
+def token_mask(logits, lengths, input_kern):
+    """[B, L] True for the tokens that cover real samples (at least the first one)."""
+    tokens = ((lengths - input_kern).clamp(min=0) // input_kern + 1).clamp(max=logits.size(1))
+    return torch.arange(logits.size(1), device=logits.device)[None, :] < tokens[:, None]
+
+
+def segment_logits(model, x, lengths):
+    """[B, C] logits: the model output, or for sequence models the mean over the valid tokens."""
+    logits = model(x)
+    if logits.dim() == 2:
+        return logits
+    mask = token_mask(logits, lengths, model.input_kern).unsqueeze(-1).float()
+    return (logits * mask).sum(dim=1) / mask.sum(dim=1)
+
+
+def distillation_loss(student, teacher, labels, temperature, alpha, mask=None):
+    """alpha * T^2 * KL(teacher_T || student_T) + (1 - alpha) * CE. Sequences: [B, L, C] with mask [B, L]."""
+    if student.dim() == 3:
+        student, labels = student[mask], labels[:, None].expand(mask.shape)[mask]
+        teacher = teacher[mask] if teacher is not None else None
+    loss = F.cross_entropy(student.float(), labels)
+    if teacher is None or alpha == 0:
+        return loss
+    kd = F.kl_div(F.log_softmax(student.float() / temperature, dim=-1),
+                  F.log_softmax(teacher.float() / temperature, dim=-1),
+                  log_target=True, reduction="batchmean") * temperature ** 2
+    return alpha * kd + (1 - alpha) * loss
+
+
+@torch.no_grad()   # not inference_mode: the logits are used as targets in training
+def teacher_logits(teacher, data, batch_size=64):
+    """Logits of the teacher for every segment of `data`, or None if they would not fit TEACHER_CACHE_MB."""
+    probe = teacher.eval()(data.x[:1])
+    if probe.numel() * len(data) * 4 > TEACHER_CACHE_MB << 20:
+        return None
+    out = torch.empty((len(data),) + tuple(probe.shape[1:]))
+    for start in range(0, len(data), batch_size):
+        out[start:start + batch_size] = teacher(data.x[start:start + batch_size])
+    return out
+
+
+def distill(student, teacher, train_set, epochs, temperature=4.0, alpha=0.7, learning_rate=1e-3, batch_size=32,
+            precision="auto", compile=False, verbose=1):
+    """
+    Train `student` on train_set against the teacher's softened logits (teacher None: labels only).
+    The teacher logits are computed once when they fit in TEACHER_CACHE_MB, else on every batch.
+    """
+    cached = teacher_logits(teacher, train_set) if teacher is not None else None
+    if teacher is not None:
+        teacher.eval()
+
+    def compute_loss(model, batch):
+        x, labels, lengths, index = batch
+        out = model(x)
+        target = None
+        if cached is not None:
+            target = cached[index]
+        elif teacher is not None:
+            with torch.no_grad():
+                target = teacher(x)
+        mask = token_mask(out, lengths, student.input_kern) if out.dim() == 3 else None
+        loss = distillation_loss(out, target, labels, temperature, alpha, mask)
+        predicted = (out * mask.unsqueeze(-1)).sum(dim=1).argmax(dim=-1) if mask is not None else out.argmax(dim=-1)
+        return loss, {"correct": (predicted == labels).sum().item(), "total": len(labels)}
+
+    loader = DataLoader(train_set, batch_size=batch_size, shuffle=True, drop_last=True)
+    optimizer = torch.optim.AdamW(student.parameters(), lr=learning_rate, weight_decay=1e-4)
+    scheduler = torch.optim.lr_scheduler.CosineAnnealingLR(optimizer, max(1, epochs * len(loader)))
+    return train(student, loader, epochs, compute_loss, optimizer=optimizer, scheduler=scheduler,
+                 precision=precision, compile=compile, verbose=verbose)
+
+
+# --- Structured pruning ---
+
+def _keep_count(original, ratio):
+    keep = max(1, int(round(original * (1 - ratio))))
+    # Multiples of 8 keep the CPU kernels on their vectorized paths.
+    return max(8, keep // 8 * 8) if original >= 16 else keep
+
+
+def _select(module, index, dim):
+    """Keep `index` along `dim` of a Conv1d / Linear weight (and the bias of dim 0)."""
+    module.weight = nn.Parameter(module.weight.data.index_select(dim, index).clone())
+    if dim == 0 and module.bias is not None:
+        module.bias = nn.Parameter(module.bias.data.index_select(0, index).clone())
+
+
+def _prune_block(block, keep):
+    """Keep the `keep` most important inner channels of a ResNetBlock (conv1 out / bn1 / conv2 in)."""
+    depthwise = isinstance(block.conv1, nn.Sequential)
+    emit = block.conv1[1] if depthwise else block.conv1
+    use = block.conv2 if not depthwise else block.conv2[1]
+    # |gamma| says how much of the channel survives bn1, the conv2 weights how much the block reads it.
+    if depthwise:
+        reads = block.conv2[0].weight.data.abs().sum(dim=(1, 2)) * use.weight.data.abs().sum(dim=(0, 2))
+    else:
+        reads = use.weight.data.abs().sum(dim=(0, 2))
+    score = block.bn1.weight.data.abs() * reads
+    index = torch.sort(torch.topk(score, keep).indices).values
+
+    _select(emit, index, 0)
+    emit.out_channels = keep
+    bn = block.bn1
+    bn.weight = nn.Parameter(bn.weight.data[index].clone())
+    bn.bias = nn.Parameter(bn.bias.data[index].clone())
+    bn.running_mean = bn.running_mean[index].clone()
+    bn.running_var = bn.running_var[index].clone()
+    bn.num_features = keep
+    if depthwise:
+        dw = block.conv2[0]
+        _select(dw, index, 0)
+        dw.in_channels = dw.out_channels = dw.groups = keep
+        _select(use, index, 1)
+    else:
+        _select(use, index, 1)
+    use.in_channels = keep
+
+
+def _prune_ffn(layer, keep):
+    """Keep the `keep` most important feed-forward units of an encoder layer (linear1 rows / linear2 columns)."""
+    score = layer.linear1.weight.data.abs().sum(dim=1) * layer.linear2.weight.data.abs().sum(dim=0)
+    index = torch.sort(torch.topk(score, keep).indices).values
+    _select(layer.linear1, index, 0)
+    layer.linear1.out_features = keep
+    _select(layer.linear2, index, 1)
+    layer.linear2.in_features = keep
+
+
+def prunable_units(model):
+    """(module, width) of every structure pruning shrinks."""
+    units = []
+    for module in model.modules():
+        if isinstance(module, ResNetBlock):
+            units.append((module, module.bn1.num_features))
+        elif hasattr(module, "linear1") and hasattr(module, "linear2"):
+            units.append((module, module.linear1.out_features))
+    return units
+
+
+def prune_model(model, ratio, reference=None):
+    """
+    Copy of `model` with `ratio` of the inner channels / feed-forward units of every
+    block removed. Widths are taken relative to `reference` (default: the model), so
+    iterative pruning can start each step from the previous, already pruned, model.
+    """
+    pruned = copy.deepcopy(model).cpu()
+    reference = reference if reference is not None else model
+    with torch.no_grad():
+        for (unit, width), (_, original) in zip(prunable_units(pruned), prunable_units(reference)):
+            keep = min(width, _keep_count(original, ratio))
+            if keep == width:
+                continue
+            if isinstance(unit, ResNetBlock):
+                _prune_block(unit, keep)
+            else:
+                _prune_ffn(unit, keep)
+    return pruned
+
+
+# --- Measurement ---
+
+@torch.inference_mode()
+def evaluate(model, data, batch_size=64):
+    """Segment accuracy (%) on `data`."""
+    model.eval()
+    correct = 0
+    for start in range(0, len(data), batch_size):
+        x, labels, lengths = (t[start:start + batch_size] for t in (data.x, data.labels, data.lengths))
+        correct += (segment_logits(model, x, lengths).argmax(dim=-1) == labels).sum().item()
+    return 100 * correct / max(1, len(data))
+
+
+@torch.inference_mode()
+def measure_latency(model, example, runs=100, warmup=10, threads=1):
+    """Batch-1 inference time (ms) of `example` [1, 2, T] with `threads` intra-op threads."""
+    model.eval()
+    previous = torch.get_num_threads()
+    torch.set_num_threads(threads)
+    try:
+        for _ in range(warmup):
+            model(example)
+        times = []
+        for _ in range(runs):
+            start = time.perf_counter()
+            model(example)
+            times.append(time.perf_counter() - start)
+    finally:
+        torch.set_num_threads(previous)
+    times = 1000 * np.asarray(times)
+    return {"latency_ms_p50": float(np.percentile(times, 50)), "latency_ms_p95": float(np.percentile(times, 95)),
+            "latency_ms_mean": float(times.mean())}
+
+
+def model_size(model):
+    buffer = io.BytesIO()
+    torch.save(model.state_dict(), buffer)
+    return {"params": sum(p.numel() for p in model.parameters()), "size_mb": buffer.tell() / (1 << 20)}
+
+
+def measure(name, model, val_set, source, threads=1, runs=100):
+    row = {"name": name, "source": source, "accuracy": evaluate(model, val_set)}
+    row.update(model_size(model))
+    row.update(measure_latency(model, val_set.x[:1], runs=runs, threads=threads))
+    return row
+
+
+def pareto_front(rows, cost):
+    """Names of the rows that no other row beats on both accuracy and `cost`."""
+    front = set()
+    for row in rows:
+        dominated = any(other["accuracy"] >= row["accuracy"] and other[cost] <= row[cost]
+                        and (other["accuracy"] > row["accuracy"] or other[cost] < row[cost]) for other in rows)
+        if not dominated:
+            front.add(row["name"])
+    return front
+
+
+def print_report(rows):
+    latency_front = pareto_front(rows, "latency_ms_p50")
+    size_front = pareto_front(rows, "size_mb")
+    print(f"{'model':28s} {'accuracy':>9s} {'p50 ms':>8s} {'p95 ms':>8s} {'params':>10s} {'MB':>7s}  pareto")
+    for row in sorted(rows, key=lambda r: r["latency_ms_p50"]):
+        marks = ("latency " if row["name"] in latency_front else "") + ("size" if row["name"] in size_front else "")
+        print(f"{row['name']:28s} {row['accuracy']:8.2f}% {row['latency_ms_p50']:8.2f} {row['latency_ms_p95']:8.2f} "
+              f"{row['params']:10d} {row['size_mb']:7.2f}  {marks}")
+    for row in rows:
+        row["pareto_latency"] = row["name"] in latency_front
+        row["pareto_size"] = row["name"] in size_front
+    return rows
+
+
+def plot_report(rows, filename):
+    import matplotlib
+    matplotlib.use("Agg")
+    import matplotlib.pyplot as plt
+    fig, axes = plt.subplots(1, 2, figsize=(12, 5))
+    for ax, cost, label in ((axes[0], "latency_ms_p50", "latency p50 (ms, batch 1)"), (axes[1], "size_mb", "size (MB, fp32)")):
+        front = sorted((r for r in rows if r["name"] in pareto_front(rows, cost)), key=lambda r: r[cost])
+        ax.plot([r[cost] for r in front], [r["accuracy"] for r in front], "r--", label="Pareto front")
+        for row in rows:
+            ax.scatter(row[cost], row["accuracy"], color="C0" if row["source"] != "teacher" else "k")
+            ax.annotate(row["name"], (row[cost], row["accuracy"]), fontsize=7, xytext=(3, 3), textcoords="offset points")
+        ax.set_xscale("log")
+        ax.set_xlabel(label)
+        ax.set_ylabel("validation accuracy (%)")
+        ax.grid(True, which="both", alpha=0.3)
+        ax.legend()
+    fig.tight_layout()
+    fig.savefig(filename, dpi=120)
+
+
+# --- Pipeline ---
+
+def student_spec(name):
+    if name in STUDENTS:
+        return name, STUDENTS[name]
+    spec = json.loads(name)
+    return spec.pop("name", spec["kind"] + "-custom"), spec
+
+
+def run(args):
+    with open(args.descriptor, "r") as f:
+        descriptor = json.load(f)
+    teacher_spec = dict(TEACHERS[args.kind], **(json.loads(args.teacher_config) if args.teacher_config else {}))
+    sequence = is_sequence(teacher_spec["kind"])
+    length = args.length or (descriptor["max_adc_len"] if sequence else 512)
+
+    start = time.perf_counter()
+    train_set, val_set = load_segments(descriptor, length, sequence, filter=args.filter, val_fraction=args.val_fraction,
+                                       seed=args.seed, max_segments=args.max_segments)
+    n_classes = count_classes(descriptor, train_set, val_set)
+    print(f"{len(train_set)} train / {len(val_set)} validation segments, {n_classes} classes, length {length} "
+          f"({time.perf_counter() - start:.1f} s)")
+    torch.manual_seed(args.seed)
+    common = dict(temperature=args.temperature, alpha=args.alpha, learning_rate=args.lr, batch_size=args.batch_size,
+                  precision=args.precision, verbose=args.verbose)
+
+    if args.teacher:
+        teacher = load_teacher(args.teacher, teacher_spec, n_classes, length)
+    else:
+        print(f"No teacher checkpoint: training a {args.kind} teacher for {args.teacher_epochs} epochs")
+        teacher = build_model(teacher_spec, n_classes, length)
+        distill(teacher, None, train_set, args.teacher_epochs, **common)
+    models = {"teacher": (teacher, "teacher")}
+
+    for name in args.students:
+        name, spec = student_spec(name)
+        if is_sequence(spec["kind"]) != sequence:
+            print(f"Skipping {name}: a {spec['kind']} student cannot learn from a {args.kind} teacher "
+                  f"(different inputs)")
+            continue
+        print(f"Distilling {name} ({args.epochs} epochs)")
+        student = build_model(spec, n_classes, length)
+        distill(student, teacher, train_set, args.epochs, **common)
+        models[name] = (student, "distilled")
+
+    for target in args.prune_targets:
+        if target not in models:
+            print(f"Skipping pruning of {target}: no such model")
+            continue
+        base = models[target][0]
+        current = base
+        for ratio in sorted(args.prune):
+            name = f"{target}-pruned{int(round(100 * ratio))}"
+            print(f"Pruning {target} by {100 * ratio:.0f}%, fine-tuning {args.finetune_epochs} epochs")
+            current = prune_model(current, ratio, reference=base)
+            distill(current, base, train_set, args.finetune_epochs, **dict(common, learning_rate=args.lr / 10))
+            models[name] = (current, f"pruned from {target}")
+
+    rows = [measure(name, model, val_set, source, threads=args.threads, runs=args.runs)
+            for name, (model, source) in models.items()]
+    print(f"\nValidation accuracy vs batch-1 latency ({args.threads} thread{'s' if args.threads > 1 else ''}) and size:")
+    rows = print_report(rows)
+
+    if args.out_dir:
+        os.makedirs(args.out_dir, exist_ok=True)
+        for name, (model, _) in models.items():
+            torch.save(model, os.path.join(args.out_dir, f"{name}.pt"))
+    if args.report:
+        with open(args.report, "w") as f:
+            json.dump({"kind": args.kind, "length": length, "n_classes": n_classes, "models": rows}, f, indent=2)
+    if args.plot:
+        plot_report(rows, args.plot)
+    return rows
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Distil and prune a classifier, report accuracy vs latency / size.")
+    parser.add_argument("--descriptor", "-d", required=True, help="Descriptor JSON of the memmap dataset.")
+    parser.add_argument("--kind", choices=sorted(TEACHERS), default="resnet", help="Teacher architecture.")
+    parser.add_argument("--teacher", default=None, help="Teacher checkpoint (module or state dict).")
+    parser.add_argument("--teacher_config", default=None, help="JSON overriding the teacher constructor arguments.")
+    parser.add_argument("--teacher_epochs", type=int, default=20, help="Epochs to train a teacher if none is given.")
+    parser.add_argument("--students", nargs="*", default=None,
+                        help=f"Presets ({', '.join(STUDENTS)}) or JSON specs. Default: the presets of --kind.")
+    parser.add_argument("--prune", type=float, nargs="*", default=[0.25, 0.5, 0.75],
+                        help="Pruning ratios, applied one after the other.")
+    parser.add_argument("--prune_targets", nargs="*", default=["teacher"], help="Models to prune (teacher or students).")
+    parser.add_argument("--epochs", type=int, default=20, help="Distillation epochs per student.")
+    parser.add_argument("--finetune_epochs", type=int, default=5, help="Fine-tuning epochs after each pruning step.")
+    parser.add_argument("--temperature", type=float, default=4.0)
+    parser.add_argument("--alpha", type=float, default=0.7, help="Weight of the distillation term.")
+    parser.add_argument("--lr", type=float, default=1e-3)
+    parser.add_argument("--batch_size", type=int, default=32)
+    parser.add_argument("--precision", default="auto", choices=["auto", "bf16", "fp32"])
+    parser.add_argument("--length", type=int, default=None,
+                        help="Input samples (default: 512 for resnet, max_adc_len for transformers).")
+    parser.add_argument("--filter", action="store_true", help="Band-pass the ADC channels (as MemmapDataset(filter=True)).")
+    parser.add_argument("--val_fraction", type=float, default=0.2)
+    parser.add_argument("--max_segments", type=int, default=None)
+    parser.add_argument("--threads", type=int, default=1, help="Intra-op threads for the latency measurement.")
+    parser.add_argument("--runs", type=int, default=100, help="Timed inferences per model.")
+    parser.add_argument("--report", default=None, help="Write the results to this JSON file.")
+    parser.add_argument("--plot", default=None, help="Save the Pareto plots to this image.")
+    parser.add_argument("--out_dir", default=None, help="Save every model here.")
+    parser.add_argument("--seed", type=int, default=0)
+    parser.add_argument("--verbose", type=int, default=1)
+    args = parser.parse_args()
+
+    if not os.path.isfile(args.descriptor):
+        print(f"Error: File '{args.descriptor}' does not exist.")
+        raise SystemExit(1)
+    if args.students is None:
+        args.students = [name for name, spec in STUDENTS.items()
+                         if is_sequence(spec["kind"]) == is_sequence(TEACHERS[args.kind]["kind"])]
+    run(args)
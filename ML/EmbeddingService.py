@@ -0,0 +1,325 @@
+"""
+Incremental embedding / clustering of word segments.
+
+The analysis notebooks re-extract features and refit UMAP (or t-SNE) and KMeans
+from scratch for every plot. EmbeddingService keeps the expensive parts:
+  - FeatureCache: features per segment in an HDF5 file, keyed by
+    "<file path>/<dataset>@<data signature>/<start>:<end>" under a group named
+    after the feature settings, so re-running an analysis only extracts features
+    of new segments, and a re-recorded file with the same name is not mistaken
+    for the old one,
+  - the embedding is fitted once (UMAP, whose kNN graph comes from
+    NN-descent, an approximate-nearest-neighbour method). New sessions are
+    projected with transform() instead of refitting. If umap-learn is not
+    installed, PCA is used,
+  - MiniBatchKMeans is updated with partial_fit per incoming session,
+  - ARI / NMI come from a label x cluster contingency table, updated with every
+    point (assigned to its cluster when it arrives). The silhouette is the
+    simplified (centroid) silhouette, accumulated the same way. refresh_metrics()
+    recomputes all three exactly for the current centroids.
+The service state (embedder, clusterer, metric tables) is pickled, so the next
+run only transforms the new sessions. Segments already in the state (same key)
+are skipped, so adding a session twice does not count it twice.
+
+Usage (segments from the H5 datasets with the notebook's energy segmentation):
+    python EmbeddingService.py -i recordings.h5 --fit word0 word1 word2 --state embed.pkl
+    python EmbeddingService.py -i recordings2.h5 --add word0 word1 --state embed.pkl --out points.csv
+"""
+
+import argparse
+import csv
+import hashlib
+import json
+import os
+import pickle
+import time
+import zlib
+
+import h5py
+import numpy as np
+from sklearn.cluster import MiniBatchKMeans
+from sklearn.decomposition import PCA
+from sklearn.metrics import adjusted_rand_score, normalized_mutual_info_score, silhouette_score
+from sklearn.preprocessing import StandardScaler
+
+from SegmentTuner import EnergyCache, segment_energy, segment_features, ADC_CHANNELS, ADC_DECIMATION
+
+# Segmentation used in nicoAnalysis.ipynb for the datasets loop.
+DEFAULT_SEGMENTATION = dict(frame_duration=0.04, hop_duration=0.1, smoothing_window=6, energy_quantile=0.20,
+                            min_silence_frames=1, min_voiced_frames=2)
+DEFAULT_FEATURES = dict(n_fft=256, hop=128, n_bands=16)
+
+
+class FeatureCache:
+    """Segment features persisted in HDF5, one group per feature configuration."""
+    def __init__(self, filename, feature_params=DEFAULT_FEATURES):
+        self.filename = filename
+        self.feature_params = dict(feature_params)
+        self.group_name = hashlib.sha1(json.dumps(self.feature_params, sort_keys=True).encode()).hexdigest()[:12]
+        self.memory = {}
+        self.hits = 0
+        self.misses = 0
+        if os.path.exists(filename):
+            with h5py.File(filename, "r") as f:
+                if self.group_name in f:
+                    group = f[self.group_name]
+                    keys = group["keys"].asstr()[:]
+                    features = group["features"][:]
+                    self.memory = dict(zip(keys, features))
+        self.pending = {}
+
+    def get(self, key, compute):
+        feats = self.memory.get(key)
+        if feats is None:
+            self.misses += 1
+            feats = self.memory[key] = self.pending[key] = compute()
+        else:
+            self.hits += 1
+        return feats
+
+    def flush(self):
+        if not self.pending:
+            return
+        keys = list(self.pending)
+        features = np.stack([self.pending[k] for k in keys]).astype(np.float32)
+        with h5py.File(self.filename, "a") as f:
+            if self.group_name not in f:
+                group = f.create_group(self.group_name)
+                group.attrs["feature_params"] = json.dumps(self.feature_params)
+                group.create_dataset("keys", shape=(0,), maxshape=(None,), dtype=h5py.string_dtype(), chunks=True)
+                group.create_dataset("features", shape=(0, features.shape[1]), maxshape=(None, features.shape[1]),
+                                     dtype=np.float32, chunks=True)
+            group = f[self.group_name]
+            old = group["keys"].shape[0]
+            group["keys"].resize((old + len(keys),))
+            group["keys"][old:] = keys
+            group["features"].resize((old + len(keys), features.shape[1]))
+            group["features"][old:] = features
+        self.pending.clear()
+
+
+class ContingencyMetrics:
+    """ARI / NMI from a growing label x cluster table, plus a running simplified silhouette."""
+    def __init__(self, n_clusters):
+        self.n_clusters = n_clusters
+        self.labels = {}                # label -> row
+        self.table = np.zeros((0, n_clusters), dtype=np.int64)
+        self.silhouette_sum = 0.0
+        self.count = 0
+
+    def update(self, labels, clusters, distances):
+        """distances: [n, n_clusters] point-to-centroid distances at assignment time."""
+        for label in labels:
+            if label not in self.labels:
+                self.labels[label] = len(self.labels)
+                self.table = np.vstack((self.table, np.zeros((1, self.n_clusters), dtype=np.int64)))
+        rows = np.array([self.labels[label] for label in labels])
+        np.add.at(self.table, (rows, clusters), 1)
+        own = distances[np.arange(len(clusters)), clusters]
+        others = distances.copy()
+        others[np.arange(len(clusters)), clusters] = np.inf
+        nearest = others.min(axis=1)
+        self.silhouette_sum += float(np.sum((nearest - own) / np.maximum(np.maximum(nearest, own), 1e-12)))
+        self.count += len(clusters)
+
+    def ari(self):
+        comb2 = lambda x: x * (x - 1) / 2.0
+        n = self.table.sum()
+        if n < 2:
+            return float("nan")
+        index = comb2(self.table).sum()
+        a = comb2(self.table.sum(axis=1)).sum()
+        b = comb2(self.table.sum(axis=0)).sum()
+        expected = a * b / comb2(n)
+        maximum = (a + b) / 2.0
+        return float((index - expected) / (maximum - expected)) if maximum != expected else 1.0
+
+    def nmi(self):
+        n = self.table.sum()
+        if n == 0:
+            return float("nan")
+        p = self.table / n
+        pu, pv = p.sum(axis=1), p.sum(axis=0)
+        nz = p > 0
+        mi = float(np.sum(p[nz] * np.log(p[nz] / np.outer(pu, pv)[nz])))
+        hu = -float(np.sum(pu[pu > 0] * np.log(pu[pu > 0])))
+        hv = -float(np.sum(pv[pv > 0] * np.log(pv[pv > 0])))
+        denom = (hu + hv) / 2.0
+        return mi / denom if denom > 0 else 1.0
+
+    def silhouette(self):
+        return self.silhouette_sum / self.count if self.count else float("nan")
+
+
+class EmbeddingService:
+    def __init__(self, n_clusters, n_components=2, n_neighbors=15, min_dist=0.1, metric="correlation",
+                 batch_size=256, seed=42):
+        self.n_clusters = n_clusters
+        self.n_components = n_components
+        self.umap_params = dict(n_components=n_components, n_neighbors=n_neighbors, min_dist=min_dist,
+                                metric=metric, random_state=seed)
+        self.scaler = None
+        self.embedder = None
+        self.clusterer = MiniBatchKMeans(n_clusters=n_clusters, batch_size=batch_size, random_state=seed, n_init=3)
+        self.metrics = ContingencyMetrics(n_clusters)
+        # Everything seen so far, for refresh_metrics() and plotting.
+        self.features = []
+        self.labels = []
+        self.keys = []
+        self.embedding = []
+
+    def fit(self, features, labels, keys):
+        """Fit the scaler and the embedding once on the first sessions, then stream them in."""
+        features = np.asarray(features, dtype=np.float64)
+        self.scaler = StandardScaler().fit(features)
+        scaled = self.scaler.transform(features)
+        try:
+            from umap import UMAP
+            self.embedder = UMAP(**self.umap_params, low_memory=True)
+        except ImportError:
+            print("umap-learn not installed, using PCA for the embedding")
+            self.embedder = PCA(n_components=self.n_components, random_state=self.umap_params["random_state"])
+        start = time.perf_counter()
+        coords = self.embedder.fit_transform(scaled)
+        print(f"Embedding fitted on {len(features)} segments in {time.perf_counter() - start:.2f} s")
+        self._ingest(features, scaled, coords, labels, keys)
+
+    def add(self, features, labels, keys):
+        """
+        Project a new session with the fitted embedding and update the clustering.
+        Segments whose key is already in the state are skipped. Returns the number added.
+        """
+        if self.embedder is None:
+            self.fit(features, labels, keys)
+            return len(keys)
+        known = set(self.keys)
+        new = [i for i, key in enumerate(keys) if key not in known]
+        if len(new) < len(keys):
+            print(f"Skipping {len(keys) - len(new)} segments already in the state")
+        if not new:
+            return 0
+        features = np.asarray(features, dtype=np.float64)[new]  # cached features are float32
+        labels = [labels[i] for i in new]
+        keys = [keys[i] for i in new]
+        scaled = self.scaler.transform(features)
+        coords = self.embedder.transform(scaled)
+        self._ingest(features, scaled, coords, labels, keys)
+        return len(new)
+
+    def _ingest(self, features, scaled, coords, labels, keys):
+        # Clustering runs in feature space, like the notebooks' KMeans on X_scaled.
+        # A first call with fewer points than clusters cannot initialise the centroids.
+        if len(scaled) >= self.n_clusters or hasattr(self.clusterer, "cluster_centers_"):
+            self.clusterer.partial_fit(scaled)
+            distances = self.clusterer.transform(scaled)
+            self.metrics.update(labels, distances.argmin(axis=1), distances)
+        self.features.extend(features)
+        self.labels.extend(labels)
+        self.keys.extend(keys)
+        self.embedding.extend(coords)
+
+    def clusters(self):
+        return self.clusterer.predict(self.scaler.transform(np.asarray(self.features)))
+
+    def refresh_metrics(self, max_silhouette_points=5000, seed=0):
+        """Exact ARI / NMI / silhouette with the current centroids (silhouette on a sample)."""
+        scaled = self.scaler.transform(np.asarray(self.features))
+        clusters = self.clusterer.predict(scaled)
+        idx = np.random.default_rng(seed).permutation(len(scaled))[:max_silhouette_points]
+        sil = silhouette_score(scaled[idx], clusters[idx]) if len(set(clusters[idx])) > 1 else float("nan")
+        return {"ARI": adjusted_rand_score(self.labels, clusters),
+                "NMI": normalized_mutual_info_score(self.labels, clusters),
+                "silhouette": sil}
+
+    def streaming_metrics(self):
+        return {"ARI": self.metrics.ari(), "NMI": self.metrics.nmi(), "silhouette": self.metrics.silhouette()}
+
+    def save(self, filename):
+        with open(filename, "wb") as f:
+            pickle.dump(self, f)
+
+    @staticmethod
+    def load(filename):
+        with open(filename, "rb") as f:
+            return pickle.load(f)
+
+
+def data_signature(signal):
+    """Cheap fingerprint of a recording stream: its length and a CRC of ~64k samples spread over it."""
+    signal = np.asarray(signal)
+    step = max(1, len(signal) // 65536)
+    return f"{len(signal)}:{zlib.crc32(np.ascontiguousarray(signal[::step]).tobytes()):08x}"
+
+
+def session_segments(filename, datasets, cache, segmentation=DEFAULT_SEGMENTATION):
+    """Segment every dataset (= word label) of an H5 file and return (features, labels, keys)."""
+    from DataLoader import H5DataLoader
+
+    loader = H5DataLoader(filename)
+    session = os.path.abspath(filename)
+    features, labels, keys = [], [], []
+    for name in datasets:
+        data = loader.load_dataset(name)
+        energy = EnergyCache(data["audio_data"])
+        adc = {ch: np.asarray(data["adc_data"].get(ch, np.array([])), dtype=np.float64) for ch in ADC_CHANNELS}
+        signature = data_signature(data["audio_data"])
+        for start, end in segment_energy(energy, **segmentation):
+            key = f"{session}/{name}@{signature}/{start}:{end}"
+            blocks = [adc[ch][start // ADC_DECIMATION:end // ADC_DECIMATION] for ch in ADC_CHANNELS]
+            features.append(cache.get(key, lambda: segment_features(blocks, **cache.feature_params)))
+            labels.append(name)
+            keys.append(key)
+    loader.close()
+    cache.flush()
+    return features, labels, keys
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Incremental embedding and clustering of word segments.")
+    parser.add_argument("--input_file", "-i", required=True, help="H5 recording.")
+    group = parser.add_mutually_exclusive_group(required=True)
+    group.add_argument("--fit", nargs="+", help="Datasets used to fit the embedding (new state).")
+    group.add_argument("--add", nargs="+", help="Datasets streamed into an existing state.")
+    parser.add_argument("--state", default="embedding_state.pkl", help="Pickled service state.")
+    parser.add_argument("--cache", default="feature_cache.h5", help="HDF5 feature cache.")
+    parser.add_argument("--clusters", type=int, default=None, help="Number of clusters (default: number of --fit datasets).")
+    parser.add_argument("--out", "-o", default=None, help="CSV with key, label, cluster and embedding coordinates.")
+    args = parser.parse_args()
+
+    if not os.path.isfile(args.input_file):
+        print(f"Error: File '{args.input_file}' does not exist.")
+        raise SystemExit(1)
+
+    cache = FeatureCache(args.cache)
+    start = time.perf_counter()
+    features, labels, keys = session_segments(args.input_file, args.fit or args.add, cache)
+    print(f"{len(features)} segments, features in {time.perf_counter() - start:.2f} s "
+          f"(cache hits {cache.hits}, misses {cache.misses})")
+
+    if args.fit:
+        service = EmbeddingService(args.clusters or len(args.fit))
+        service.fit(features, labels, keys)
+    else:
+        if not os.path.isfile(args.state):
+            print(f"Error: no state '{args.state}', run with --fit first.")
+            raise SystemExit(1)
+        service = EmbeddingService.load(args.state)
+        start = time.perf_counter()
+        added = service.add(features, labels, keys)
+        print(f"Projected {added} new segments in {time.perf_counter() - start:.2f} s")
+    service.save(args.state)
+
+    streaming = service.streaming_metrics()
+    exact = service.refresh_metrics()
+    print(f"Streaming: ARI {streaming['ARI']:.3f} NMI {streaming['NMI']:.3f} silhouette {streaming['silhouette']:.3f} "
+          f"({service.metrics.count} segments)")
+    print(f"Refreshed: ARI {exact['ARI']:.3f} NMI {exact['NMI']:.3f} silhouette {exact['silhouette']:.3f}")
+
+    if args.out:
+        clusters = service.clusters()
+        with open(args.out, "w", newline="") as f:
+            writer = csv.writer(f)
+            writer.writerow(["key", "label", "cluster"] + [f"dim{i}" for i in range(service.n_components)])
+            for key, label, cluster, coords in zip(service.keys, service.labels, clusters, service.embedding):
+                writer.writerow([key, label, int(cluster)] + [f"{c:.5f}" for c in coords])
+        print("Points saved to", args.out)
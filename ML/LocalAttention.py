@@ -0,0 +1,264 @@
+"""
+Local (chunked) attention encoder for long ADC sequences.
+
+V1dTransformer in Transformer_seq_full.ipynb runs full self-attention over all
+tokens of a composite sequence, so memory and time grow with tokens^2. Here the
+token sequence is cut into blocks of `window` tokens and each block attends to
+itself and its two neighbours (3 * window keys), which makes the cost linear in
+the sequence length. The receptive field still grows by one block per layer.
+
+LocalV1dTransformer keeps the V1dTransformer interface:
+  - same constructor arguments (plus window / downsample),
+  - forward(x) with x [B, 2, T] -> logits [B, (T - input_kern) // input_kern + 1, C],
+    so train_epoch's `ids[:, ::model.input_kern]` labels line up unchanged,
+  - optional src_key_padding_mask, and compute_src_key_padding_mask() for inf padding.
+downsample=k adds k stride-2 conv stages after the input conv. Attention then runs
+on T / (input_kern * 2^k) tokens, and the logits are repeated back to the input_kern
+resolution.
+
+Memory / throughput benchmark (one process per configuration, peak RSS), ending
+with the longest length each model trained at and the lengths that only the local
+models reach:
+    python LocalAttention.py --lengths 16384 65536 262144 --batch_size 8
+No results have been recorded for it yet (it was not run when this was written).
+"""
+
+import argparse
+import math
+import os
+import resource
+import time
+
+import torch
+from torch import nn
+import torch.nn.functional as F
+
+from Models import FullV1dTransformer, SinusoidalPositionalEncoding
+
+
+def _shift_blocks(t, direction, fill):
+    """Shift [B, ..., n, W, ...] along the block axis (dim 2 for heads, 1 for masks)."""
+    dim = 2 if t.dim() == 5 else 1
+    pad_shape = list(t.shape)
+    pad_shape[dim] = 1
+    pad = t.new_full(pad_shape, fill)
+    if direction > 0:   # block i sees block i - 1
+        return torch.cat((pad, t.narrow(dim, 0, t.size(dim) - 1)), dim=dim)
+    return torch.cat((t.narrow(dim, 1, t.size(dim) - 1), pad), dim=dim)
+
+
+class LocalWindowAttention(nn.Module):
+    """Multi-head attention restricted to the own block and the two neighbouring blocks."""
+    def __init__(self, d_model, nhead, window, dropout=0.0):
+        super().__init__()
+        assert d_model % nhead == 0
+        self.nhead = nhead
+        self.window = window
+        self.dropout = dropout
+        self.in_proj = nn.Linear(d_model, 3 * d_model)
+        self.out_proj = nn.Linear(d_model, d_model)
+
+    def forward(self, x, key_padding_mask=None):
+        B, L, D = x.shape
+        H, W = self.nhead, self.window
+        n = math.ceil(L / W)
+        pad = n * W - L
+        valid = torch.ones(B, L, dtype=torch.bool, device=x.device) if key_padding_mask is None else ~key_padding_mask
+        if pad:
+            x = F.pad(x, (0, 0, 0, pad))
+            valid = F.pad(valid, (0, pad), value=False)
+
+        q, k, v = self.in_proj(x).chunk(3, dim=-1)
+        # [B, L', D] -> [B, H, n, W, dh]
+        q, k, v = (t.view(B, n, W, H, D // H).permute(0, 3, 1, 2, 4) for t in (q, k, v))
+        k = torch.cat((_shift_blocks(k, 1, 0.0), k, _shift_blocks(k, -1, 0.0)), dim=3)
+        v = torch.cat((_shift_blocks(v, 1, 0.0), v, _shift_blocks(v, -1, 0.0)), dim=3)
+
+        blocks = valid.view(B, n, W)
+        ctx = torch.cat((_shift_blocks(blocks, 1, False), blocks, _shift_blocks(blocks, -1, False)), dim=2)
+        # A block without any valid key would give NaN; its outputs are padding anyway.
+        ctx = ctx | ~ctx.any(dim=2, keepdim=True)
+        attn_mask = ctx[:, None, :, None, :].expand(B, H, n, 1, 3 * W).reshape(B, H * n, 1, 3 * W)
+
+        # Heads and blocks are folded into one batch axis: [B, H * n, W, dh] x [B, H * n, 3W, dh].
+        dh = D // H
+        out = F.scaled_dot_product_attention(q.reshape(B, H * n, W, dh), k.reshape(B, H * n, 3 * W, dh),
+                                             v.reshape(B, H * n, 3 * W, dh), attn_mask=attn_mask,
+                                             dropout_p=self.dropout if self.training else 0.0)
+        out = out.view(B, H, n, W, dh).permute(0, 2, 3, 1, 4).reshape(B, n * W, D)[:, :L]
+        return self.out_proj(out)
+
+
+class LocalEncoderLayer(nn.Module):
+    """Post-norm encoder layer, like nn.TransformerEncoderLayer (relu, batch_first)."""
+    def __init__(self, d_model, nhead, dim_feedforward, window, dropout=0.1):
+        super().__init__()
+        self.self_attn = LocalWindowAttention(d_model, nhead, window, dropout)
+        self.linear1 = nn.Linear(d_model, dim_feedforward)
+        self.linear2 = nn.Linear(dim_feedforward, d_model)
+        self.norm1 = nn.LayerNorm(d_model)
+        self.norm2 = nn.LayerNorm(d_model)
+        self.dropout = nn.Dropout(dropout)
+        self.dropout1 = nn.Dropout(dropout)
+        self.dropout2 = nn.Dropout(dropout)
+
+    def forward(self, x, src_key_padding_mask=None):
+        x = self.norm1(x + self.dropout1(self.self_attn(x, src_key_padding_mask)))
+        x = self.norm2(x + self.dropout2(self.linear2(self.dropout(F.relu(self.linear1(x))))))
+        return x
+
+
+class LocalV1dTransformer(nn.Module):
+    def __init__(self,
+                 input_dim,
+                 output_dim,
+                 max_length,
+                 input_kern=16,     # Kernel size (and stride) of the initial Conv1d layer
+                 nhead=8,
+                 num_encoder_layers=6,
+                 dim_feedforward=512,
+                 dropout=0.1,
+                 window=64,         # Tokens per attention block
+                 downsample=0):     # Extra stride-2 conv stages before the encoder
+        super(LocalV1dTransformer, self).__init__()
+
+        self.input_dim = input_dim
+        self.output_dim = output_dim
+        self.input_kern = input_kern
+        self.stride = input_kern
+        self.downsample = downsample
+
+        self.conv = nn.Conv1d(input_dim, dim_feedforward, kernel_size=self.input_kern, stride=self.stride)
+        self.front = nn.ModuleList([
+            nn.Conv1d(dim_feedforward, dim_feedforward, kernel_size=3, stride=2, padding=1)
+            for _ in range(downsample)
+        ])
+        n_tokens = (max_length - self.input_kern) // self.stride + 1
+        self.pos_encoding = SinusoidalPositionalEncoding(dim_feedforward, max_len=math.ceil(n_tokens / 2 ** downsample))
+        self.layers = nn.ModuleList([
+            LocalEncoderLayer(dim_feedforward, nhead, dim_feedforward * 2, window, dropout)
+            for _ in range(num_encoder_layers)
+        ])
+        self.fc_out = nn.Linear(dim_feedforward, output_dim)
+
+    def compute_src_key_padding_mask(self, x):
+        """[B, C, T] padded with inf -> [B, tokens] mask at input_kern resolution, True = padding."""
+        B, C, L_in = x.shape
+        real_lengths = (~torch.isinf(x).all(dim=1)).sum(dim=1)
+        L_out = (L_in - self.input_kern) // self.stride + 1
+        real_tokens = (real_lengths - self.input_kern).clamp(min=0) // self.stride + 1
+        return torch.arange(L_out, device=x.device)[None, :] >= real_tokens[:, None]
+
+    def forward(self, x, src_key_padding_mask=None):
+        """
+        x: [B, 2, T] (two ADC channels). inf padding is zeroed before the conv.
+        src_key_padding_mask: optional [B, tokens] (see compute_src_key_padding_mask).
+        """
+        x = x.masked_fill(torch.isinf(x), 0.0)
+        x = self.conv(x)                            # [B, D, L1]
+        L1 = x.size(-1)
+        mask = src_key_padding_mask
+        for stage in self.front:
+            x = F.gelu(stage(x))
+            if mask is not None:
+                # A downsampled token is padding only if both of its inputs are.
+                mask = ~F.max_pool1d((~mask).float().unsqueeze(1), 2, 2, ceil_mode=True).squeeze(1).bool()
+        x = x.permute(0, 2, 1)                      # [B, L, D]
+        x = self.pos_encoding(x)
+        for layer in self.layers:
+            x = layer(x, mask)
+        x = self.fc_out(x)                          # [B, L, C]
+        if self.downsample:
+            x = x.repeat_interleave(2 ** self.downsample, dim=1)[:, :L1]
+        return x
+
+
+def _bench_one(kind, length, args, conn):
+    """Runs in a child process so that ru_maxrss is the peak of this configuration only."""
+    torch.manual_seed(0)
+    torch.set_num_threads(args.threads or os.cpu_count())
+    common = dict(input_dim=2, output_dim=args.classes, max_length=length, input_kern=args.input_kern,
+                  nhead=args.nhead, num_encoder_layers=args.layers, dim_feedforward=args.dim)
+    if kind == "full":
+        model = FullV1dTransformer(**common)
+    else:
+        model = LocalV1dTransformer(**common, window=args.window, downsample=args.downsample if kind == "local+ds" else 0)
+    optimizer = torch.optim.Adam(model.parameters(), lr=1e-4)
+    x = torch.randn(args.batch_size, 2, length)
+    ids = torch.randint(0, args.classes, (args.batch_size, length))[:, ::args.input_kern]
+    base = resource.getrusage(resource.RUSAGE_SELF).ru_maxrss
+    try:
+        times = []
+        for step in range(args.steps + 1):
+            start = time.perf_counter()
+            logits = model(x)
+            loss = F.cross_entropy(logits.permute(0, 2, 1), ids[:, :logits.size(1)])
+            optimizer.zero_grad()
+            loss.backward()
+            optimizer.step()
+            if step:  # first step is warm-up
+                times.append(time.perf_counter() - start)
+        peak = resource.getrusage(resource.RUSAGE_SELF).ru_maxrss
+        conn.send({"step_s": sum(times) / len(times), "peak_mb": (peak - base) / 1024, "tokens": logits.size(1)})
+    except RuntimeError as e:  # allocation failure
+        conn.send({"error": str(e).splitlines()[0]})
+
+
+if __name__ == "__main__":
+    import multiprocessing as mp
+
+    parser = argparse.ArgumentParser(description="Memory / throughput of full vs local attention encoders.")
+    parser.add_argument("--lengths", type=int, nargs="+", default=[4096, 16384, 65536, 262144],
+                        help="Composite sequence lengths in ADC samples.")
+    parser.add_argument("--batch_size", type=int, default=8)
+    parser.add_argument("--input_kern", type=int, default=32)
+    parser.add_argument("--nhead", type=int, default=4)
+    parser.add_argument("--layers", type=int, default=4)
+    parser.add_argument("--dim", type=int, default=256)
+    parser.add_argument("--classes", type=int, default=40)
+    parser.add_argument("--window", type=int, default=64)
+    parser.add_argument("--downsample", type=int, default=2, help="Stride-2 stages for the local+ds variant.")
+    parser.add_argument("--steps", type=int, default=3)
+    parser.add_argument("--threads", type=int, default=None)
+    parser.add_argument("--mem_limit_mb", type=float, default=8192,
+                        help="Skip the full model at a length once it exceeded this at a shorter one.")
+    args = parser.parse_args()
+
+    ctx = mp.get_context("spawn")
+    print(f"batch {args.batch_size}, input_kern {args.input_kern}, d_model {args.dim}, {args.layers} layers, "
+          f"window {args.window}")
+    print(f"{'length':>8s} {'model':>9s} {'tokens':>7s} {'step s':>8s} {'samples/s':>10s} {'peak MB':>9s}")
+    over_limit = set()
+    feasible = {kind: [] for kind in ("full", "local", "local+ds")}
+    for length in args.lengths:
+        for kind in ("full", "local", "local+ds"):
+            if kind in over_limit:
+                print(f"{length:8d} {kind:>9s}   skipped (over --mem_limit_mb at a shorter length)")
+                continue
+            parent, child = ctx.Pipe()
+            proc = ctx.Process(target=_bench_one, args=(kind, length, args, child))
+            proc.start()
+            child.close()
+            try:
+                result = parent.recv() if parent.poll(3600) else {"error": "timeout"}
+            except EOFError:
+                result = None
+            proc.join()
+            if result is None:
+                result = {"error": f"exit code {proc.exitcode} (killed, likely out of memory)"}
+            if "error" in result:
+                print(f"{length:8d} {kind:>9s}   infeasible: {result['error']}")
+                over_limit.add(kind)
+                continue
+            print(f"{length:8d} {kind:>9s} {result['tokens']:7d} {result['step_s']:8.3f} "
+                  f"{args.batch_size / result['step_s']:10.1f} {result['peak_mb']:9.0f}")
+            if result["peak_mb"] > args.mem_limit_mb:
+                over_limit.add(kind)
+            else:
+                feasible[kind].append(length)
+
+    print(f"Longest length trained within {args.mem_limit_mb:.0f} MB:")
+    for kind, lengths in feasible.items():
+        print(f"  {kind:>9s}: {max(lengths) if lengths else '-'}")
+    gained = sorted(set(feasible["local"] + feasible["local+ds"]) - set(feasible["full"]))
+    print(f"Feasible only with local attention: {', '.join(map(str, gained)) if gained else 'none'}")
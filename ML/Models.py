@@ -0,0 +1,122 @@
+"""
+Notebook models as an importable module, so scripts benchmark and train the same
+networks as the notebooks instead of look-alikes. Transformer.ipynb and
+Transformer_seq_full.ipynb import their model from here.
+
+V1dTransformer: per-segment classifier of Transformer.ipynb. Segments are padded
+with inf, compute_src_key_padding_mask() masks the padded tokens, and forward()
+returns logits [B, C, tokens] (one prediction per token, loss masked per token).
+The defaults are the configuration the notebook trains (input_kern 16, 4 heads,
+2 layers, width 128).
+
+FullV1dTransformer: sequence labeller of Transformer_seq_full.ipynb (stride
+input_kern, SinusoidalPositionalEncoding, full attention), logits [B, tokens, C].
+LocalAttention.py shares its positional encoding and uses it as the baseline.
+
+    from Models import V1dTransformer
+    model = V1dTransformer(input_dim=2, output_dim=n_classes)
+"""
+
+import math
+
+import torch
+from torch import nn
+
+
+class SinusoidalPositionalEncoding(nn.Module):
+    """Sinusoidal positional encoding of Transformer_seq_full.ipynb."""
+    def __init__(self, d_model, max_len=10000):
+        super().__init__()
+        position = torch.arange(0, max_len, dtype=torch.float).unsqueeze(1)
+        div_term = torch.exp(torch.arange(0, d_model, 2).float() * (-math.log(10000.0) / d_model))
+        pe = torch.zeros(max_len, d_model)
+        pe[:, 0::2] = torch.sin(position * div_term)
+        pe[:, 1::2] = torch.cos(position * div_term)
+        self.register_buffer("pe", pe)
+
+    def forward(self, x):
+        return x + self.pe[:x.size(1)].unsqueeze(0)
+
+
+class V1dTransformer(nn.Module):
+    def __init__(self,
+                 input_dim,
+                 output_dim,
+                 input_kern=16,     # Kernel size of the initial Conv1d layer
+                 nhead=4,
+                 num_encoder_layers=2,
+                 dim_feedforward=128,
+                 dropout=0.1):
+        super(V1dTransformer, self).__init__()
+
+        self.input_dim = input_dim
+        self.output_dim = output_dim
+        self.input_kern = input_kern
+        self.stride = input_kern // 2
+
+        self.conv = nn.Conv1d(input_dim, dim_feedforward, kernel_size=self.input_kern, stride=self.stride)
+        self.posencoding = nn.Embedding(10000, dim_feedforward)  # learned positions, up to 10000 tokens
+        self.transformer_encoder = nn.TransformerEncoder(
+            nn.TransformerEncoderLayer(
+                d_model=dim_feedforward,
+                nhead=nhead,
+                dim_feedforward=dim_feedforward * 2,
+                dropout=dropout,
+                batch_first=True
+            ),
+            num_layers=num_encoder_layers
+        )
+        self.fc_out = nn.Linear(dim_feedforward, output_dim)
+
+    def compute_src_key_padding_mask(self, x):
+        """
+        x: [B, C, L_in] padded with inf at the end. Returns [B, L_out] after the conv,
+        True where the token's centre (i * stride) falls in the padding.
+        """
+        B, C, L_in = x.shape
+        real_lengths = (~torch.isinf(x).all(dim=1)).sum(dim=1)
+        L_out = (L_in - self.input_kern) // self.stride + 1
+        center_ixs = torch.arange(L_out, device=x.device) * self.stride
+        return center_ixs[None, :] >= real_lengths[:, None]
+
+    def forward(self, x, src_key_padding_mask=None):
+        if src_key_padding_mask is None:
+            src_key_padding_mask = self.compute_src_key_padding_mask(x)
+        x = x.masked_fill(torch.isinf(x), 0.0)
+        features = self.conv(x).permute(0, 2, 1)    # [B, L, D]
+        positions = torch.arange(features.size(1), device=x.device)
+        features = features + self.posencoding(positions).unsqueeze(0)
+        out = self.transformer_encoder(features, src_key_padding_mask=src_key_padding_mask)
+        return self.fc_out(out).transpose(1, 2)     # [B, C, L]
+
+
+def masked_token_loss(logits, ids, mask, loss_function=None):
+    """Transformer.ipynb's loss: per-token cross entropy against the segment id, padding excluded."""
+    if loss_function is None:
+        loss_function = nn.CrossEntropyLoss(reduction="none")
+    ids = ids.unsqueeze(1).repeat(1, logits.size(-1))
+    per_token = loss_function(logits, ids) * (~mask).float()
+    return per_token.sum() / ((~mask).float().sum() + 1e-9)
+
+
+class FullV1dTransformer(nn.Module):
+    """V1dTransformer from Transformer_seq_full.ipynb (full self-attention over all tokens)."""
+    def __init__(self, input_dim, output_dim, max_length, input_kern=16, nhead=8,
+                 num_encoder_layers=6, dim_feedforward=512, dropout=0.1):
+        super().__init__()
+        self.input_dim = input_dim
+        self.output_dim = output_dim
+        self.input_kern = input_kern
+        self.stride = input_kern
+        self.conv = nn.Conv1d(input_dim, dim_feedforward, kernel_size=input_kern, stride=input_kern)
+        self.pos_encoding = SinusoidalPositionalEncoding(dim_feedforward, max_len=(max_length - input_kern) // input_kern + 1)
+        self.transformer_encoder = nn.TransformerEncoder(
+            nn.TransformerEncoderLayer(d_model=dim_feedforward, nhead=nhead, dim_feedforward=dim_feedforward * 2,
+                                       dropout=dropout, batch_first=True),
+            num_layers=num_encoder_layers)
+        self.fc_out = nn.Linear(dim_feedforward, output_dim)
+
+    def forward(self, x):
+        x = self.conv(x).permute(0, 2, 1)
+        x = self.pos_encoding(x)
+        return self.fc_out(self.transformer_encoder(x))
@@ -0,0 +1,233 @@
+"""
+One-pass normalization statistics for a memmap dataset.
+
+The memmap described by a descriptor JSON (see streamlinedAnalysis.ipynb) is
+scanned once, in row chunks on a thread pool (numpy releases the GIL in the
+reductions). Each chunk produces per-channel partial statistics:
+  - count / mean / M2, merged with Chan's parallel form of Welford's update,
+  - min / max,
+  - a log-bucket quantile sketch (relative accuracy `alpha`, mergeable by adding
+    bucket counts, so the result does not depend on chunking or thread order).
+np.inf padding is ignored. Optionally the band-pass filter of MemmapDataset is
+applied first (--filter), so the statistics match what the normalizer sees.
+
+The result is written back into the descriptor:
+  - audio_mean/std/min/max and adc_mean/std/min/max are replaced by the pooled
+    values (adc = adc1 and adc2 together, as used by the normalizer),
+  - "norm_stats" holds the full per-channel table, including percentiles.
+
+Usage:
+    python NormStats.py -d p2SamPhonemes_filtered_descriptor.json --filter
+    python NormStats.py -d descriptor.json --dry_run
+"""
+
+import argparse
+import json
+import math
+import os
+import time
+from concurrent.futures import ThreadPoolExecutor
+
+import numpy as np
+
+from Filters import BPfilter_batch
+
+CHANNELS = ("audio", "adc1", "adc2")
+PERCENTILES = (0.1, 1, 5, 25, 50, 75, 95, 99, 99.9)
+
+
+class QuantileSketch:
+    """
+    Log-bucket sketch: |x| falls into bucket ceil(log_gamma |x|), gamma = (1+a)/(1-a),
+    so every returned quantile is within a relative error a of a true sample value.
+    Values with |x| < min_value are counted as zero.
+    """
+    def __init__(self, alpha=0.005, min_value=1e-6, max_value=1e9):
+        self.alpha = alpha
+        self.gamma = (1 + alpha) / (1 - alpha)
+        self.log_gamma = math.log(self.gamma)
+        self.offset = int(math.floor(math.log(min_value) / self.log_gamma))
+        n_buckets = int(math.ceil(math.log(max_value) / self.log_gamma)) - self.offset + 1
+        self.min_value = min_value
+        self.positive = np.zeros(n_buckets, dtype=np.int64)
+        self.negative = np.zeros(n_buckets, dtype=np.int64)
+        self.zeros = 0
+
+    def _buckets(self, magnitudes):
+        idx = np.ceil(np.log(magnitudes) / self.log_gamma).astype(np.int64) - self.offset
+        return np.clip(idx, 0, len(self.positive) - 1)
+
+    def add(self, values):
+        values = np.asarray(values, dtype=np.float64)
+        small = np.abs(values) < self.min_value
+        self.zeros += int(small.sum())
+        pos = values[(values > 0) & ~small]
+        neg = -values[(values < 0) & ~small]
+        self.positive += np.bincount(self._buckets(pos), minlength=len(self.positive)) if len(pos) else 0
+        self.negative += np.bincount(self._buckets(neg), minlength=len(self.negative)) if len(neg) else 0
+
+    def merge(self, other):
+        self.positive += other.positive
+        self.negative += other.negative
+        self.zeros += other.zeros
+        return self
+
+    def count(self):
+        return int(self.positive.sum() + self.negative.sum() + self.zeros)
+
+    def _value(self, bucket):
+        # Midpoint (in the relative-error sense) of the bucket (gamma^(i-1), gamma^i].
+        return 2 * self.gamma ** (bucket + self.offset) / (self.gamma + 1)
+
+    def quantile(self, q):
+        """q in [0, 1]."""
+        total = self.count()
+        if total == 0:
+            return float("nan")
+        rank = q * (total - 1)
+        # Ascending order: negatives from large to small magnitude, zeros, positives.
+        neg_cum = np.cumsum(self.negative[::-1])
+        if rank < neg_cum[-1]:
+            i = int(np.searchsorted(neg_cum, rank, side="right"))
+            return -self._value(len(self.negative) - 1 - i)
+        rank -= neg_cum[-1]
+        if rank < self.zeros:
+            return 0.0
+        rank -= self.zeros
+        pos_cum = np.cumsum(self.positive)
+        i = int(np.searchsorted(pos_cum, rank, side="right"))
+        return self._value(min(i, len(self.positive) - 1))
+
+
+class RunningStats:
+    """Count / mean / M2 / min / max and a quantile sketch, mergeable across chunks."""
+    def __init__(self):
+        self.count = 0
+        self.mean = 0.0
+        self.m2 = 0.0
+        self.min = math.inf
+        self.max = -math.inf
+        self.sketch = QuantileSketch()
+
+    def add(self, values):
+        values = np.asarray(values, dtype=np.float64)
+        if len(values) == 0:
+            return
+        other = RunningStats()
+        other.count = len(values)
+        other.mean = float(values.mean())
+        other.m2 = float(((values - other.mean) ** 2).sum())
+        other.min = float(values.min())
+        other.max = float(values.max())
+        other.sketch.add(values)
+        self.merge(other)
+
+    def merge(self, other):
+        if other.count == 0:
+            return self
+        n = self.count + other.count
+        delta = other.mean - self.mean
+        self.mean += delta * other.count / n
+        self.m2 += other.m2 + delta * delta * self.count * other.count / n
+        self.count = n
+        self.min = min(self.min, other.min)
+        self.max = max(self.max, other.max)
+        self.sketch.merge(other.sketch)
+        return self
+
+    def summary(self):
+        var = self.m2 / self.count if self.count else float("nan")
+        return {
+            "count": self.count,
+            "mean": self.mean,
+            "var": var,
+            "std": math.sqrt(var) if self.count else float("nan"),
+            "min": self.min,
+            "max": self.max,
+            "percentiles": {f"p{p:g}": self.sketch.quantile(p / 100) for p in PERCENTILES},
+        }
+
+
+def scan_chunk(memmap, start, stop, filter_params):
+    """Partial statistics of rows [start, stop)."""
+    stats = {ch: RunningStats() for ch in CHANNELS}
+    rows = memmap[start:stop]
+    for ch in CHANNELS:
+        values = np.asarray(rows[ch], dtype=np.float64)
+        if filter_params is not None:
+            fs, low, high = filter_params[ch]
+            values = BPfilter_batch(values, fs, low, high)
+        stats[ch].add(values[np.isfinite(values)])
+    return stats
+
+
+def compute_stats(descriptor, filter=False, workers=None, chunk_rows=256):
+    dtype = np.dtype([tuple(item) for item in descriptor["dtype"]])
+    memmap = np.memmap(descriptor["memmap_filename"], dtype=dtype, mode="r",
+                       shape=(descriptor["n_segments"],))
+    filter_params = None
+    if filter:
+        audio = (descriptor["audio_sampling_rate"], descriptor["audio_lowcut"], descriptor["audio_highcut"])
+        adc = (descriptor["adc_sampling_rate"], descriptor["adc_lowcut"], descriptor["adc_highcut"])
+        filter_params = {"audio": audio, "adc1": adc, "adc2": adc}
+
+    starts = range(0, descriptor["n_segments"], chunk_rows)
+    with ThreadPoolExecutor(max_workers=workers or os.cpu_count()) as pool:
+        partials = list(pool.map(
+            lambda s: scan_chunk(memmap, s, min(s + chunk_rows, descriptor["n_segments"]), filter_params),
+            starts))
+
+    totals = {ch: RunningStats() for ch in CHANNELS}
+    for partial in partials:  # fixed order: results do not depend on scheduling
+        for ch in CHANNELS:
+            totals[ch].merge(partial[ch])
+    totals["adc"] = RunningStats().merge(totals["adc1"]).merge(totals["adc2"])
+    return {ch: st.summary() for ch, st in totals.items()}
+
+
+def update_descriptor(descriptor, stats, filter):
+    descriptor["norm_stats"] = {"filtered": filter, "channels": stats}
+    for prefix, ch in (("audio", "audio"), ("adc", "adc")):
+        descriptor[f"{prefix}_mean"] = stats[ch]["mean"]
+        descriptor[f"{prefix}_std"] = stats[ch]["std"]
+        descriptor[f"{prefix}_min"] = stats[ch]["min"]
+        descriptor[f"{prefix}_max"] = stats[ch]["max"]
+    return descriptor
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Compute normalization statistics and store them in the descriptor.")
+    parser.add_argument("--descriptor", "-d", required=True, help="Descriptor JSON of the memmap dataset.")
+    parser.add_argument("--filter", action="store_true", help="Band-pass the data first (as MemmapDataset(filter=True)).")
+    parser.add_argument("--workers", type=int, default=None, help="Worker threads (default: all cores).")
+    parser.add_argument("--chunk_rows", type=int, default=256, help="Segments per work item.")
+    parser.add_argument("--dry_run", action="store_true", help="Print the statistics without updating the descriptor.")
+    args = parser.parse_args()
+
+    if not os.path.isfile(args.descriptor):
+        print(f"Error: File '{args.descriptor}' does not exist.")
+        raise SystemExit(1)
+    with open(args.descriptor, "r") as f:
+        descriptor = json.load(f)
+
+    start = time.perf_counter()
+    stats = compute_stats(descriptor, filter=args.filter, workers=args.workers, chunk_rows=args.chunk_rows)
+    elapsed = time.perf_counter() - start
+    n_values = sum(stats[ch]["count"] for ch in CHANNELS)
+    print(f"Scanned {descriptor['n_segments']} segments ({n_values} values) in {elapsed:.2f} s")
+    for ch, st in stats.items():
+        pct = ", ".join(f"{k}={v:.4g}" for k, v in st["percentiles"].items())
+        print(f"  {ch:5s} mean={st['mean']:.6g} std={st['std']:.6g} min={st['min']:.6g} max={st['max']:.6g}")
+        print(f"        {pct}")
+
+    if not args.dry_run:
+        for key in ("audio_mean", "audio_std", "adc_mean", "adc_std"):
+            if key in descriptor:
+                print(f"  {key}: {descriptor[key]!r} -> ", end="")
+                print(stats["audio" if key.startswith("audio") else "adc"][key.split("_")[1]])
+        update_descriptor(descriptor, stats, args.filter)
+        tmp = args.descriptor + ".tmp"
+        with open(tmp, "w") as f:
+            json.dump(descriptor, f)
+        os.replace(tmp, args.descriptor)
+        print("Descriptor updated:", args.descriptor)
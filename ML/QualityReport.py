@@ -0,0 +1,317 @@
+"""
+Corpus-wide quality report for the H5 recordings written by live.py.
+
+Every (file, dataset) pair, i.e. one word/PID of one session, is checked in a
+worker process:
+  - clipping:   fraction of ADC samples at the rails (0 / 4095) and of audio
+                samples at positive full scale. live.py folds the raw samples
+                before storing them; the audio metrics undo it (unfold_audio),
+  - SNR:        10*log10 of the loud (p95) over the quiet (p10) frame energy, per
+                stream. Speech and silence alternate in a recording, so this
+                estimates speech-to-background,
+  - flatness:   std and fraction of repeated values per stream. A dead ADC
+                channel or a mic on the wrong I2S slot (zeros / constant) shows up
+                here,
+  - timestamp gaps: device timestamps (data_ts) of consecutive audio packets
+                compared with the packet duration. Reports gaps > 1.5 packets and
+                the total lost time,
+  - packet sizes: audio packets or ADC channel counts that differ from the
+                modal size,
+  - duration mismatch between the audio and ADC streams.
+Records are grouped by their "channels" string, so the ADC data is unpacked with
+one reshape per group instead of the per-record parsing of DataLoader.
+
+Outputs:
+  - a CSV with one row per (file, dataset), sorted by --sort,
+  - a JSON exclude list of the pairs that fail a threshold, with the reasons.
+    Dataset builds skip them with:
+        exclude = load_exclude("exclude.json")
+        if (os.path.basename(h5_path), dataset_name) in exclude: continue
+
+Usage:
+    python QualityReport.py -i recordings/*.h5 --out quality.csv --exclude exclude.json
+    python QualityReport.py -i session.h5 --sort snr_audio_db --ascending --top 20
+"""
+
+import argparse
+import csv
+import json
+import os
+import time
+from concurrent.futures import ProcessPoolExecutor
+
+import h5py
+import numpy as np
+
+AUDIO_RATE = 48000
+ADC_RATE = 4000          # per channel (8 kHz ADC clock over two channels)
+ADC_MAX_CODE = 4095
+AUDIO_MAX = 32767        # full scale of the raw int16 samples, after unfold_audio()
+FRAME_DURATION = 0.02    # seconds per energy frame for the SNR estimate
+
+# A pair is excluded when any of these is exceeded (or, for the minimums, not reached).
+THRESHOLDS = {
+    "max_clip_ratio": 0.001,
+    "min_snr_db": 6.0,
+    "min_std": 1.0,
+    "max_repeat_ratio": 0.5,
+    "max_lost_ms": 500.0,
+    "max_packet_anomaly_ratio": 0.01,
+    "max_duration_mismatch": 0.02,
+}
+
+
+def parse_channels(channels):
+    if isinstance(channels, bytes):
+        channels = channels.decode("utf-8")
+    result = []
+    for part in channels.split(","):
+        part = part.strip()
+        if part:
+            ch, count = part.split(":")
+            result.append((int(ch.replace("ch", "")), int(count)))
+    return result
+
+
+def load_streams(records):
+    """
+    Audio samples, ADC samples per channel, audio packet sizes / timestamps and
+    ADC packet layouts of one dataset.
+    """
+    source = records["source"]
+    audio_idx = np.flatnonzero(source == 0)
+    adc_idx = np.flatnonzero(source == 1)
+    data = records["data"]
+
+    audio_sizes = np.array([len(data[i]) for i in audio_idx], dtype=np.int64)
+    audio = np.concatenate([data[i] for i in audio_idx]) if len(audio_idx) else np.zeros(0, dtype=np.int16)
+
+    adc_parts = {}
+    layouts = []
+    channel_strings = records["channels"][adc_idx]
+    for text in set(channel_strings):
+        layout = parse_channels(text)
+        rows = adc_idx[channel_strings == text]
+        layouts.append((layout, len(rows)))
+        counts = [count for _, count in layout]
+        if len(set(counts)) == 1:
+            # Same count on every channel: one reshape for the whole group.
+            block = np.stack([data[i] for i in rows]).reshape(len(rows), len(layout), counts[0])
+            for k, (ch, _) in enumerate(layout):
+                adc_parts.setdefault(ch, []).append((rows, block[:, k, :]))
+        else:
+            offsets = np.cumsum([0] + counts)
+            for k, (ch, count) in enumerate(layout):
+                part = np.stack([data[i][offsets[k]:offsets[k + 1]] for i in rows])
+                adc_parts.setdefault(ch, []).append((rows, part))
+    adc = {}
+    for ch, parts in adc_parts.items():
+        if len(parts) == 1:
+            adc[ch] = parts[0][1].ravel()
+        else:
+            # Several layouts for this channel: restore the record order.
+            pieces = sorted((int(i), block[j]) for rows, block in parts for j, i in enumerate(rows))
+            adc[ch] = np.concatenate([piece for _, piece in pieces])
+    timestamps = records["data_ts"][audio_idx].astype(np.float64)
+    return audio, adc, audio_sizes, timestamps, layouts
+
+
+def unfold_audio(audio):
+    """
+    Raw int16 samples from the stored audio. live.py stores a raw sample u (read as
+    uint16) as u - 32768 if u >= 16384, else u. Stored 16384..32767 are raw -16384..-1
+    and stored -16384..-1 are raw 16384..32767, so raw positive full scale is stored
+    as -1. Raw -32768..-16385 land on 0..16383 like small positive samples and
+    cannot be told apart: they are kept as is, and the negative rail goes undetected.
+    """
+    x = np.asarray(audio).astype(np.int32)
+    return np.where(x >= 16384, x - 32768, np.where(x < 0, x + 32768, x))
+
+
+def snr_db(x, rate):
+    frame = max(1, int(FRAME_DURATION * rate))
+    n = len(x) // frame
+    if n < 10:
+        return float("nan")
+    frames = x[:n * frame].astype(np.float64).reshape(n, frame)
+    energy = frames.var(axis=1) + 1e-12
+    return float(10 * np.log10(np.percentile(energy, 95) / np.percentile(energy, 10)))
+
+
+def repeat_ratio(x):
+    return float(np.mean(np.diff(x) == 0)) if len(x) > 1 else float("nan")
+
+
+def analyse(task):
+    """Quality metrics of one (file, dataset) pair."""
+    filename, dataset = task
+    start = time.perf_counter()
+    with h5py.File(filename, "r") as f:
+        records = f[dataset][:]
+    row = analyse_streams(filename, dataset, len(records), *load_streams(records))
+    row["seconds"] = time.perf_counter() - start
+    return row
+
+
+def analyse_streams(filename, dataset, n_records, audio, adc, audio_sizes, timestamps, layouts):
+    row = {"file": os.path.basename(filename), "path": filename, "dataset": dataset,
+           "records": n_records, "audio_s": len(audio) / AUDIO_RATE}
+    adc_len = max((len(v) for v in adc.values()), default=0)
+    row["adc_s"] = adc_len / ADC_RATE
+    longest = max(row["audio_s"], row["adc_s"])
+    row["duration_mismatch"] = abs(row["audio_s"] - row["adc_s"]) / longest if longest else float("nan")
+
+    audio = unfold_audio(audio)
+    row["clip_audio"] = float(np.mean(np.abs(audio) >= AUDIO_MAX)) if len(audio) else float("nan")
+    row["snr_audio_db"] = snr_db(audio, AUDIO_RATE)
+    row["std_audio"] = float(audio.std()) if len(audio) else float("nan")
+    row["repeat_audio"] = repeat_ratio(audio)
+    for ch in sorted(adc):
+        x = adc[ch]
+        row[f"clip_adc{ch}"] = float(np.mean((x >= ADC_MAX_CODE) | (x <= 0))) if len(x) else float("nan")
+        row[f"snr_adc{ch}_db"] = snr_db(x, ADC_RATE)
+        row[f"std_adc{ch}"] = float(x.std()) if len(x) else float("nan")
+        row[f"repeat_adc{ch}"] = repeat_ratio(x)
+
+    clips = [v for k, v in row.items() if k.startswith("clip_") and np.isfinite(v)]
+    row["clip_max"] = max(clips) if clips else float("nan")
+
+    # Packet sizes: audio packets and ADC layouts that differ from the most common one.
+    anomalies = total = 0
+    if len(audio_sizes):
+        _, counts = np.unique(audio_sizes, return_counts=True)
+        anomalies += len(audio_sizes) - int(counts.max())
+        total += len(audio_sizes)
+    if layouts:
+        modal = max(n for _, n in layouts)
+        anomalies += sum(n for _, n in layouts) - modal
+        total += sum(n for _, n in layouts)
+    row["packet_anomaly_ratio"] = anomalies / total if total else float("nan")
+
+    # Timestamp gaps (device clock, microseconds). Recordings without device
+    # timestamps (all zero) are skipped.
+    if len(timestamps) > 1 and np.any(timestamps != timestamps[0]):
+        expected = np.median(audio_sizes) / AUDIO_RATE * 1e6
+        deltas = np.diff(timestamps)
+        gaps = deltas > 1.5 * expected
+        row["ts_gaps"] = int(gaps.sum())
+        row["ts_max_gap_ms"] = float(deltas.max() / 1000)
+        row["ts_lost_ms"] = float((deltas[gaps] - expected).sum() / 1000)
+        row["ts_backwards"] = int((deltas < 0).sum())
+    else:
+        row.update(ts_gaps=0, ts_max_gap_ms=float("nan"), ts_lost_ms=float("nan"), ts_backwards=0)
+
+    row["reasons"] = ";".join(check(row))
+    return row
+
+
+def check(row, thresholds=THRESHOLDS):
+    reasons = []
+    above = lambda value, limit: np.isfinite(value) and value > limit
+    below = lambda value, limit: np.isfinite(value) and value < limit
+    for key, value in row.items():
+        if key.startswith("clip_") and key != "clip_max" and above(value, thresholds["max_clip_ratio"]):
+            reasons.append(f"{key}={value:.4f}")
+        elif key.startswith("snr_") and below(value, thresholds["min_snr_db"]):
+            reasons.append(f"{key}={value:.1f}")
+        elif key.startswith("std_") and below(value, thresholds["min_std"]):
+            reasons.append(f"flat_{key[4:]}")
+        elif key.startswith("repeat_") and above(value, thresholds["max_repeat_ratio"]):
+            reasons.append(f"{key}={value:.2f}")
+    if row["audio_s"] == 0:
+        reasons.append("no_audio")
+    if row["adc_s"] == 0:
+        reasons.append("no_adc")
+    if above(row["ts_lost_ms"], thresholds["max_lost_ms"]) or row["ts_backwards"]:
+        reasons.append(f"ts_lost_ms={row['ts_lost_ms']:.0f},backwards={row['ts_backwards']}")
+    if above(row["packet_anomaly_ratio"], thresholds["max_packet_anomaly_ratio"]):
+        reasons.append(f"packet_anomaly_ratio={row['packet_anomaly_ratio']:.3f}")
+    if above(row["duration_mismatch"], thresholds["max_duration_mismatch"]):
+        reasons.append(f"duration_mismatch={row['duration_mismatch']:.3f}")
+    return reasons
+
+
+def list_tasks(filenames):
+    tasks = []
+    for filename in filenames:
+        with h5py.File(filename, "r") as f:
+            tasks.extend((filename, name) for name in f.keys())
+    return tasks
+
+
+def scan(filenames, workers=None):
+    tasks = list_tasks(filenames)
+    # Largest datasets first so one long recording does not finish last on its own.
+    sizes = {}
+    for filename in filenames:
+        with h5py.File(filename, "r") as f:
+            sizes.update({(filename, name): f[name].id.get_storage_size() for name in f.keys()})
+    tasks.sort(key=lambda t: -sizes[t])
+    with ProcessPoolExecutor(max_workers=workers or os.cpu_count()) as pool:
+        return list(pool.map(analyse, tasks))
+
+
+def load_exclude(filename):
+    """Set of (file basename, dataset) pairs listed in an exclude file."""
+    with open(filename, "r") as f:
+        return {(item["file"], item["dataset"]) for item in json.load(f)["exclude"]}
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Scan H5 recordings and report per-session / per-word quality.")
+    parser.add_argument("--input_files", "-i", nargs="+", required=True, help="H5 recordings written by live.py.")
+    parser.add_argument("--out", "-o", default="quality.csv", help="Report CSV.")
+    parser.add_argument("--exclude", default="exclude.json", help="Exclude list for dataset builds.")
+    parser.add_argument("--sort", default="reasons", help="Report column to sort by.")
+    parser.add_argument("--ascending", action="store_true")
+    parser.add_argument("--top", type=int, default=20, help="Rows printed to the console.")
+    parser.add_argument("--workers", type=int, default=None, help="Worker processes (default: all cores).")
+    args = parser.parse_args()
+
+    for filename in args.input_files:
+        if not os.path.isfile(filename):
+            print(f"Error: File '{filename}' does not exist.")
+            raise SystemExit(1)
+
+    start = time.perf_counter()
+    rows = scan(args.input_files, args.workers)
+    elapsed = time.perf_counter() - start
+    if not rows:
+        print("No datasets found.")
+        raise SystemExit(0)
+    if args.sort not in rows[0]:
+        print(f"Error: unknown column '{args.sort}'. Columns: {', '.join(rows[0])}")
+        raise SystemExit(1)
+
+    def sort_value(row):
+        value = row[args.sort]
+        if args.sort == "reasons":
+            return len(value.split(";")) if value else 0
+        return value
+
+    # Rows without a value (NaN) go last in both directions.
+    missing = [r for r in rows if isinstance(sort_value(r), float) and not np.isfinite(sort_value(r))]
+    missing_ids = {id(r) for r in missing}
+    rows = sorted((r for r in rows if id(r) not in missing_ids), key=sort_value, reverse=not args.ascending) + missing
+
+    columns = []
+    for row in rows:
+        columns.extend(k for k in row if k not in columns)
+    with open(args.out, "w", newline="") as f:
+        writer = csv.DictWriter(f, fieldnames=columns)
+        writer.writeheader()
+        writer.writerows(rows)
+
+    excluded = [{"file": r["file"], "path": r["path"], "dataset": r["dataset"], "reasons": r["reasons"].split(";")}
+                for r in rows if r["reasons"]]
+    with open(args.exclude, "w") as f:
+        json.dump({"thresholds": THRESHOLDS, "exclude": excluded}, f, indent=2)
+
+    audio_hours = sum(r["audio_s"] for r in rows) / 3600
+    print(f"Scanned {len(rows)} datasets in {len(args.input_files)} files ({audio_hours:.2f} h of audio) "
+          f"in {elapsed:.2f} s")
+    print(f"{'file':20s} {'dataset':16s} {'audio_s':>8s} {'snr_db':>7s} {'clip':>7s} {'lost_ms':>8s} reasons")
+    for r in rows[:args.top]:
+        print(f"{r['file'][:20]:20s} {r['dataset'][:16]:16s} {r['audio_s']:8.1f} {r['snr_audio_db']:7.1f} "
+              f"{r['clip_max']:7.4f} {r['ts_lost_ms']:8.0f} {r['reasons']}")
+    print(f"Report saved to {args.out}, {len(excluded)} datasets listed in {args.exclude}")
@@ -0,0 +1,221 @@
+"""
+Parquet table of word segments: metadata, quality and features.
+
+The analysis notebooks rebuild segment lists (adc1segmentsX, ...) and feature
+arrays after every kernel restart. export_segments() computes them once, in a
+process pool over the (file, dataset) pairs of the H5 recordings:
+  - metadata: segment key, file, dataset, participant, word, audio / ADC sample
+    offsets and duration,
+  - quality: per-segment audio RMS / peak and ADC clipping ratio, plus the
+    session-level SNR and exclusion reasons of QualityReport. Audio RMS / peak
+    are taken on the raw samples (unfold_audio), like QualityReport's session
+    metrics, so a positive full-scale sample shows as a peak of 32767; the
+    segmentation still runs on the stored samples,
+  - features: the ADC log band-energy mean/std of SegmentTuner.segment_features,
+    one float32 column per value (adc1_band03_mean, ...), so a query can read
+    only the bands it needs.
+Rows are sorted by word and participant and written in row groups. Parquet keeps
+per-row-group min/max statistics, so a filter on word / participant / duration
+skips whole row groups (predicate pushdown), and unread columns are never
+decoded (column pruning). The segmentation and feature settings are stored in
+the schema metadata.
+
+    table = load_segments("segments.parquet", columns=["word", "duration_s"],
+                          filters=[("word", "in", ["Europe", "Asia"]), ("session_excluded", "==", False)])
+    X, names = feature_matrix(load_segments("segments.parquet", filters=[("duration_s", ">", 0.3)]))
+
+Usage:
+    python SegmentTable.py -i recordings/*.h5 --out segments.parquet
+    python SegmentTable.py --query segments.parquet --columns word duration_s --where "word == Europe"
+"""
+
+import argparse
+import json
+import os
+import re
+import time
+from concurrent.futures import ProcessPoolExecutor
+
+import h5py
+import numpy as np
+import pyarrow as pa
+import pyarrow.parquet as pq
+
+from EmbeddingService import DEFAULT_SEGMENTATION, DEFAULT_FEATURES
+from QualityReport import ADC_MAX_CODE, AUDIO_RATE, analyse_streams, list_tasks, load_streams, unfold_audio
+from SegmentTuner import EnergyCache, segment_energy, segment_features, ADC_CHANNELS, ADC_DECIMATION
+
+# participant / word from "<file>/<dataset>". Default: one participant per file.
+DEFAULT_NAME_PATTERN = r"(?P<participant>[^/]+?)(\.h5|\.hdf5)?/(?P<word>.+)"
+META_KEY = b"murmurations"
+
+
+def feature_names(n_values, channels=ADC_CHANNELS):
+    n_bands = n_values // (2 * len(channels))
+    names = []
+    for ch in channels:
+        names += [f"adc{ch}_band{b:02d}_mean" for b in range(n_bands)]
+        names += [f"adc{ch}_band{b:02d}_std" for b in range(n_bands)]
+    return names
+
+
+def segment_rows(task, segmentation=DEFAULT_SEGMENTATION, feature_params=DEFAULT_FEATURES,
+                 name_pattern=DEFAULT_NAME_PATTERN):
+    """Columns (dict of lists) of all segments of one (file, dataset) pair."""
+    filename, dataset = task
+    with h5py.File(filename, "r") as f:
+        records = f[dataset][:]
+    streams = load_streams(records)
+    quality = analyse_streams(filename, dataset, len(records), *streams)
+    audio, adc = streams[0], streams[1]
+    raw_audio = unfold_audio(audio)     # quality columns, same convention as analyse_streams
+
+    match = re.fullmatch(name_pattern, f"{os.path.basename(filename)}/{dataset}")
+    participant = match.group("participant") if match else os.path.basename(filename)
+    word = match.group("word") if match else dataset
+
+    cols = {key: [] for key in ("segment_key", "audio_start", "audio_end", "adc_start", "adc_end",
+                                "duration_s", "rms_audio", "peak_audio", "clip_adc")}
+    features = []
+    adc = {ch: np.asarray(adc.get(ch, np.array([])), dtype=np.float64) for ch in ADC_CHANNELS}
+    for start, end in segment_energy(EnergyCache(audio), **segmentation):
+        a0, a1 = start // ADC_DECIMATION, end // ADC_DECIMATION
+        blocks = [adc[ch][a0:a1] for ch in ADC_CHANNELS]
+        segment = raw_audio[start:end].astype(np.float64)
+        adc_values = np.concatenate(blocks)
+        cols["segment_key"].append(f"{os.path.basename(filename)}/{dataset}/{start}:{end}")
+        cols["audio_start"].append(start)
+        cols["audio_end"].append(end)
+        cols["adc_start"].append(a0)
+        cols["adc_end"].append(a1)
+        cols["duration_s"].append((end - start) / AUDIO_RATE)
+        cols["rms_audio"].append(float(np.sqrt(np.mean(segment ** 2))) if len(segment) else 0.0)
+        cols["peak_audio"].append(float(np.abs(segment).max()) if len(segment) else 0.0)
+        cols["clip_adc"].append(float(np.mean((adc_values >= ADC_MAX_CODE) | (adc_values <= 0)))
+                                if len(adc_values) else 0.0)
+        features.append(segment_features(blocks, **feature_params))
+
+    n = len(cols["segment_key"])
+    cols.update(file=[os.path.basename(filename)] * n, dataset=[dataset] * n, participant=[participant] * n,
+                word=[word] * n, session_snr_db=[quality["snr_audio_db"]] * n,
+                session_excluded=[bool(quality["reasons"])] * n, session_reasons=[quality["reasons"]] * n)
+    return cols, np.asarray(features, dtype=np.float32) if n else np.zeros((0, 0), dtype=np.float32)
+
+
+def _segment_rows(args):
+    return segment_rows(*args)
+
+
+def export_segments(filenames, out, segmentation=DEFAULT_SEGMENTATION, feature_params=DEFAULT_FEATURES,
+                    name_pattern=DEFAULT_NAME_PATTERN, workers=None, row_group_size=2048):
+    tasks = list_tasks(filenames)
+    with ProcessPoolExecutor(max_workers=workers or os.cpu_count()) as pool:
+        parts = list(pool.map(_segment_rows, [(t, segmentation, feature_params, name_pattern) for t in tasks]))
+
+    meta_columns = ["segment_key", "file", "dataset", "participant", "word", "audio_start", "audio_end",
+                    "adc_start", "adc_end", "duration_s", "rms_audio", "peak_audio", "clip_adc",
+                    "session_snr_db", "session_excluded", "session_reasons"]
+    cols = {key: [v for part, _ in parts for v in part[key]] for key in meta_columns}
+    features = np.concatenate([f for _, f in parts if len(f)]) if any(len(f) for _, f in parts) \
+        else np.zeros((0, 0), dtype=np.float32)
+    names = feature_names(features.shape[1])
+
+    # Sorted by word, then participant: row-group statistics become selective for both.
+    order = sorted(range(len(cols["word"])), key=lambda i: (cols["word"][i], cols["participant"][i],
+                                                            cols["segment_key"][i]))
+    arrays = {}
+    for key in meta_columns:
+        values = [cols[key][i] for i in order]
+        if key in ("word", "participant", "file", "dataset"):
+            arrays[key] = pa.array(values, pa.string()).dictionary_encode()
+        elif key in ("audio_start", "audio_end", "adc_start", "adc_end"):
+            arrays[key] = pa.array(values, pa.int64())
+        elif key in ("duration_s", "rms_audio", "peak_audio", "clip_adc", "session_snr_db"):
+            arrays[key] = pa.array(values, pa.float32())
+        else:
+            arrays[key] = pa.array(values)
+    for k, name in enumerate(names):
+        arrays[name] = pa.array(features[order, k])
+
+    table = pa.table(arrays)
+    meta = {"segmentation": segmentation, "features": feature_params, "feature_columns": names,
+            "sources": [os.path.abspath(f) for f in filenames]}
+    table = table.replace_schema_metadata({META_KEY: json.dumps(meta).encode()})
+    pq.write_table(table, out, row_group_size=row_group_size, compression="zstd", write_statistics=True)
+    return table
+
+
+def table_metadata(path):
+    return json.loads(pq.read_schema(path).metadata[META_KEY])
+
+
+def load_segments(path, columns=None, filters=None):
+    """Read only `columns` and the row groups / rows matching `filters` (pyarrow DNF filters)."""
+    return pq.read_table(path, columns=columns, filters=filters)
+
+
+def feature_matrix(table, prefix=None):
+    """(X, column names) of the feature columns in `table`, optionally only those starting with prefix."""
+    names = [n for n in table.column_names if re.fullmatch(r"adc\d+_band\d+_(mean|std)", n)
+             and (prefix is None or n.startswith(prefix))]
+    if not names:
+        return np.zeros((table.num_rows, 0), dtype=np.float32), names
+    return np.column_stack([table.column(n).to_numpy() for n in names]), names
+
+
+def parse_where(text):
+    """'column op value' -> pyarrow filter tuple. Values are parsed as JSON when possible."""
+    match = re.fullmatch(r"\s*(\w+)\s*(==|!=|<=|>=|<|>|in|not in)\s*(.+?)\s*", text)
+    if not match:
+        raise ValueError(f"Cannot parse filter '{text}'")
+    column, op, value = match.groups()
+    if op in ("in", "not in"):
+        value = [v.strip() for v in value.strip("[]").split(",")]
+        value = [json.loads(v) if re.fullmatch(r"-?[\d.]+|true|false", v) else v.strip("\"'") for v in value]
+    else:
+        value = json.loads(value) if re.fullmatch(r"-?[\d.]+(e-?\d+)?|true|false", value) else value.strip("\"'")
+    return (column, op, value)
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Export word segments to Parquet / query the table.")
+    parser.add_argument("--input_files", "-i", nargs="+", default=None, help="H5 recordings to export.")
+    parser.add_argument("--out", "-o", default="segments.parquet", help="Parquet file to write.")
+    parser.add_argument("--name_pattern", default=DEFAULT_NAME_PATTERN,
+                        help="Regex on '<file>/<dataset>' with groups 'participant' and 'word'.")
+    parser.add_argument("--workers", type=int, default=None, help="Worker processes (default: all cores).")
+    parser.add_argument("--query", default=None, help="Parquet file to query instead of exporting.")
+    parser.add_argument("--columns", nargs="+", default=None, help="Columns to read (default: all).")
+    parser.add_argument("--where", nargs="+", default=None, help="Filters, e.g. 'word == Europe' 'duration_s > 0.3'.")
+    args = parser.parse_args()
+
+    if args.query is None:
+        if not args.input_files:
+            parser.error("--input_files is required to export")
+        for filename in args.input_files:
+            if not os.path.isfile(filename):
+                print(f"Error: File '{filename}' does not exist.")
+                raise SystemExit(1)
+        start = time.perf_counter()
+        table = export_segments(args.input_files, args.out, name_pattern=args.name_pattern, workers=args.workers)
+        words = len(set(table.column("word").to_pylist()))
+        print(f"Exported {table.num_rows} segments ({words} words, {table.num_columns} columns) to {args.out} "
+              f"in {time.perf_counter() - start:.2f} s ({os.path.getsize(args.out) / 1e6:.2f} MB)")
+        raise SystemExit(0)
+
+    if not os.path.isfile(args.query):
+        print(f"Error: File '{args.query}' does not exist.")
+        raise SystemExit(1)
+    filters = [parse_where(w) for w in args.where] if args.where else None
+    start = time.perf_counter()
+    full = pq.read_table(args.query)
+    full_ms = 1000 * (time.perf_counter() - start)
+    start = time.perf_counter()
+    table = load_segments(args.query, columns=args.columns, filters=filters)
+    query_ms = 1000 * (time.perf_counter() - start)
+    metadata = pq.ParquetFile(args.query).metadata
+    print(f"Full read   : {full.num_rows} rows x {full.num_columns} columns in {full_ms:.1f} ms")
+    print(f"Query       : {table.num_rows} rows x {table.num_columns} columns in {query_ms:.1f} ms "
+          f"({metadata.num_row_groups} row groups in the file)")
+    for row in table.slice(0, 10).to_pylist():
+        print("  ", row)
@@ -0,0 +1,288 @@
+"""
+Parallel, cached grid search over the short-time-energy segmentation parameters
+(short_time_energy_segmentation in nicoAnalysis.ipynb).
+
+Each dataset of the H5 recording is one word, so a parameter set is scored by
+segmenting every dataset, extracting ADC features of the segments, clustering
+them with KMeans (k = number of words) and comparing the clusters with the
+dataset labels (ARI / NMI), as in the notebook's evaluate_parameters.
+
+Re-running everything per combination is what makes the notebook sweep slow.
+Here the stages are cached and shared:
+  - squared-sample prefix sums are computed once per recording, so the frame
+    energies for any (frame, hop) are a single vectorized difference,
+  - energies are cached per (frame, hop), smoothed contours per smoothing window,
+    and quantile thresholds / run merging reuse them,
+  - features are cached per segment boundary, so combinations that produce the
+    same segments do not pay for feature extraction again,
+  - combinations are grouped by (frame, hop) and evaluated in parallel worker
+    processes,
+  - successive halving: every combination is first scored on a short prefix of
+    each recording, and only the best 1/eta survive to the next rung, which gets
+    eta times more audio, until the survivors see everything.
+
+segment_energy() returns exactly the same segments as the notebook function.
+
+Usage:
+    python SegmentTuner.py -i recordings.h5 --datasets Europe NOISE2 ...
+    python SegmentTuner.py -i recordings.h5 --quantile 0.1 0.15 0.2 0.3 --eta 3 --out tuning.csv
+"""
+
+import argparse
+import csv
+import itertools
+import multiprocessing as mp
+import os
+import time
+from concurrent.futures import ProcessPoolExecutor
+
+import numpy as np
+from sklearn.cluster import KMeans
+from sklearn.metrics import adjusted_rand_score, normalized_mutual_info_score
+from sklearn.preprocessing import StandardScaler
+
+from DataLoader import H5DataLoader
+
+AUDIO_SAMPLE_RATE = 48000
+ADC_DECIMATION = 12         # audio samples per ADC sample (per channel), as in streamlinedAnalysis
+ADC_CHANNELS = (1, 3)
+
+PARAM_NAMES = ("frame_duration", "hop_duration", "smoothing_window", "energy_quantile",
+               "min_silence_frames", "min_voiced_frames")
+
+
+# --- Segmentation (vectorized, same results as the notebook) ---
+
+class EnergyCache:
+    """Per-recording cache of prefix sums, frame energies and smoothed contours."""
+    def __init__(self, audio, sr=AUDIO_SAMPLE_RATE):
+        audio = np.asarray(audio, dtype=np.float64).flatten()
+        self.sr = sr
+        self.n_samples = len(audio)
+        self.cumsum = np.concatenate(([0.0], np.cumsum(audio ** 2)))
+        self.energies = {}
+        self.smoothed = {}
+
+    def frame_energies(self, frame_duration, hop_duration, n_samples=None):
+        n_samples = self.n_samples if n_samples is None else n_samples
+        key = (frame_duration, hop_duration, n_samples)
+        if key not in self.energies:
+            frame_size = int(frame_duration * self.sr)
+            hop_size = int(hop_duration * self.sr)
+            n_frames = (n_samples - frame_size) // hop_size + 1 if n_samples >= frame_size else 0
+            starts = np.arange(n_frames) * hop_size
+            energies = (self.cumsum[starts + frame_size] - self.cumsum[starts]) / frame_size
+            frame_times = (starts + frame_size / 2.0) / self.sr
+            self.energies[key] = (energies, frame_times)
+        return self.energies[key]
+
+    def smoothed_energies(self, frame_duration, hop_duration, smoothing_window, n_samples=None):
+        n_samples = self.n_samples if n_samples is None else n_samples
+        key = (frame_duration, hop_duration, smoothing_window, n_samples)
+        if key not in self.smoothed:
+            energies, frame_times = self.frame_energies(frame_duration, hop_duration, n_samples)
+            kernel = np.ones(smoothing_window) / smoothing_window
+            self.smoothed[key] = (np.convolve(energies, kernel, mode='same'), frame_times)
+        return self.smoothed[key]
+
+
+def merge_runs(labels, min_count, target_value):
+    """Flip runs of target_value shorter than min_count (runs taken on the input labels)."""
+    if len(labels) == 0:
+        return labels
+    change = np.flatnonzero(labels[1:] != labels[:-1]) + 1
+    starts = np.concatenate(([0], change))
+    ends = np.concatenate((change, [len(labels)]))
+    flip = (labels[starts] == target_value) & (ends - starts < min_count)
+    merged = labels.copy()
+    for s, e in zip(starts[flip], ends[flip]):
+        merged[s:e] = not target_value
+    return merged
+
+
+def segment_energy(cache, frame_duration=0.02, hop_duration=0.01, smoothing_window=5, energy_quantile=0.2,
+                   min_silence_frames=3, min_voiced_frames=3, n_samples=None):
+    """short_time_energy_segmentation on a cached recording (optionally only its first n_samples)."""
+    n_samples = cache.n_samples if n_samples is None else n_samples
+    sr = cache.sr
+    ste_smoothed, frame_times = cache.smoothed_energies(frame_duration, hop_duration, smoothing_window, n_samples)
+    if len(ste_smoothed) == 0:
+        return []
+    threshold_value = np.quantile(ste_smoothed, energy_quantile) * 2.0
+    voiced = ste_smoothed >= threshold_value
+    voiced = merge_runs(voiced, min_voiced_frames, True)
+    voiced = merge_runs(voiced, min_silence_frames, False)
+
+    padded = np.concatenate(([False], voiced, [False]))
+    edges = np.flatnonzero(padded[1:] != padded[:-1])
+    seg_start, seg_end = edges[0::2], edges[1::2] - 1
+    start_times = frame_times[seg_start] - (frame_duration / 2)
+    end_times = frame_times[seg_end] + (frame_duration / 2)
+    sample_start = (np.maximum(start_times, 0) * sr).astype(int)
+    sample_end = (np.minimum(end_times, n_samples / sr) * sr).astype(int)
+    return list(zip(sample_start.tolist(), sample_end.tolist()))
+
+
+# --- Features ---
+
+def segment_features(adc_blocks, n_fft=256, hop=128, n_bands=16):
+    """
+    Log band-energy statistics of the ADC channels of one segment: for each channel,
+    the mean and std over frames of the log power in n_bands log-spaced bands
+    (a numpy stand-in for the notebooks' mel mean/std features).
+    """
+    edges = np.unique(np.geomspace(1, n_fft // 2 + 1, n_bands + 1).astype(int))
+    window = np.hanning(n_fft)
+    features = []
+    for block in adc_blocks:
+        block = np.asarray(block, dtype=np.float64)
+        block = block - block.mean() if len(block) else block
+        if len(block) < n_fft:
+            block = np.pad(block, (0, n_fft - len(block)))
+        n_frames = (len(block) - n_fft) // hop + 1
+        frames = np.lib.stride_tricks.sliding_window_view(block, n_fft)[::hop][:n_frames] * window
+        power = np.abs(np.fft.rfft(frames, axis=1)) ** 2
+        bands = np.add.reduceat(power, edges[:-1], axis=1)
+        log_bands = np.log10(bands + 1e-10)
+        features.append(log_bands.mean(axis=0))
+        features.append(log_bands.std(axis=0))
+    return np.concatenate(features)
+
+
+# --- Evaluation (runs in the worker processes) ---
+
+_recordings = None          # name -> (EnergyCache, {channel: adc array})
+_feature_cache = {}
+
+
+def _init_worker(recordings):
+    global _recordings
+    _recordings = recordings
+
+
+def evaluate(params, fraction=1.0, seed=42):
+    """Score one parameter set on the first `fraction` of every recording."""
+    X, y = [], []
+    for label, (name, (cache, adc)) in enumerate(sorted(_recordings.items())):
+        n_samples = int(cache.n_samples * fraction)
+        for start, end in segment_energy(cache, **params, n_samples=n_samples):
+            key = (name, start, end)
+            feats = _feature_cache.get(key)
+            if feats is None:
+                blocks = [adc[ch][start // ADC_DECIMATION:end // ADC_DECIMATION] for ch in ADC_CHANNELS]
+                feats = _feature_cache[key] = segment_features(blocks)
+            X.append(feats)
+            y.append(label)
+    n_classes = len(_recordings)
+    result = dict(params, fraction=fraction, n_segments=len(y), ARI=-1.0, NMI=0.0)
+    if len(y) < 2 * n_classes:
+        return result  # not enough segments to cluster
+    X = StandardScaler().fit_transform(np.array(X))
+    clusters = KMeans(n_clusters=n_classes, random_state=seed, n_init=4).fit_predict(X)
+    result["ARI"] = adjusted_rand_score(y, clusters)
+    result["NMI"] = normalized_mutual_info_score(y, clusters)
+    return result
+
+
+def _evaluate_group(group, fraction):
+    # One (frame, hop) group per task keeps the energy caches hot in that worker.
+    return [evaluate(params, fraction) for params in group]
+
+
+# --- Search ---
+
+def successive_halving(grid, recordings, eta=3, min_fraction=0.1, workers=None, verbose=True):
+    """
+    Evaluate every combination on a short prefix, keep the best 1/eta, and repeat
+    with eta times more audio until the survivors are scored on full recordings.
+    The first rung uses at least min_fraction of the audio: on too short a prefix
+    there are not enough segments to cluster and the ranking would be noise.
+    Returns all results (every rung), best last-rung result first.
+    """
+    n_rungs = max(1, int(np.ceil(np.log(len(grid)) / np.log(eta))))
+    fraction = max(float(eta) ** -(n_rungs - 1), min_fraction)
+    candidates = list(grid)
+    all_results = []
+    ctx = mp.get_context("fork") if "fork" in mp.get_all_start_methods() else None
+    with ProcessPoolExecutor(max_workers=workers or os.cpu_count(), mp_context=ctx,
+                             initializer=_init_worker, initargs=(recordings,)) as pool:
+        while True:
+            start = time.perf_counter()
+            groups = {}
+            for params in candidates:
+                groups.setdefault((params["frame_duration"], params["hop_duration"]), []).append(params)
+            futures = [pool.submit(_evaluate_group, g, fraction) for g in groups.values()]
+            results = [r for f in futures for r in f.result()]
+            all_results.extend(results)
+            results.sort(key=lambda r: (r["ARI"], r["NMI"]), reverse=True)
+            if verbose:
+                print(f"  rung: {len(candidates):4d} candidates on {100 * fraction:5.1f}% of the audio "
+                      f"in {time.perf_counter() - start:6.2f} s, best ARI {results[0]['ARI']:.3f}")
+            if fraction >= 1.0 or len(results) == 1:
+                final = {id(r) for r in results}
+                return results + [r for r in all_results if id(r) not in final]
+            candidates = [{k: r[k] for k in PARAM_NAMES} for r in results[:max(1, len(results) // eta)]]
+            fraction = min(1.0, fraction * eta)
+
+
+def make_grid(args):
+    grid = []
+    for values in itertools.product(args.frame, args.hop, args.smoothing, args.quantile,
+                                    args.min_silence, args.min_voiced):
+        grid.append(dict(zip(PARAM_NAMES, values)))
+    return grid
+
+
+def load_recordings(filename, datasets=None):
+    loader = H5DataLoader(filename)
+    names = datasets or loader.list_datasets()
+    recordings = {}
+    for name in names:
+        data = loader.load_dataset(name)
+        adc = {ch: np.asarray(data["adc_data"].get(ch, np.array([])), dtype=np.float64) for ch in ADC_CHANNELS}
+        recordings[name] = (EnergyCache(data["audio_data"]), adc)
+    loader.close()
+    return recordings
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Tune the short-time-energy segmentation parameters.")
+    parser.add_argument("--input_file", "-i", required=True, help="H5 recording (one dataset per word).")
+    parser.add_argument("--datasets", nargs="*", default=None, help="Datasets to use (default: all).")
+    parser.add_argument("--frame", type=float, nargs="+", default=[0.02, 0.04])
+    parser.add_argument("--hop", type=float, nargs="+", default=[0.01, 0.05, 0.1])
+    parser.add_argument("--smoothing", type=int, nargs="+", default=[3, 6, 9])
+    parser.add_argument("--quantile", type=float, nargs="+", default=[0.1, 0.15, 0.2, 0.3])
+    parser.add_argument("--min_silence", type=int, nargs="+", default=[1, 2, 3])
+    parser.add_argument("--min_voiced", type=int, nargs="+", default=[1, 2, 3])
+    parser.add_argument("--eta", type=int, default=3, help="Successive halving factor.")
+    parser.add_argument("--min_fraction", type=float, default=0.1, help="Share of the audio used by the first rung.")
+    parser.add_argument("--workers", type=int, default=None)
+    parser.add_argument("--out", "-o", default="segmentation_tuning.csv", help="CSV with every evaluation.")
+    args = parser.parse_args()
+
+    if not os.path.isfile(args.input_file):
+        print(f"Error: File '{args.input_file}' does not exist.")
+        raise SystemExit(1)
+
+    start = time.perf_counter()
+    recordings = load_recordings(args.input_file, args.datasets)
+    print(f"Loaded {len(recordings)} datasets in {time.perf_counter() - start:.2f} s")
+
+    grid = make_grid(args)
+    print(f"{len(grid)} parameter combinations, eta={args.eta}")
+    start = time.perf_counter()
+    results = successive_halving(grid, recordings, eta=args.eta, min_fraction=args.min_fraction,
+                                 workers=args.workers)
+    print(f"Search finished in {time.perf_counter() - start:.2f} s ({len(results)} evaluations)")
+
+    with open(args.out, "w", newline="") as f:
+        writer = csv.DictWriter(f, fieldnames=list(PARAM_NAMES) + ["fraction", "n_segments", "ARI", "NMI"])
+        writer.writeheader()
+        writer.writerows(results)
+    print("All evaluations saved to", args.out)
+
+    print("Top 5 on full recordings:")
+    for r in [r for r in results if r["fraction"] >= 1.0][:5]:
+        params = ", ".join(f"{k}={r[k]}" for k in PARAM_NAMES)
+        print(f"  ARI {r['ARI']:.3f} NMI {r['NMI']:.3f} segments {r['n_segments']:4d} | {params}")
@@ -0,0 +1,339 @@
+"""
+Sequential shard format for the memmap datasets.
+
+MemmapDataset reads one row per __getitem__ at a random offset of a single large
+file. That is fine on local NVMe, but on network storage or a spinning disk every
+sample costs a seek, and most of each row read is np.inf padding.
+export_shards() rewrites a memmap dataset as a directory of shards:
+  shards.json         descriptor fields (sampling rates, cutoffs, max lengths,
+                      dataset_mapping, statistics) and the list of shards,
+  shard-00000.bin     the records, one after the other. A record is audio, adc1
+                      and adc2 as float32 without the padding,
+  shard-00000.idx     per-shard index (.npy): id, byte offset and the three lengths
+                      of every record, so a shard can also be read at random.
+Segments are shuffled once when exporting, so neighbouring records are not from
+the same recording.
+
+ShardDataset streams the shards back (the WebDataset approach):
+  - the shard order is reshuffled every epoch,
+  - `readers` threads each read whole shards sequentially with large buffered
+    reads (the file I/O releases the GIL),
+  - the records go through a shuffle buffer of `shuffle_buffer` samples,
+  - with DataLoader(num_workers=N) every worker streams its own subset of shards.
+Samples are (id, audio, adc1, adc2), as MemmapDataset returns them
+(padding_handling "remove" or a float, optional band-pass filter).
+
+Usage:
+    python ShardDataset.py -d descriptor.json --export shards/ --shard_mb 64
+    python ShardDataset.py -d descriptor.json --shards shards/ --bench
+    loader = DataLoader(ShardDataset("shards/", shuffle_buffer=2000), batch_size=64,
+                        collate_fn=pad_collate, num_workers=4)
+"""
+
+import argparse
+import json
+import os
+import queue
+import random
+import threading
+import time
+
+import numpy as np
+
+try:
+    import torch
+    from torch.utils.data import IterableDataset, get_worker_info
+except ImportError:  # export and benchmarks work without torch
+    torch = None
+    IterableDataset = object
+    get_worker_info = lambda: None
+
+from Filters import BPfilter
+
+MANIFEST = "shards.json"
+INDEX_DTYPE = np.dtype([("id", np.int64), ("offset", np.int64), ("audio", np.int32),
+                        ("adc1", np.int32), ("adc2", np.int32)])
+DESCRIPTOR_KEYS = ("audio_sampling_rate", "adc_sampling_rate", "audio_lowcut", "audio_highcut", "adc_lowcut",
+                   "adc_highcut", "max_audio_len", "max_adc_len", "audio_mean", "audio_std", "audio_min",
+                   "audio_max", "adc_mean", "adc_std", "adc_min", "adc_max", "dataset_mapping", "norm_stats")
+
+
+def open_memmap(descriptor):
+    dtype = np.dtype([tuple(item) for item in descriptor["dtype"]])
+    return np.memmap(descriptor["memmap_filename"], dtype=dtype, mode="r", shape=(descriptor["n_segments"],))
+
+
+def valid(values):
+    # Padding is trailing np.inf, so the valid part is a prefix.
+    return values[:int(np.isfinite(values).sum())]
+
+
+def export_shards(descriptor, out_dir, shard_bytes=64 << 20, shuffle=True, seed=0, read_rows=256):
+    """Write the memmap dataset of `descriptor` as shards in out_dir. Returns the manifest."""
+    memmap = open_memmap(descriptor)
+    os.makedirs(out_dir, exist_ok=True)
+    n = descriptor["n_segments"]
+    order = np.random.default_rng(seed).permutation(n) if shuffle else np.arange(n)
+
+    shards = []
+    state = {"file": None, "index": [], "offset": 0}
+
+    def close_shard():
+        if state["file"] is None:
+            return
+        state["file"].close()
+        name = f"shard-{len(shards):05d}"
+        with open(os.path.join(out_dir, name + ".idx"), "wb") as f:
+            np.save(f, np.array(state["index"], dtype=INDEX_DTYPE))
+        shards.append({"name": name, "n_segments": len(state["index"]), "bytes": state["offset"]})
+        state.update(file=None, index=[], offset=0)
+
+    for start in range(0, n, read_rows):
+        chunk = order[start:start + read_rows]
+        # Read the chunk in file order, write it in shuffled order.
+        sorted_idx = np.sort(chunk)
+        rows = memmap[sorted_idx]
+        position = {int(i): k for k, i in enumerate(sorted_idx)}
+        for i in chunk:
+            row = rows[position[int(i)]]
+            audio, adc1, adc2 = valid(row["audio"]), valid(row["adc1"]), valid(row["adc2"])
+            if state["file"] is None:
+                state["file"] = open(os.path.join(out_dir, f"shard-{len(shards):05d}.bin"), "wb")
+            state["index"].append((int(row["id"]), state["offset"], len(audio), len(adc1), len(adc2)))
+            for values in (audio, adc1, adc2):
+                data = np.ascontiguousarray(values, dtype=np.float32).tobytes()
+                state["file"].write(data)
+                state["offset"] += len(data)
+            if state["offset"] >= shard_bytes:
+                close_shard()
+    close_shard()
+
+    manifest = {key: descriptor[key] for key in DESCRIPTOR_KEYS if key in descriptor}
+    manifest.update(n_segments=n, source_memmap=descriptor["memmap_filename"], shuffled=shuffle, shards=shards)
+    with open(os.path.join(out_dir, MANIFEST), "w") as f:
+        json.dump(manifest, f)
+    return manifest
+
+
+def read_shard(path, index, read_bytes=4 << 20):
+    """Yield (id, audio, adc1, adc2) numpy arrays of one shard, reading it front to back."""
+    with open(path, "rb", buffering=read_bytes) as f:
+        for rec in index:
+            lengths = (int(rec["audio"]), int(rec["adc1"]), int(rec["adc2"]))
+            data = np.frombuffer(f.read(4 * sum(lengths)), dtype=np.float32)
+            a, b = lengths[0], lengths[0] + lengths[1]
+            yield int(rec["id"]), data[:a], data[a:b], data[b:]
+
+
+class ShardDataset(IterableDataset):
+    def __init__(self, shard_dir, shuffle_buffer=1000, readers=4, shuffle=True, seed=0,
+                 padding_handling="remove", filter=False, to_tensor=True, read_bytes=4 << 20):
+        with open(os.path.join(shard_dir, MANIFEST), "r") as f:
+            self.descriptor = json.load(f)
+        self.shard_dir = shard_dir
+        self.shards = self.descriptor["shards"]
+        self.indexes = [np.load(os.path.join(shard_dir, s["name"] + ".idx")) for s in self.shards]
+        self.n_segments = self.descriptor["n_segments"]
+        self.shuffle_buffer = shuffle_buffer if shuffle else 0
+        self.readers = readers
+        self.shuffle = shuffle
+        self.seed = seed
+        self.epoch = 0
+        self.padding_handling = padding_handling
+        self.filter = filter
+        self.to_tensor = to_tensor and torch is not None
+        self.read_bytes = read_bytes
+
+    def __len__(self):
+        return self.n_segments
+
+    def set_epoch(self, epoch):
+        self.epoch = epoch
+
+    def get(self, field):
+        return self.descriptor[field]
+
+    def _my_shards(self):
+        order = list(range(len(self.shards)))
+        if self.shuffle:
+            random.Random(self.seed * 100003 + self.epoch).shuffle(order)
+        worker = get_worker_info()
+        if worker is not None:
+            order = order[worker.id::worker.num_workers]
+        return order
+
+    def _records(self, shard_ids):
+        """Records of the given shards, read by `readers` threads, in arrival order."""
+        todo = queue.Queue()
+        for s in shard_ids:
+            todo.put(s)
+        out = queue.Queue(maxsize=4 * max(self.shuffle_buffer, 256))
+        stop = threading.Event()
+        done = object()
+
+        def reader():
+            try:
+                while not stop.is_set():
+                    try:
+                        s = todo.get_nowait()
+                    except queue.Empty:
+                        return
+                    path = os.path.join(self.shard_dir, self.shards[s]["name"] + ".bin")
+                    for record in read_shard(path, self.indexes[s], self.read_bytes):
+                        while not stop.is_set():
+                            try:
+                                out.put(record, timeout=0.1)
+                                break
+                            except queue.Full:
+                                pass
+                        if stop.is_set():
+                            return
+            finally:
+                out.put(done)
+
+        n_readers = max(1, min(self.readers, len(shard_ids)))
+        threads = [threading.Thread(target=reader, daemon=True) for _ in range(n_readers)]
+        for t in threads:
+            t.start()
+        try:
+            finished = 0
+            while finished < n_readers:
+                record = out.get()
+                if record is done:
+                    finished += 1
+                else:
+                    yield record
+        finally:
+            stop.set()
+            # Unblock readers waiting on a full queue.
+            while any(t.is_alive() for t in threads):
+                try:
+                    out.get(timeout=0.1)
+                except queue.Empty:
+                    pass
+
+    def _sample(self, record):
+        seg_id, audio, adc1, adc2 = record
+        d = self.descriptor
+        channels = [audio, adc1, adc2]
+        if self.filter:
+            channels[0] = BPfilter(channels[0], d["audio_sampling_rate"], d["audio_lowcut"], d["audio_highcut"])
+            channels[1] = BPfilter(channels[1], d["adc_sampling_rate"], d["adc_lowcut"], d["adc_highcut"])
+            channels[2] = BPfilter(channels[2], d["adc_sampling_rate"], d["adc_lowcut"], d["adc_highcut"])
+        if self.padding_handling != "remove":
+            if not isinstance(self.padding_handling, (int, float)):
+                raise ValueError("Invalid padding_handling value. Use 'remove' or a float value.")
+            sizes = (d["max_audio_len"], d["max_adc_len"], d["max_adc_len"])
+            padded = []
+            for values, size in zip(channels, sizes):
+                full = np.full(size, self.padding_handling, dtype=np.float32)
+                full[:len(values)] = values
+                padded.append(full)
+            channels = padded
+        if self.to_tensor:
+            channels = [torch.from_numpy(np.array(values, dtype=np.float32)) for values in channels]
+        return (seg_id, *channels)
+
+    def __iter__(self):
+        rng = random.Random(self.seed * 100003 + self.epoch + 1)
+        records = self._records(self._my_shards())
+        if self.shuffle:
+            self.epoch += 1  # a fresh shard order next time unless set_epoch() is used
+        buffer = []
+        for record in records:
+            if len(buffer) < self.shuffle_buffer:
+                buffer.append(record)
+                continue
+            k = rng.randrange(len(buffer))
+            buffer[k], record = record, buffer[k]
+            yield self._sample(record)
+        rng.shuffle(buffer)
+        for record in buffer:
+            yield self._sample(record)
+
+
+def drop_cache(paths):
+    """Ask the kernel to evict the files from the page cache (cold-cache benchmark)."""
+    for path in paths:
+        fd = os.open(path, os.O_RDONLY)
+        try:
+            os.fsync(fd)
+            os.posix_fadvise(fd, 0, 0, os.POSIX_FADV_DONTNEED)
+        finally:
+            os.close(fd)
+
+
+def bench_memmap(descriptor, max_segments, seed=0):
+    """MemmapDataset access pattern: random row order (DataLoader shuffle=True), padding removed."""
+    memmap = open_memmap(descriptor)
+    order = np.random.default_rng(seed).permutation(descriptor["n_segments"])[:max_segments]
+    start = time.perf_counter()
+    n_values = 0
+    for i in order:
+        row = memmap[i]
+        for field in ("audio", "adc1", "adc2"):
+            values = np.array(row[field])
+            n_values += len(values[~np.isinf(values)])
+    return len(order) / (time.perf_counter() - start), n_values
+
+
+def bench_shards(shard_dir, max_segments, readers, shuffle_buffer):
+    dataset = ShardDataset(shard_dir, shuffle_buffer=shuffle_buffer, readers=readers, to_tensor=False)
+    start = time.perf_counter()
+    n = n_values = 0
+    for sample in dataset:
+        n_values += sum(len(x) for x in sample[1:])
+        n += 1
+        if n >= max_segments:
+            break
+    return n / (time.perf_counter() - start), n_values
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Export a memmap dataset to sequential shards / benchmark reading.")
+    parser.add_argument("--descriptor", "-d", required=True, help="Descriptor JSON of the memmap dataset.")
+    parser.add_argument("--export", default=None, help="Write shards to this directory.")
+    parser.add_argument("--shards", default=None, help="Shard directory to benchmark (default: the --export one).")
+    parser.add_argument("--shard_mb", type=float, default=64, help="Target shard size in MB.")
+    parser.add_argument("--no_shuffle", action="store_true", help="Keep the memmap order when exporting.")
+    parser.add_argument("--bench", action="store_true", help="Compare segments/s with the memmap on a cold cache.")
+    parser.add_argument("--max_segments", type=int, default=None, help="Segments per benchmark run.")
+    parser.add_argument("--readers", type=int, default=4, help="Shard reader threads.")
+    parser.add_argument("--shuffle_buffer", type=int, default=1000)
+    args = parser.parse_args()
+
+    if not os.path.isfile(args.descriptor):
+        print(f"Error: File '{args.descriptor}' does not exist.")
+        raise SystemExit(1)
+    with open(args.descriptor, "r") as f:
+        descriptor = json.load(f)
+
+    if args.export:
+        start = time.perf_counter()
+        manifest = export_shards(descriptor, args.export, shard_bytes=int(args.shard_mb * (1 << 20)),
+                                 shuffle=not args.no_shuffle)
+        total = sum(s["bytes"] for s in manifest["shards"])
+        print(f"Exported {manifest['n_segments']} segments to {len(manifest['shards'])} shards "
+              f"({total / 1e6:.1f} MB, memmap {os.path.getsize(descriptor['memmap_filename']) / 1e6:.1f} MB) "
+              f"in {time.perf_counter() - start:.2f} s")
+
+    if args.bench:
+        shard_dir = args.shards or args.export
+        if shard_dir is None or not os.path.isfile(os.path.join(shard_dir, MANIFEST)):
+            print(f"Error: File '{os.path.join(shard_dir or '.', MANIFEST)}' does not exist.")
+            raise SystemExit(1)
+        max_segments = args.max_segments or descriptor["n_segments"]
+        with open(os.path.join(shard_dir, MANIFEST), "r") as f:
+            shard_files = [os.path.join(shard_dir, s["name"] + ".bin") for s in json.load(f)["shards"]]
+
+        drop_cache([descriptor["memmap_filename"]])
+        rate_mm, values_mm = bench_memmap(descriptor, max_segments)
+        drop_cache(shard_files)
+        rate_sh, values_sh = bench_shards(shard_dir, max_segments, args.readers, args.shuffle_buffer)
+        print(f"Cold cache, {max_segments} segments:")
+        print(f"  memmap, random rows : {rate_mm:9.1f} segments/s")
+        print(f"  shards, streaming   : {rate_sh:9.1f} segments/s ({args.readers} readers, "
+              f"buffer {args.shuffle_buffer})")
+        print(f"  speedup             : {rate_sh / rate_mm:.2f}x")
+        if max_segments >= descriptor["n_segments"] and values_mm != values_sh:
+            print(f"Warning: sample counts differ (memmap {values_mm}, shards {values_sh})")
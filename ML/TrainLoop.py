@@ -0,0 +1,321 @@
+"""
+Shared CPU training loop for the classifier / transformer notebooks.
+
+The notebooks train in plain fp32 eager mode with PyTorch's default threading.
+train() keeps the train_epoch() structure (epochs over a DataLoader, returns one
+result dict per epoch) and adds:
+  - bf16 autocast on CPUs with native bf16 (AVX512_BF16 / AMX). Weights,
+    gradients and the optimizer state stay fp32, so no loss scaling is needed,
+  - torch.compile when available (falls back to eager if compilation fails;
+    errors raised by the model or the loss itself are not swallowed),
+  - gradient accumulation (accumulation_steps micro-batches per optimizer step),
+  - per-step timing: mean / p50 / p95 step time and samples/s.
+configure_threads() sets intra-op threads (default: the cores this process may
+use) and inter-op threads. Call it once at the start of the notebook, before any
+torch work, because the inter-op pool cannot be resized afterwards.
+
+The loss is model specific, so it is passed in. For the padded per-segment
+classifier of Transformer.ipynb, whose loader yields (ids, audio, adc1, adc2):
+    def compute_loss(model, batch):
+        ids, audio, adc1, adc2 = batch
+        adc = torch.stack((adc1, adc2), dim=1)
+        mask = model.compute_src_key_padding_mask(adc)
+        outputs = model(adc, mask)
+        ...
+        return loss, {"correct": correct, "total": total}   # or just loss
+sequence_loss() is the loss of Transformer_seq_full.ipynb (composite sequences
+with one label per ADC sample).
+The notebooks still run their own train_epoch() copies: they step the scheduler
+once per epoch (train() steps it per optimizer step) and add their own input
+noise and shifts, so moving them to train() changes their training schedule and
+is left to a retraining run.
+
+    configure_threads()
+    results = train(model, dataloader, epochs=10, compute_loss=compute_loss,
+                    optimizer=torch.optim.Adam(model.parameters(), lr=1e-4),
+                    precision="auto", compile=True, accumulation_steps=4)
+
+Benchmark of the options (one process per configuration):
+    python TrainLoop.py --batch_size 16 --length 16384 --steps 20
+"""
+
+import argparse
+import multiprocessing as mp
+import os
+import time
+
+import numpy as np
+import torch
+
+
+def available_cores():
+    try:
+        return len(os.sched_getaffinity(0))
+    except AttributeError:
+        return os.cpu_count() or 1
+
+
+def configure_threads(intra_op=None, inter_op=None):
+    """Set torch intra/inter-op thread counts. Returns the values in effect."""
+    intra_op = intra_op or available_cores()
+    inter_op = inter_op or max(1, min(4, intra_op // 4))
+    torch.set_num_threads(intra_op)
+    try:
+        torch.set_num_interop_threads(inter_op)
+    except RuntimeError:
+        pass  # already set, or torch work already started in this process
+    return torch.get_num_threads(), torch.get_num_interop_threads()
+
+
+def cpu_has_bf16():
+    """True if the CPU advertises native bf16 instructions."""
+    try:
+        with open("/proc/cpuinfo", "r") as f:
+            flags = f.read()
+    except OSError:
+        return False
+    return "avx512_bf16" in flags or "amx_bf16" in flags
+
+
+def resolve_precision(precision):
+    """'auto' -> 'bf16' on CPUs with native bf16, else 'fp32'."""
+    if precision == "auto":
+        return "bf16" if cpu_has_bf16() else "fp32"
+    if precision not in ("bf16", "fp32"):
+        raise ValueError("precision must be 'auto', 'bf16' or 'fp32'")
+    return precision
+
+
+def compile_errors():
+    """Exception types torch.compile raises when it cannot compile (none if unavailable)."""
+    try:
+        from torch._dynamo.exc import TorchDynamoException
+    except ImportError:
+        return ()
+    return (TorchDynamoException,)
+
+
+def maybe_compile(model, enabled=True):
+    if not enabled or not hasattr(torch, "compile"):
+        return model, False
+    try:
+        return torch.compile(model), True
+    except Exception as e:
+        print(f"torch.compile unavailable ({e}), running eager")
+        return model, False
+
+
+class StepTimer:
+    """Wall time and sample count of every optimizer step."""
+    def __init__(self, skip=1):
+        self.skip = skip  # warm-up steps left out of the summary (compilation, allocator)
+        self.times = []
+        self.samples = []
+
+    def add(self, seconds, samples):
+        self.times.append(seconds)
+        self.samples.append(samples)
+
+    def summary(self):
+        times = np.asarray(self.times[self.skip:] or self.times, dtype=np.float64)
+        samples = np.asarray(self.samples[self.skip:] or self.samples)
+        if len(times) == 0:
+            return {"steps": 0}
+        return {
+            "steps": len(self.times),
+            "step_ms_mean": 1000 * float(times.mean()),
+            "step_ms_p50": 1000 * float(np.percentile(times, 50)),
+            "step_ms_p95": 1000 * float(np.percentile(times, 95)),
+            "samples_per_s": float(samples.sum() / times.sum()),
+        }
+
+
+def batch_size_of(batch):
+    first = batch[0] if isinstance(batch, (tuple, list)) else batch
+    return len(first)
+
+
+def train(model, dataloader, epochs, compute_loss, optimizer=None, learning_rate=1e-4, scheduler=None,
+          precision="auto", compile=False, accumulation_steps=1, max_grad_norm=None, max_steps=None,
+          verbose=1, log_interval=50, logger=None):
+    """
+    compute_loss(model, batch) -> loss, or (loss, stats) where stats may hold
+    "correct" / "total" for the accuracy. Returns one dict per epoch with loss,
+    accuracy (if reported) and the step timing summary.
+    """
+    precision = resolve_precision(precision)
+    if optimizer is None:
+        optimizer = torch.optim.Adam(model.parameters(), lr=learning_rate)
+    model.train()
+    run_model, compiled = maybe_compile(model, compile)
+    fallback_errors = compile_errors() if compiled else ()
+    if verbose:
+        print(f"Training: {precision}, {'compiled' if compiled else 'eager'}, "
+              f"{torch.get_num_threads()} threads, accumulation {accumulation_steps}")
+
+    epoch_results = []
+    steps_done = 0
+    for epoch in range(epochs):
+        timer = StepTimer()
+        total_loss = 0.0
+        num_batches = 0
+        correct = total = 0
+        step_start = time.perf_counter()
+        step_samples = 0
+        optimizer.zero_grad(set_to_none=True)
+
+        for batch_idx, batch in enumerate(dataloader):
+            try:
+                with torch.autocast("cpu", dtype=torch.bfloat16, enabled=(precision == "bf16")):
+                    out = compute_loss(run_model, batch)
+            except fallback_errors as e:
+                # Compilation happens on the first call (and on recompiles for new shapes):
+                # fall back to eager for the rest of the run.
+                print(f"torch.compile failed ({type(e).__name__}: {e}), running eager")
+                run_model, compiled, fallback_errors = model, False, ()
+                with torch.autocast("cpu", dtype=torch.bfloat16, enabled=(precision == "bf16")):
+                    out = compute_loss(run_model, batch)
+            loss, stats = out if isinstance(out, tuple) else (out, {})
+            (loss.float() / accumulation_steps).backward()
+
+            total_loss += loss.item()
+            num_batches += 1
+            correct += int(stats.get("correct", 0))
+            total += int(stats.get("total", 0))
+            step_samples += batch_size_of(batch)
+
+            if num_batches % accumulation_steps == 0:
+                if max_grad_norm is not None:
+                    torch.nn.utils.clip_grad_norm_(model.parameters(), max_grad_norm)
+                optimizer.step()
+                optimizer.zero_grad(set_to_none=True)
+                if scheduler is not None:
+                    scheduler.step()
+                now = time.perf_counter()
+                timer.add(now - step_start, step_samples)
+                step_start, step_samples = now, 0
+                steps_done += 1
+                if verbose and len(timer.times) % log_interval == 0:
+                    print(f"[TRAIN] Epoch: {epoch}/{epochs}, Batch: {batch_idx}, Loss: {loss.item():.4f}, "
+                          f"Step: {1000 * timer.times[-1]:.1f} ms")
+                if max_steps is not None and steps_done >= max_steps:
+                    break
+
+        if num_batches % accumulation_steps:
+            # Leftover micro-batches: step on the partial accumulation (gradients scaled to match).
+            done = num_batches % accumulation_steps
+            for p in model.parameters():
+                if p.grad is not None:
+                    p.grad.mul_(accumulation_steps / done)
+            optimizer.step()
+            optimizer.zero_grad(set_to_none=True)
+            if scheduler is not None:
+                scheduler.step()
+            timer.add(time.perf_counter() - step_start, step_samples)
+
+        result = {"epoch": epoch, "loss": total_loss / max(num_batches, 1), **timer.summary()}
+        if total:
+            result["accuracy"] = 100 * correct / total
+        epoch_results.append(result)
+        if verbose:
+            msg = f"[TRAIN] Epoch: {epoch}/{epochs}, Loss: {result['loss']:.4f}"
+            if "accuracy" in result:
+                msg += f", Accuracy: {result['accuracy']:.2f}%"
+            if result["steps"]:
+                msg += (f", step {result['step_ms_mean']:.1f} ms (p95 {result['step_ms_p95']:.1f}), "
+                        f"{result['samples_per_s']:.1f} samples/s")
+            print(msg)
+        if logger is not None:
+            logger.log({"split": "train", **result})
+        if max_steps is not None and steps_done >= max_steps:
+            break
+    return epoch_results
+
+
+def sequence_loss(model, batch):
+    """
+    Loss of Transformer_seq_full.ipynb's train_epoch. The CompositeDataset loader
+    yields (adc1, adc2, ids): adc [B, T] and ids [B, T], one class per ADC sample.
+    model(adc) returns logits [B, tokens, C] (FullV1dTransformer, LocalV1dTransformer),
+    and the labels are taken every input_kern samples to line up with the tokens.
+    """
+    adc1, adc2, ids = batch
+    adc = torch.stack((adc1, adc2), dim=1)
+    outputs = model(adc)                                # [B, L, C]
+    labels = ids[:, ::model.input_kern][:, :outputs.size(1)]
+    loss = torch.nn.functional.cross_entropy(outputs.float().transpose(1, 2), labels)
+    correct = (outputs.argmax(dim=-1) == labels).sum().item()
+    return loss, {"correct": correct, "total": labels.numel()}
+
+
+def _bench_one(config, args, conn):
+    try:
+        if config["threads"] == "tuned":
+            configure_threads()
+        from LocalAttention import LocalV1dTransformer
+        torch.manual_seed(0)
+        model = LocalV1dTransformer(2, args.classes, args.length, input_kern=16, nhead=8,
+                                    num_encoder_layers=args.layers, dim_feedforward=args.d_model,
+                                    window=64, downsample=1)
+        generator = torch.Generator().manual_seed(0)
+        micro = args.batch_size // config["accumulation"]
+        batches = []
+        for _ in range(4):
+            # Composite sequences as Transformer_seq_full.ipynb builds them: one label per sample.
+            ids = torch.randint(0, args.classes, (micro, args.length), generator=generator)
+            adc = torch.randn(micro, 2, args.length, generator=generator)
+            batches.append((adc[:, 0], adc[:, 1], ids))
+        loader = [batches[i % len(batches)] for i in range(args.steps * config["accumulation"])]
+        results = train(model, loader, epochs=1, compute_loss=sequence_loss, precision=config["precision"],
+                        compile=config["compile"], accumulation_steps=config["accumulation"], verbose=0)
+        conn.send(results[-1])
+    except Exception as e:
+        conn.send({"error": f"{type(e).__name__}: {e}"})
+    finally:
+        conn.close()
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Benchmark CPU training options on a LocalV1dTransformer.")
+    parser.add_argument("--batch_size", type=int, default=16, help="Samples per optimizer step.")
+    parser.add_argument("--length", type=int, default=16384, help="ADC samples per sequence.")
+    parser.add_argument("--steps", type=int, default=20)
+    parser.add_argument("--layers", type=int, default=4)
+    parser.add_argument("--d_model", type=int, default=256)
+    parser.add_argument("--classes", type=int, default=10)
+    parser.add_argument("--accumulation", type=int, default=4, help="Micro-batches per step for the last run.")
+    args = parser.parse_args()
+
+    has_bf16 = cpu_has_bf16()
+    print(f"{available_cores()} cores, native bf16: {'yes' if has_bf16 else 'no'}, torch {torch.__version__}")
+    configs = [
+        ("fp32 eager, default threads", dict(threads="default", precision="fp32", compile=False, accumulation=1)),
+        ("fp32 eager, tuned threads", dict(threads="tuned", precision="fp32", compile=False, accumulation=1)),
+        ("bf16 eager, tuned threads", dict(threads="tuned", precision="bf16", compile=False, accumulation=1)),
+        ("bf16 compiled, tuned threads", dict(threads="tuned", precision="bf16", compile=True, accumulation=1)),
+        (f"bf16 compiled, accumulation {args.accumulation}",
+         dict(threads="tuned", precision="bf16", compile=True, accumulation=args.accumulation)),
+    ]
+    if not has_bf16:
+        print("(bf16 runs are emulated on this CPU and are expected to be slower than fp32)")
+
+    ctx = mp.get_context("spawn")  # fresh process per run: thread pools can only be configured once
+    baseline = None
+    for name, config in configs:
+        parent, child = ctx.Pipe(duplex=False)
+        proc = ctx.Process(target=_bench_one, args=(config, args, child))
+        proc.start()
+        child.close()
+        try:
+            result = parent.recv()
+        except EOFError:
+            result = {"error": "worker died"}
+        proc.join()
+        if "error" in result:
+            print(f"  {name:34s}: {result['error']}")
+            continue
+        baseline = baseline or result["samples_per_s"]
+        print(f"  {name:34s}: step {result['step_ms_mean']:8.1f} ms (p95 {result['step_ms_p95']:8.1f}), "
+              f"{result['samples_per_s']:7.2f} samples/s, {result['samples_per_s'] / baseline:.2f}x")
+    if baseline is None:
+        raise SystemExit(1)
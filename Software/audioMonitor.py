@@ -0,0 +1,303 @@
+#!/usr/bin/env python3
+"""
+Live monitoring output for the mic stream (source 0).
+
+Packets from DataReceiverThread are pushed into an adaptive jitter buffer; an
+output sink pulls fixed-size blocks at its own clock rate. The buffer's target
+delay follows the network jitter, estimated as in RFC 3550 from the arrival
+time of each packet against its device timestamp, and the device /
+sound-card clock drift is absorbed by resampling: a PI controller nudges the
+read ratio (at most +-0.5%) to keep the fill level on target, so the stream never
+has to be cut or padded while both ends run.
+
+Sinks:
+  - QtAudioSink: local audio device through PyQt5.QtMultimedia (used by live.py).
+  - NullSink / WavFileSink: clocked by a thread, for headless runs and tests.
+
+Headless usage (replays a raw capture from live.py through the monitor):
+    python audioMonitor.py -i session.cap --wav monitor.wav
+    python audioMonitor.py -i session.cap          # null sink, stats only
+"""
+
+import argparse
+import os
+import threading
+import time
+import wave
+from collections import deque
+
+import numpy as np
+
+MIC_SAMPLE_RATE = 48000
+BLOCK_MS = 10              # sink pull size
+MIN_DELAY_MS = 20          # jitter buffer target bounds
+MAX_DELAY_MS = 100
+CAPACITY_MS = 400          # hard cap, older samples are dropped beyond this
+MAX_RATIO_DEVIATION = 0.005
+
+
+class JitterBuffer:
+    """
+    Ring buffer with a fractional read position.
+    push() is called from the receiver side, pull() from the sink clock.
+    """
+    def __init__(self, sample_rate=MIC_SAMPLE_RATE, min_delay_ms=MIN_DELAY_MS,
+                 max_delay_ms=MAX_DELAY_MS, capacity_ms=CAPACITY_MS):
+        self.sample_rate = sample_rate
+        self.min_delay = min_delay_ms * sample_rate // 1000
+        self.max_delay = max_delay_ms * sample_rate // 1000
+        self.capacity = capacity_ms * sample_rate // 1000
+        self.ring = np.zeros(self.capacity, dtype=np.float32)
+        self.lock = threading.Lock()
+
+        self.write_total = 0        # samples written since start
+        self.read_pos = 0.0         # fractional sample index of the next read
+        self.buffering = True       # refill to target before playing (start / after underrun)
+
+        # Jitter estimation (RFC 3550): transit = arrival - media time (device timestamp).
+        self.jitter = 0.0           # seconds
+        self.last_transit = None
+        self.target = self.min_delay
+
+        # Drift controller state.
+        self.ratio = 1.0
+        self.integral = 0.0
+
+        # Statistics.
+        self.underruns = 0
+        self.dropped = 0
+        self.latency_ms_hist = deque(maxlen=1000)
+
+    def fill(self):
+        return self.write_total - self.read_pos
+
+    def push(self, samples, media_time=None, arrival=None):
+        """
+        media_time: device time of the packet in seconds (its header timestamp). Without
+        it the sample count stands in, which also counts host scheduling as jitter.
+        """
+        samples = np.asarray(samples, dtype=np.float32) / 32768.0
+        n = len(samples)
+        if n == 0:
+            return
+        arrival = time.perf_counter() if arrival is None else arrival
+        with self.lock:
+            media_time = self.write_total / self.sample_rate if media_time is None else media_time
+            transit = arrival - media_time
+            if self.last_transit is not None:
+                self.jitter += (abs(transit - self.last_transit) - self.jitter) / 16.0
+            self.last_transit = transit
+            # Target covers one packet plus a few jitter deviations.
+            target = n + 4.0 * self.jitter * self.sample_rate
+            self.target = int(min(max(target, self.min_delay), self.max_delay))
+
+            start = self.write_total % self.capacity
+            first = min(n, self.capacity - start)
+            self.ring[start:start + first] = samples[:first]
+            self.ring[:n - first] = samples[first:]
+            self.write_total += n
+
+            # Never let the reader fall more than the ring (or twice the max delay) behind.
+            overflow = self.fill() - min(self.capacity - 1, 2 * self.max_delay)
+            if overflow > 0:
+                self.read_pos += overflow
+                self.dropped += int(overflow)
+
+    def pull(self, n_out, dt):
+        """Return n_out resampled samples; dt is the sink period in seconds (for the PI controller)."""
+        with self.lock:
+            fill = self.fill()
+            if self.buffering:
+                if fill < self.target:
+                    return np.zeros(n_out, dtype=np.float32)
+                self.buffering = False
+                self.integral = 0.0
+
+            # PI control on the fill error (in seconds): positive error -> read faster.
+            error = (fill - self.target) / self.sample_rate
+            self.integral += error * dt
+            ratio = 1.0 + 0.05 * error + 0.01 * self.integral
+            self.ratio = min(max(ratio, 1.0 - MAX_RATIO_DEVIATION), 1.0 + MAX_RATIO_DEVIATION)
+
+            needed = n_out * self.ratio + 1
+            if fill < needed:
+                self.underruns += 1
+                self.buffering = True
+                return np.zeros(n_out, dtype=np.float32)
+
+            positions = self.read_pos + np.arange(n_out) * self.ratio
+            base = np.floor(positions).astype(np.int64)
+            frac = (positions - base).astype(np.float32)
+            idx0 = base % self.capacity
+            idx1 = (base + 1) % self.capacity
+            out = self.ring[idx0] * (1.0 - frac) + self.ring[idx1] * frac
+            self.read_pos += n_out * self.ratio
+            self.latency_ms_hist.append(1000.0 * self.fill() / self.sample_rate)
+            return out
+
+    def stats(self, sink_latency_ms=0.0):
+        with self.lock:
+            hist = list(self.latency_ms_hist)
+        lat = np.array(hist) + sink_latency_ms if hist else np.array([0.0])
+        return {
+            "latency_ms": float(lat[-1]),
+            "latency_p95_ms": float(np.percentile(lat, 95)),
+            "target_ms": 1000.0 * self.target / self.sample_rate,
+            "jitter_ms": 1000.0 * self.jitter,
+            "ratio": self.ratio,
+            "underruns": self.underruns,
+            "dropped": self.dropped,
+        }
+
+
+class NullSink:
+    """Pulls BLOCK_MS blocks on a wall-clock thread and discards them."""
+    latency_ms = 0.0
+
+    def __init__(self, sample_rate=MIC_SAMPLE_RATE, block_ms=BLOCK_MS, clock_skew=1.0):
+        # clock_skew != 1 simulates a sound card running faster/slower than the device.
+        self.sample_rate = sample_rate
+        self.block = sample_rate * block_ms // 1000
+        self.period = block_ms / 1000.0 / clock_skew
+        self.buffer = None
+        self.running = False
+        self.thread = None
+
+    def start(self, buffer):
+        self.buffer = buffer
+        self.running = True
+        self.thread = threading.Thread(target=self._run, daemon=True)
+        self.thread.start()
+
+    def _run(self):
+        next_tick = time.perf_counter()
+        while self.running:
+            self.consume(self.buffer.pull(self.block, self.period))
+            next_tick += self.period
+            delay = next_tick - time.perf_counter()
+            if delay > 0:
+                time.sleep(delay)
+
+    def consume(self, block):
+        pass
+
+    def stop(self):
+        self.running = False
+        if self.thread is not None:
+            self.thread.join()
+
+
+class WavFileSink(NullSink):
+    """Same clock as NullSink, writes everything it pulls to a 16-bit mono WAV."""
+    def __init__(self, filename, sample_rate=MIC_SAMPLE_RATE, block_ms=BLOCK_MS, clock_skew=1.0):
+        super().__init__(sample_rate, block_ms, clock_skew)
+        self.wav = wave.open(filename, "wb")
+        self.wav.setnchannels(1)
+        self.wav.setsampwidth(2)
+        self.wav.setframerate(sample_rate)
+
+    def consume(self, block):
+        self.wav.writeframes((np.clip(block, -1.0, 1.0) * 32767).astype("<i2").tobytes())
+
+    def stop(self):
+        super().stop()
+        self.wav.close()
+
+
+class QtAudioSink:
+    """
+    Local audio device via QAudioOutput in push mode. A QTimer tops the device
+    buffer up every BLOCK_MS; the device buffer is kept small (~2 blocks) so that
+    almost all of the latency budget is in the jitter buffer.
+    """
+    def __init__(self, sample_rate=MIC_SAMPLE_RATE, block_ms=BLOCK_MS):
+        from PyQt5.QtCore import QTimer
+        from PyQt5.QtMultimedia import QAudioFormat, QAudioOutput
+
+        fmt = QAudioFormat()
+        fmt.setSampleRate(sample_rate)
+        fmt.setChannelCount(1)
+        fmt.setSampleSize(16)
+        fmt.setCodec("audio/pcm")
+        fmt.setByteOrder(QAudioFormat.LittleEndian)
+        fmt.setSampleType(QAudioFormat.SignedInt)
+        self.sample_rate = sample_rate
+        self.block = sample_rate * block_ms // 1000
+        self.period = block_ms / 1000.0
+        self.output = QAudioOutput(fmt)
+        self.output.setBufferSize(self.block * 2 * 3)
+        self.latency_ms = 2 * block_ms
+        self.timer = QTimer()
+        self.timer.setInterval(block_ms // 2)
+        self.timer.timeout.connect(self._feed)
+        self.device = None
+        self.buffer = None
+
+    def start(self, buffer):
+        self.buffer = buffer
+        self.device = self.output.start()
+        self.latency_ms = 1000.0 * self.output.bufferSize() / 2 / self.sample_rate
+        self.timer.start()
+
+    def _feed(self):
+        while self.output.bytesFree() >= self.block * 2:
+            block = self.buffer.pull(self.block, self.period)
+            self.device.write((np.clip(block, -1.0, 1.0) * 32767).astype("<i2").tobytes())
+
+    def stop(self):
+        self.timer.stop()
+        self.output.stop()
+
+
+class AudioMonitor:
+    """Glue between DataReceiverThread.newData and a sink."""
+    def __init__(self, sink, sample_rate=MIC_SAMPLE_RATE):
+        self.buffer = JitterBuffer(sample_rate)
+        self.sink = sink
+
+    def start(self):
+        self.sink.start(self.buffer)
+
+    def stop(self):
+        self.sink.stop()
+
+    def on_data(self, source, ts, data):
+        if source == 0:
+            self.buffer.push(data, media_time=ts / 1e6)
+
+    def stats(self):
+        return self.buffer.stats(self.sink.latency_ms)
+
+
+def main():
+    from live import DataReceiverThread
+    from streamCapture import read_capture, ReplaySocket
+
+    parser = argparse.ArgumentParser(description="Play a raw capture through the audio monitor headlessly.")
+    parser.add_argument("--input_file", "-i", required=True, help="Capture file written by live.py.")
+    parser.add_argument("--wav", "-w", default=None, help="Write the monitor output to this WAV file (default: null sink).")
+    parser.add_argument("--clock_skew", type=float, default=1.0,
+                        help="Simulated sink clock rate relative to the device (e.g. 1.002).")
+    args = parser.parse_args()
+
+    if not os.path.isfile(args.input_file):
+        print(f"Error: File '{args.input_file}' does not exist.")
+        return
+
+    chunks = read_capture(args.input_file)
+    if args.wav:
+        sink = WavFileSink(args.wav, clock_skew=args.clock_skew)
+    else:
+        sink = NullSink(clock_skew=args.clock_skew)
+    monitor = AudioMonitor(sink)
+    receiver = DataReceiverThread("replay", socket_factory=lambda: ReplaySocket(chunks, 1.0))
+    receiver.newData.connect(monitor.on_data)
+    monitor.start()
+    receiver.run()  # original pacing, returns at the end of the capture
+    monitor.stop()
+    for key, value in monitor.stats().items():
+        print(f"{key}: {value:.4f}" if isinstance(value, float) else f"{key}: {value}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,132 @@
+"""
+High-rate ADC bursts (see Firmware-idf/src/adc_burst.h).
+
+On a trigger (threshold on the ADC, the "B" command sent by a client, or a GPIO
+edge) the device freezes a pre/post window of the 80 kHz ADC and uploads it in
+the background, interleaved with the normal stream:
+    source 2  BURST_INFO  payload = burst_info_t (id, rate, pre, total, trigger/first/request times, ...)
+    source 3  BURST       payload = up to 256 samples, header timestamp = time of the first one
+Samples are packed like the ADC stream (channel in the upper 4 bits, 12-bit value).
+Timestamps are device microseconds, on the same clock as the mic/ADC packets.
+
+    assembler = BurstAssembler()
+    burst = assembler.add(source, metadata, timestamp, payload)   # dict when a burst completes
+
+Extract every burst of a raw capture (streamCapture.py) into a .npz per burst:
+    python burstCapture.py -i session.cap -o bursts/
+"""
+
+import argparse
+import os
+import struct
+
+import numpy as np
+
+SOURCE_BURST_INFO = 2
+SOURCE_BURST = 3
+HEADER_FORMAT = "<BBHQ"
+HEADER_SIZE = struct.calcsize(HEADER_FORMAT)
+INFO_FORMAT = "<IIIIqqqBBH"
+INFO_FIELDS = ("id", "rate_hz", "pre", "total", "trigger_us", "first_us", "request_us",
+               "trigger", "channel", "missed")
+TRIGGERS = {1: "threshold", 2: "host", 3: "gpio"}
+
+
+def parse_info(payload):
+    info = dict(zip(INFO_FIELDS, struct.unpack_from(INFO_FORMAT, payload)))
+    info["trigger_name"] = TRIGGERS.get(info["trigger"], str(info["trigger"]))
+    return info
+
+
+class BurstAssembler:
+    """Collects BURST_INFO/BURST packets. A burst restarts whenever its info packet is seen again."""
+    def __init__(self):
+        self.info = None
+        self.samples = None
+        self.received = 0
+
+    def add(self, source, metadata, timestamp, payload):
+        """Feed one packet. Returns the completed burst (dict) or None."""
+        if source == SOURCE_BURST_INFO:
+            self.info = parse_info(payload)
+            self.samples = np.zeros(self.info["total"], dtype=np.uint16)
+            self.received = 0
+            return None
+        if source != SOURCE_BURST or self.info is None or metadata != self.info["id"] & 0xFF:
+            return None
+        values = np.frombuffer(payload, dtype="<u2")
+        offset = round((timestamp - self.info["first_us"]) * self.info["rate_hz"] / 1e6)
+        offset = min(max(offset, 0), self.info["total"] - len(values))
+        self.samples[offset:offset + len(values)] = values
+        self.received += len(values)
+        if self.received < self.info["total"]:
+            return None
+        burst = self.build()
+        self.info = None
+        return burst
+
+    def build(self):
+        info = self.info
+        index = np.arange(info["total"])
+        channels = self.samples >> 12
+        burst = dict(info)
+        # Sample k was taken at first_us + k / rate (device clock, microseconds).
+        burst["time_us"] = info["first_us"] + index * 1e6 / info["rate_hz"]
+        burst["channels"] = {}
+        for ch in np.unique(channels):
+            mask = channels == ch
+            burst["channels"][int(ch)] = (self.samples[mask] & 0x0FFF, burst["time_us"][mask])
+        return burst
+
+
+def iter_packets(data):
+    """(source, metadata, timestamp, payload) for every complete packet of a raw stream."""
+    pos = 0
+    while pos + HEADER_SIZE <= len(data):
+        source, metadata, length, ts = struct.unpack_from(HEADER_FORMAT, data, pos)
+        end = pos + HEADER_SIZE + 2 * length
+        if end > len(data):
+            break
+        yield source, metadata, ts, data[pos + HEADER_SIZE:end]
+        pos = end
+
+
+def save_burst(burst, out_dir):
+    path = os.path.join(out_dir, f"burst_{burst['id']:05d}.npz")
+    arrays = {}
+    for ch, (values, times) in burst["channels"].items():
+        arrays[f"ch{ch}"] = values
+        arrays[f"ch{ch}_time_us"] = times
+    scalars = {k: burst[k] for k in INFO_FIELDS}
+    np.savez(path, **arrays, **scalars)
+    return path
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Extract high-rate ADC bursts from a raw stream capture.")
+    parser.add_argument("--input_file", "-i", required=True, help="Capture file written by live.py.")
+    parser.add_argument("--output_dir", "-o", default=None, help="Write one .npz per burst here.")
+    args = parser.parse_args()
+
+    if not os.path.exists(args.input_file):
+        print(f"Error: File '{args.input_file}' does not exist.")
+        raise SystemExit(1)
+
+    from streamCapture import read_capture
+    stream = b"".join(chunk for _, chunk in read_capture(args.input_file))
+    if args.output_dir:
+        os.makedirs(args.output_dir, exist_ok=True)
+    assembler = BurstAssembler()
+    count = 0
+    for packet in iter_packets(stream):
+        burst = assembler.add(*packet)
+        if burst is None:
+            continue
+        count += 1
+        per_channel = ", ".join(f"ch{ch}: {len(v)}" for ch, (v, _) in sorted(burst["channels"].items()))
+        print(f"Burst {burst['id']} ({burst['trigger_name']}) at {burst['trigger_us'] / 1e6:.6f} s, "
+              f"{burst['pre']} + {burst['total'] - burst['pre']} samples at {burst['rate_hz']} Hz [{per_channel}], "
+              f"{burst['missed']} triggers missed before it")
+        if args.output_dir:
+            print("  ->", save_burst(burst, args.output_dir))
+    print(f"{count} burst(s) found.")
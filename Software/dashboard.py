@@ -0,0 +1,392 @@
+#!/usr/bin/env python3
+"""
+Multi-device live dashboard.
+
+One panel per device (audio + ADC plots, 3 streams with two ADC channels). Unlike
+live.py, nothing is drawn when a packet arrives: receiver threads only append to
+per-stream numpy ring buffers, and a single shared QTimer (the redraw clock)
+renders every panel once per frame. Each panel measures its own render cost
+(setData() plus the paint of its plots, which Qt runs later in the event loop)
+and adapts its decimation budget (points per curve, min/max envelope) so that
+all panels together stay within a fixed share of the frame period.
+
+Device specs (one per panel):
+    10.42.0.24          a device on PORT 5000
+    10.42.0.24:5003     a device (or stand-in, see discovery.py) on another port
+    replay:session.cap  a raw capture (see streamCapture.py), original pacing
+    synth:name          synthetic device (48 kHz audio + 2x4 kHz ADC), for benchmarks
+
+Usage:
+    python dashboard.py 10.42.0.24 10.42.0.25
+    python dashboard.py --synth 8 --fps 30
+    python dashboard.py --discover          # one panel per device announcing itself within 1 s
+    QT_QPA_PLATFORM=offscreen python dashboard.py --synth 8 --bench 10
+"""
+
+import argparse
+import math
+import sys
+import threading
+import time
+import struct
+
+import numpy as np
+from PyQt5.QtCore import Qt, QTimer
+from PyQt5.QtWidgets import (
+    QApplication, QMainWindow, QWidget, QVBoxLayout, QHBoxLayout, QGridLayout,
+    QGroupBox, QLabel, QSpinBox
+)
+import pyqtgraph as pg
+
+from live import DataReceiverThread, HEADER_FORMAT, PORT, ch2c
+from discovery import discover
+from streamCapture import read_capture, ReplaySocket
+
+AUDIO_RATE = 48000
+ADC_RATE = 4000             # per channel (8 kHz total over two channels)
+DEFAULT_FPS = 30
+DEFAULT_WINDOW_S = 1.0
+RENDER_SHARE = 0.5          # fraction of the frame period all panels may use together
+MIN_BUDGET = 128            # points per curve
+MAX_BUDGET = 4096
+
+
+class StreamRing:
+    """Fixed-size ring of the most recent samples of one stream (thread-safe append)."""
+    def __init__(self, capacity):
+        self.data = np.zeros(capacity, dtype=np.float32)
+        self.capacity = capacity
+        self.total = 0
+        self.lock = threading.Lock()
+
+    def append(self, samples):
+        samples = np.asarray(samples, dtype=np.float32)[-self.capacity:]
+        n = len(samples)
+        with self.lock:
+            start = self.total % self.capacity
+            first = min(n, self.capacity - start)
+            self.data[start:start + first] = samples[:first]
+            self.data[:n - first] = samples[first:]
+            self.total += n
+
+    def latest(self, n):
+        """Copy of the last n samples (fewer at start-up) and the index of the first one."""
+        with self.lock:
+            n = min(n, self.total, self.capacity)
+            end = self.total % self.capacity
+            if n <= end:
+                out = self.data[end - n:end].copy()
+            else:
+                out = np.concatenate((self.data[self.capacity - (n - end):], self.data[:end]))
+            return out, self.total - n
+
+
+def minmax_decimate(y, x0, budget):
+    """
+    Reduce y to at most `budget` points while keeping peaks: each bin contributes
+    its min and max. Returns (x, y) ready for PlotDataItem.setData.
+    """
+    n = len(y)
+    if n <= budget:
+        return np.arange(x0, x0 + n, dtype=np.float64), y
+    bins = max(budget // 2, 1)
+    width = n // bins
+    trimmed = y[n - bins * width:].reshape(bins, width)
+    out = np.empty(bins * 2, dtype=np.float32)
+    out[0::2] = trimmed.min(axis=1)
+    out[1::2] = trimmed.max(axis=1)
+    x = x0 + (n - bins * width) + np.repeat(np.arange(bins) * width, 2) + np.tile([0, width - 1], bins)
+    return x.astype(np.float64), out
+
+
+class SyntheticSocket:
+    """Socket stand-in producing the device wire format at real-time rate."""
+    AUDIO_PACKET = 480      # 10 ms
+    ADC_PACKET = 80         # 10 ms, two interleaved channels
+
+    def __init__(self, seed=0):
+        self.rng = np.random.default_rng(seed)
+        self.pending = b""
+        self.start = None
+        self.tick = 0
+        self.phase = self.rng.uniform(0, 2 * math.pi)
+
+    def connect(self, address):
+        self.start = time.time()
+
+    def settimeout(self, value):
+        pass
+
+    def close(self):
+        pass
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        return False
+
+    def _next_block(self):
+        due = self.start + self.tick * 0.01
+        delay = due - time.time()
+        if delay > 0:
+            time.sleep(delay)
+        t = (self.tick * self.AUDIO_PACKET + np.arange(self.AUDIO_PACKET)) / AUDIO_RATE
+        audio = (6000 * np.sin(2 * math.pi * 220 * t + self.phase)
+                 + self.rng.normal(0, 500, self.AUDIO_PACKET)).astype("<i2")
+        k = self.tick * self.ADC_PACKET // 2 + np.arange(self.ADC_PACKET // 2)
+        ch_a = (2048 + 1500 * np.sin(2 * math.pi * 2 * k / ADC_RATE + self.phase)).astype(np.uint16)
+        ch_b = (2048 + 300 * self.rng.standard_normal(self.ADC_PACKET // 2)).clip(0, 4095).astype(np.uint16)
+        adc = np.empty(self.ADC_PACKET, dtype="<u2")
+        adc[0::2] = (1 << 12) | ch_a
+        adc[1::2] = (3 << 12) | ch_b
+        ts = self.tick * 10000
+        self.tick += 1
+        return (struct.pack(HEADER_FORMAT, 0, 0, self.AUDIO_PACKET, ts) + audio.tobytes()
+                + struct.pack(HEADER_FORMAT, 1, 0, self.ADC_PACKET, ts) + adc.tobytes())
+
+    def recv(self, bufsize):
+        if not self.pending:
+            self.pending = self._next_block()
+        out = self.pending[:bufsize]
+        self.pending = self.pending[bufsize:]
+        return out
+
+
+def make_receiver(spec, index):
+    """Build a DataReceiverThread for a device spec (see module docstring)."""
+    if spec.startswith("replay:"):
+        chunks = read_capture(spec[len("replay:"):])
+        return DataReceiverThread(spec, socket_factory=lambda: ReplaySocket(chunks, 1.0))
+    if spec.startswith("synth:"):
+        return DataReceiverThread(spec, socket_factory=lambda: SyntheticSocket(seed=index))
+    if ":" in spec:
+        ip, port = spec.rsplit(":", 1)
+        return DataReceiverThread(ip, port=int(port))
+    return DataReceiverThread(spec)
+
+
+class TimedGraphicsLayout(pg.GraphicsLayoutWidget):
+    """GraphicsLayoutWidget that accumulates the time spent painting its scene."""
+    def __init__(self, *args, **kwargs):
+        super().__init__(*args, **kwargs)
+        self.paint_s = 0.0
+
+    def paintEvent(self, event):
+        start = time.perf_counter()
+        super().paintEvent(event)
+        self.paint_s += time.perf_counter() - start
+
+    def take_paint_time(self):
+        """Paint time since the previous call."""
+        paint_s, self.paint_s = self.paint_s, 0.0
+        return paint_s
+
+
+class DevicePanel(QGroupBox):
+    """Plots of one device. Receives data from any thread, draws only in render()."""
+    def __init__(self, name, window_s, parent=None):
+        super().__init__(name, parent)
+        self.name = name
+        self.audio = StreamRing(int(AUDIO_RATE * window_s))
+        self.adc = {}           # channel -> StreamRing, created by the receiver thread
+        self.adc_lock = threading.Lock()
+        self.window_s = window_s
+        self.budget = MAX_BUDGET
+        self.rendered_total = -1
+        self.cost_hist = []     # seconds per render, last 100
+        self.bytes_per_s = 0.0
+
+        self.plots = TimedGraphicsLayout()
+        self.audio_plot = self.plots.addPlot(row=0, col=0, title="Audio")
+        self.adc_plot = self.plots.addPlot(row=1, col=0, title="ADC")
+        for plot in (self.audio_plot, self.adc_plot):
+            plot.setClipToView(True)
+            plot.hideButtons()
+        self.audio_curve = self.audio_plot.plot(pen='y')
+        self.adc_curves = {}
+        self.status = QLabel("waiting for data")
+        layout = QVBoxLayout()
+        layout.addWidget(self.plots)
+        layout.addWidget(self.status)
+        self.setLayout(layout)
+
+    # Called from the receiver thread (direct connection): no widget access here.
+    def on_data(self, source, ts, data):
+        if source == 0:
+            self.audio.append(data)
+        elif source == 1:
+            for ch, samples in data.items():
+                ring = self.adc.get(ch)
+                if ring is None:
+                    with self.adc_lock:
+                        ring = self.adc.setdefault(ch, StreamRing(int(ADC_RATE * self.window_s)))
+                ring.append(samples)
+
+    def on_bps(self, bps):
+        self.bytes_per_s = bps
+
+    def render(self, share_s):
+        """
+        Draw the latest window; adapt the budget so that this panel costs at most share_s.
+        The cost is this update plus the paint of the previous one: setData() only
+        schedules the repaint, which runs after render_frame() returns.
+        """
+        start = time.perf_counter()
+        paint_s = self.plots.take_paint_time()
+        total = self.audio.total + sum(r.total for r in list(self.adc.values()))
+        if total == self.rendered_total:
+            return paint_s  # nothing new since the last frame
+        self.rendered_total = total
+
+        y, x0 = self.audio.latest(self.audio.capacity)
+        self.audio_curve.setData(*minmax_decimate(y, x0, self.budget), skipFiniteCheck=True)
+        with self.adc_lock:
+            channels = sorted(self.adc.items())
+        for ch, ring in channels:
+            y, x0 = ring.latest(ring.capacity)
+            if ch not in self.adc_curves:
+                self.adc_curves[ch] = self.adc_plot.plot(pen=ch2c.get(ch, 'w'), name=f"Ch {ch}")
+            self.adc_curves[ch].setData(*minmax_decimate(y, x0, self.budget), skipFiniteCheck=True)
+        cost = time.perf_counter() - start + paint_s
+
+        # Multiplicative budget control: shrink fast on overrun, grow slowly.
+        if cost > share_s:
+            self.budget = max(MIN_BUDGET, int(self.budget * max(0.5, share_s / cost)))
+        elif cost < 0.7 * share_s:
+            self.budget = min(MAX_BUDGET, int(self.budget * 1.1) + 1)
+        self.cost_hist = (self.cost_hist + [cost])[-100:]
+        return cost
+
+    def update_status(self):
+        if self.cost_hist:
+            cost_ms = 1000.0 * np.mean(self.cost_hist)
+            self.status.setText(f"{self.bytes_per_s / 1024:.0f} KB/s | render {cost_ms:.2f} ms | "
+                                f"{self.budget} pts/curve")
+
+
+class Dashboard(QMainWindow):
+    def __init__(self, specs, fps=DEFAULT_FPS, window_s=DEFAULT_WINDOW_S):
+        super().__init__()
+        self.setWindowTitle("Murmurations Dashboard")
+        pg.setConfigOptions(antialias=False)
+
+        self.panels = []
+        self.receivers = []
+        grid = QGridLayout()
+        cols = math.ceil(math.sqrt(len(specs)))
+        for i, spec in enumerate(specs):
+            panel = DevicePanel(spec, window_s)
+            receiver = make_receiver(spec, i)
+            # The panel lives in the GUI thread, so the default connection would be queued:
+            # force a direct one, on_data then runs in the receiver thread and a packet
+            # never waits for the GUI event loop.
+            receiver.newData.connect(panel.on_data, Qt.DirectConnection)
+            receiver.bytesPerSecondSignal.connect(panel.on_bps)
+            grid.addWidget(panel, i // cols, i % cols)
+            self.panels.append(panel)
+            self.receivers.append(receiver)
+
+        self.fps_spin = QSpinBox()
+        self.fps_spin.setRange(1, 120)
+        self.fps_spin.setValue(fps)
+        self.fps_spin.valueChanged.connect(self.set_fps)
+        self.frame_label = QLabel("")
+        controls = QHBoxLayout()
+        controls.addWidget(QLabel("Target FPS:"))
+        controls.addWidget(self.fps_spin)
+        controls.addWidget(self.frame_label)
+        controls.addStretch()
+
+        main_layout = QVBoxLayout()
+        main_layout.addLayout(grid)
+        main_layout.addLayout(controls)
+        central_widget = QWidget()
+        central_widget.setLayout(main_layout)
+        self.setCentralWidget(central_widget)
+
+        # Shared redraw clock.
+        self.frame_times = []
+        self.frame_costs = []
+        self.last_frame = None
+        self.frame_count = 0
+        self.clock = QTimer()
+        self.clock.timeout.connect(self.render_frame)
+        self.set_fps(fps)
+
+        for receiver in self.receivers:
+            receiver.start()
+        self.clock.start()
+
+    def set_fps(self, fps):
+        self.period_s = 1.0 / fps
+        self.clock.setInterval(int(1000 / fps))
+
+    def render_frame(self):
+        now = time.perf_counter()
+        if self.last_frame is not None:
+            self.frame_times = (self.frame_times + [now - self.last_frame])[-100:]
+        self.last_frame = now
+        share = RENDER_SHARE * self.period_s / max(len(self.panels), 1)
+        cost = sum(panel.render(share) for panel in self.panels)
+        self.frame_costs = (self.frame_costs + [cost])[-100:]
+        self.frame_count += 1
+        if self.frame_count % 10 == 0:
+            for panel in self.panels:
+                panel.update_status()
+            self.frame_label.setText(self.frame_summary())
+
+    def frame_summary(self):
+        if not self.frame_times:
+            return ""
+        fps = 1.0 / np.mean(self.frame_times)
+        return (f"{fps:.1f} FPS | render {1000 * np.mean(self.frame_costs):.1f} ms/frame "
+                f"(p95 {1000 * np.percentile(self.frame_costs, 95):.1f} ms)")
+
+    def report(self):
+        """Per-panel cost report (update + paint), printed at the end of a benchmark run."""
+        print(self.frame_summary())
+        for panel in self.panels:
+            if panel.cost_hist:
+                print(f"  {panel.name:24s} mean {1000 * np.mean(panel.cost_hist):.2f} ms, "
+                      f"p95 {1000 * np.percentile(panel.cost_hist, 95):.2f} ms, budget {panel.budget}")
+
+    def closeEvent(self, event):
+        self.clock.stop()
+        for receiver in self.receivers:
+            receiver.stop()
+        super().closeEvent(event)
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Live dashboard for several devices.")
+    parser.add_argument("devices", nargs="*", help="Device specs: IP, replay:<file.cap> or synth:<name>.")
+    parser.add_argument("--synth", type=int, default=0, help="Add N synthetic devices.")
+    parser.add_argument("--fps", type=int, default=DEFAULT_FPS, help="Redraw clock rate.")
+    parser.add_argument("--window", type=float, default=DEFAULT_WINDOW_S, help="Seconds of signal shown per panel.")
+    parser.add_argument("--bench", type=float, default=0,
+                        help="Run for this many seconds, print frame/panel costs and exit.")
+    parser.add_argument("--discover", type=float, nargs="?", const=1.0, default=0,
+                        help="Add the devices announcing themselves within this many seconds (default 1).")
+    args = parser.parse_args()
+
+    specs = args.devices + [f"synth:{i}" for i in range(args.synth)]
+    if args.discover:
+        found = discover(args.discover)
+        print(f"Discovered {len(found)} device(s):", ", ".join(sorted(found)) or "none")
+        specs += [f"{d['ip']}:{d.get('port', PORT)}" for _, d in sorted(found.items())
+                  if f"{d['ip']}:{d.get('port', PORT)}" not in specs]
+    if not specs:
+        parser.error("no devices given")
+
+    app = QApplication(sys.argv)
+    window = Dashboard(specs, fps=args.fps, window_s=args.window)
+    window.resize(1600, 900)
+    window.show()
+    if args.bench > 0:
+        def finish():
+            window.report()
+            window.close()
+            app.quit()
+        QTimer.singleShot(int(args.bench * 1000), finish)
+    sys.exit(app.exec_())
@@ -0,0 +1,222 @@
+"""
+Zero-config discovery of Murmurator devices on the LAN.
+
+The firmware (Firmware-idf/src/discovery.c) broadcasts a one-line JSON beacon to
+UDP port 5001 every 250 ms while no client is attached, and every 2 s otherwise:
+    {"dev":"murmurator","id":"<MAC>","ip":"10.42.0.24","port":5000,"client":0,"streams":[...]}
+It also answers a probe (b"MURMUR?" sent to UDP port 5002) right away, so
+discover() usually returns in a few milliseconds and always within `timeout`.
+
+    devices = discover(timeout=1.0)             # {id: device dict}
+    listener = DiscoveryListener(on_device)     # background thread, used by live.py
+    listener.start(); listener.probe()
+
+A stand-in beacon announces a local endpoint with the same protocol, so the
+host side can be tested without hardware. With --replay, the stand-in also
+serves a raw capture on the announced port (see streamCapture.py):
+    python discovery.py --stand_in --replay session.cap --port 5000
+    python discovery.py                          # lists the devices found within 1 s
+"""
+
+import argparse
+import json
+import socket
+import threading
+import time
+
+BEACON_PORT = 5001       # host side: beacons arrive here
+PROBE_PORT = 5002        # device side: probes are sent here
+PROBE = b"MURMUR?\n"
+STAND_IN_PERIOD = 0.25
+
+# Same capabilities as format_streams_json() in the firmware (default menuconfig).
+DEFAULT_STREAMS = [
+    {"src": 0, "kind": "mic", "rate": 48000, "samples": 256, "channels": 1},
+    {"src": 1, "kind": "adc", "rate": 8000, "samples": 256, "channels": [1, 3], "bits": 12},
+    {"src": 3, "kind": "adc_burst", "rate": 80000, "pre": 4000, "post": 12000, "channels": [1, 3], "bits": 12},
+]
+
+
+def parse_beacon(data, addr):
+    """Device dict from a beacon datagram, or None if it is not one."""
+    try:
+        device = json.loads(data.decode("utf-8"))
+    except (UnicodeDecodeError, ValueError):
+        return None
+    if not isinstance(device, dict) or device.get("dev") != "murmurator" or "id" not in device:
+        return None
+    # Keep the announced address; the sender address is the fallback and is kept for debugging.
+    device.setdefault("ip", addr[0])
+    device["from"] = addr[0]
+    device["last_seen"] = time.time()
+    return device
+
+
+def _beacon_socket():
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM, socket.IPPROTO_UDP)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    if hasattr(socket, "SO_REUSEPORT"):
+        # Several host tools may listen for the broadcast beacons at the same time.
+        sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEPORT, 1)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_BROADCAST, 1)
+    sock.bind(("", BEACON_PORT))
+    return sock
+
+
+def send_probe(sock=None, targets=("255.255.255.255", "127.0.0.1")):
+    own = sock is None
+    if own:
+        sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        sock.setsockopt(socket.SOL_SOCKET, socket.SO_BROADCAST, 1)
+    for target in targets:
+        try:
+            sock.sendto(PROBE, (target, PROBE_PORT))
+        except OSError:
+            pass  # e.g. no broadcast route; the periodic beacons still arrive
+    if own:
+        sock.close()
+
+
+class DiscoveryListener(threading.Thread):
+    """
+    Collects beacons in the background. on_device(device) is called from this
+    thread for every new device, and again when a device's ip/port/client state changes.
+    """
+    def __init__(self, on_device=None):
+        super().__init__(daemon=True)
+        self.on_device = on_device
+        self.devices = {}
+        self.lock = threading.Lock()
+        self.running = False
+        self.sock = _beacon_socket()
+        self.sock.settimeout(0.2)
+
+    def probe(self):
+        send_probe(self.sock)
+
+    def run(self):
+        self.running = True
+        while self.running:
+            try:
+                data, addr = self.sock.recvfrom(2048)
+            except socket.timeout:
+                continue
+            except OSError:
+                break
+            device = parse_beacon(data, addr)
+            if device is None:
+                continue
+            with self.lock:
+                old = self.devices.get(device["id"])
+                self.devices[device["id"]] = device
+            changed = old is None or any(old.get(k) != device.get(k) for k in ("ip", "port", "client"))
+            if changed and self.on_device is not None:
+                self.on_device(device)
+
+    def stop(self):
+        self.running = False
+        self.join(timeout=1.0)
+        self.sock.close()
+
+
+def discover(timeout=1.0, first=False):
+    """Probe, then collect beacons for up to `timeout` seconds. first=True returns on the first device."""
+    found = threading.Event()
+    listener = DiscoveryListener(lambda device: found.set())
+    listener.start()
+    listener.probe()
+    deadline = time.time() + timeout
+    if first:
+        found.wait(timeout)
+    else:
+        time.sleep(max(0.0, deadline - time.time()))
+    listener.stop()
+    return dict(listener.devices)
+
+
+class StandInBeacon(threading.Thread):
+    """Announces host:port like a device would (periodic beacons and probe answers)."""
+    def __init__(self, port=5000, ip="127.0.0.1", device_id="STANDIN000001", streams=DEFAULT_STREAMS,
+                 period=STAND_IN_PERIOD, targets=("255.255.255.255", "127.0.0.1")):
+        super().__init__(daemon=True)
+        self.info = {"dev": "murmurator", "id": device_id, "ip": ip, "port": port, "client": 0,
+                     "streams": streams}
+        self.period = period
+        self.targets = targets
+        self.start_time = time.time()
+        self.running = False
+        self.sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM, socket.IPPROTO_UDP)
+        self.sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        self.sock.setsockopt(socket.SOL_SOCKET, socket.SO_BROADCAST, 1)
+        self.sock.bind(("", PROBE_PORT))
+
+    def beacon(self):
+        info = dict(self.info, uptime_ms=int(1000 * (time.time() - self.start_time)))
+        return (json.dumps(info, separators=(",", ":")) + "\n").encode()
+
+    def send_to(self, host):
+        try:
+            self.sock.sendto(self.beacon(), (host, BEACON_PORT))
+        except OSError:
+            pass
+
+    def run(self):
+        self.running = True
+        next_beacon = 0.0
+        self.sock.settimeout(0.05)
+        while self.running:
+            now = time.time()
+            if now >= next_beacon:
+                for target in self.targets:
+                    self.send_to(target)
+                next_beacon = now + self.period
+            try:
+                data, addr = self.sock.recvfrom(64)
+            except socket.timeout:
+                continue
+            except OSError:
+                break
+            if data.startswith(PROBE.strip()):
+                self.send_to(addr[0])
+
+    def stop(self):
+        self.running = False
+        self.join(timeout=1.0)
+        self.sock.close()
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Discover devices, or run a local stand-in beacon.")
+    parser.add_argument("--timeout", type=float, default=1.0, help="Seconds to listen for beacons.")
+    parser.add_argument("--stand_in", action="store_true", help="Announce a local endpoint like a device.")
+    parser.add_argument("--port", type=int, default=5000, help="Stream port announced by the stand-in.")
+    parser.add_argument("--id", default="STANDIN000001", help="Serial id announced by the stand-in.")
+    parser.add_argument("--replay", default=None, help="Stand-in: serve this raw capture on --port.")
+    args = parser.parse_args()
+
+    if args.stand_in:
+        beacon = StandInBeacon(port=args.port, device_id=args.id)
+        beacon.start()
+        print(f"Stand-in {args.id} announcing 127.0.0.1:{args.port} (Ctrl+C to stop)")
+        try:
+            if args.replay:
+                from streamCapture import read_capture, serve_capture
+                chunks = read_capture(args.replay)
+                while True:
+                    serve_capture(chunks, args.port)
+            else:
+                while True:
+                    time.sleep(1)
+        except KeyboardInterrupt:
+            pass
+        beacon.stop()
+    else:
+        start = time.time()
+        devices = discover(args.timeout)
+        if not devices:
+            print(f"No device found within {args.timeout:.1f} s.")
+        for device in devices.values():
+            streams = ", ".join(f"{s.get('kind')} {s.get('rate')} Hz" for s in device.get("streams", []))
+            print(f"{device['id']}  {device['ip']}:{device.get('port')}  "
+                  f"{'busy' if device.get('client') else 'free'}  "
+                  f"seen after {1000 * (device['last_seen'] - start):.0f} ms  [{streams}]")
@@ -0,0 +1,403 @@
+"""
+Aligned multi-stream frames for real-time consumers (segmenter, classifier, resynthesis).
+
+The mic (source 0, or 4 for interleaved multi-mic packets) and the ADC (source 1,
+two channels interleaved) arrive as independent packets. Each packet is stamped
+by the device (esp_timer, microseconds) when its last sample was taken, with some
+scheduling jitter. FrameAssembler turns them into fixed-hop frames on the device
+timeline:
+    frame.index              frame number since the (re)start
+    frame.start_us           device time of the first sample of the frame
+    frame.mic                int16 [mic_len]              (48 kHz, 10 ms: 480)
+    frame.adc                uint16 [channels, adc_len]   (4 kHz per channel, 10 ms: 40), 12-bit values
+    frame.mic_valid / frame.adc_valid   False where samples are missing
+    frame.complete           every sample of the frame is valid
+
+Per stream, a clock model (sample index -> device time) is fitted to the packet
+timestamps by exponentially weighted least squares over the last CLOCK_TAU_S
+seconds. The fit averages out the timestamp jitter and follows the drift between
+the sample clock and esp_timer. If a packet is later than predicted by
+most of a packet duration, packets were lost: the missing samples are skipped and
+stay invalid. If a timestamp jumps back by more than RESET_US (device reboot), the
+assembler restarts.
+
+A frame is emitted once every stream has covered it. It is also emitted, with its
+missing parts invalid, at the latest max_latency_ms of device time after its end,
+so a stalled stream never holds the others back. Samples live in preallocated rings
+and frames are filled in place, with no allocation per frame.
+
+    assembler = FrameAssembler()
+    assembler.push(source, metadata, timestamp, payload)    # payload bytes, see burstCapture.iter_packets
+    while (frame := assembler.pop()) is not None:
+        consume(frame)    # pop() refills the same Frame: frame.copy() to keep one
+
+Replay a raw capture (streamCapture.py) through the assembler and report the alignment:
+    python frameAssembler.py -i session.cap -o frames.npz
+"""
+
+import argparse
+import math
+import os
+
+import numpy as np
+
+MIC_SAMPLE_RATE = 48000
+ADC_SAMPLE_RATE = 8000       # both channels together
+ADC_CHANNELS = (1, 3)
+SOURCE_MIC = 0
+SOURCE_ADC = 1
+SOURCE_MIC_MULTI = 4
+
+HOP_MS = 10
+MAX_LATENCY_MS = 100         # device time after a frame's end before it is emitted incomplete
+RING_MS = 2000
+RESET_US = 1000000           # a timestamp this far back means the device restarted
+GAP_PACKETS = 0.75           # lateness, in packet durations, that counts as lost packets
+CLOCK_TAU_S = 10.0           # memory of the clock fit
+PRIOR_S = 1.0                # weight of the nominal rate in the fit, in seconds of packets
+MAX_DRIFT = 0.001            # the sample clocks are crystals: stay within 1000 ppm
+
+
+class SampleStream:
+    """One stream of samples: a ring with a validity mask, and its clock model."""
+    def __init__(self, rate, capacity, dtype, offset_us=0.0):
+        self.nominal_period = 1e6 / rate   # us per sample
+        self.capacity = capacity
+        self.offset_us = offset_us
+        self.ring = np.zeros(capacity, dtype=dtype)
+        self.valid = np.zeros(capacity, dtype=bool)
+        self.reset()
+
+    def reset(self):
+        self.written = 0                   # absolute index of the next sample
+        self.jitter = 0.0                  # mean absolute timestamp residual (us)
+        self.packets = 0
+        self.gap_samples = 0
+        self.resyncs = 0
+        self.valid[:] = False
+        self._reset_clock()
+
+    def _reset_clock(self):
+        # Model: time(k) = ref_time + (k - ref_index) * period, ref_index None until the first packet.
+        # The fit keeps weighted means and centred moments of (index, timestamp) only,
+        # so the sums never grow with the stream length.
+        self.period = self.nominal_period
+        self.ref_index = None
+        self.ref_time = 0.0
+        self.weight = 0.0
+        self.cxx = 0.0
+        self.cxy = 0.0
+
+    @property
+    def started(self):
+        return self.ref_index is not None
+
+    def time_of(self, index):
+        return self.ref_time + (index - self.ref_index) * self.period
+
+    def index_at(self, t):
+        return self.ref_index + (t - self.ref_time) / self.period
+
+    def drift_ppm(self):
+        """Positive when the sample clock runs slower than nominal against esp_timer."""
+        return 1e6 * (self.period / self.nominal_period - 1.0)
+
+    def push(self, samples, timestamp):
+        """Append one packet; timestamp is the device time of its last sample.
+        Returns False when the timestamp went back by more than RESET_US."""
+        n = len(samples)
+        if n == 0:
+            return True
+        timestamp = float(timestamp) + self.offset_us
+        last = self.written + n - 1
+        packet_us = n * self.nominal_period
+        if self.ref_index is not None:
+            error = timestamp - self.time_of(last)
+            if error < -RESET_US:
+                return False
+            if error > GAP_PACKETS * packet_us:
+                # Lost packets: leave their samples invalid. The device drops whole packets,
+                # so the gap is rounded to packets, which keeps the timestamp jitter out of it.
+                missing = max(int(round(error / (n * self.period))), 1) * n
+                self._skip(missing)
+                self.gap_samples += missing
+                last += missing
+                error = timestamp - self.time_of(last)
+            elif error < -GAP_PACKETS * packet_us:
+                # Earlier than the model allows: the clock changed, fit it again.
+                self._reset_clock()
+                self.resyncs += 1
+                error = 0.0
+            self.jitter += (abs(error) - self.jitter) / 16.0
+        self._fit(last, timestamp, packet_us)
+        self._write(samples)
+        self.packets += 1
+        return True
+
+    def _fit(self, index, timestamp, packet_us):
+        """Weighted incremental regression of timestamp on index (one point per packet)."""
+        if self.ref_index is None:
+            self.ref_index, self.ref_time = index, timestamp
+        decay = math.exp(-packet_us / (CLOCK_TAU_S * 1e6))
+        self.weight = decay * self.weight + 1.0
+        dx = index - self.ref_index
+        dy = timestamp - self.ref_time
+        # The means move to the new point by 1/weight; the moments decay and take the new term.
+        self.ref_index += dx / self.weight
+        self.ref_time += dy / self.weight
+        self.cxx = decay * self.cxx + dx * (index - self.ref_index)
+        self.cxy = decay * self.cxy + dx * (timestamp - self.ref_time)
+        # The nominal rate acts as PRIOR_S seconds of evidence, so the first packets
+        # do not produce a wild period
+        # (evenly spaced packets over a span of P samples have cxx = packets * P^2 / 12).
+        span = PRIOR_S * 1e6 / self.nominal_period
+        prior = (PRIOR_S * 1e6 / packet_us) * span * span / 12.0
+        period = (self.cxy + prior * self.nominal_period) / (self.cxx + prior)
+        low, high = self.nominal_period * (1 - MAX_DRIFT), self.nominal_period * (1 + MAX_DRIFT)
+        self.period = min(max(period, low), high)
+
+    def _write(self, samples):
+        n = len(samples)
+        if n > self.capacity:
+            samples = samples[-self.capacity:]
+            self.written += n - self.capacity
+            n = self.capacity
+        start = self.written % self.capacity
+        first = min(n, self.capacity - start)
+        self.ring[start:start + first] = samples[:first]
+        self.ring[:n - first] = samples[first:]
+        self.valid[start:start + first] = True
+        self.valid[:n - first] = True
+        self.written += n
+
+    def _skip(self, n):
+        cleared = min(n, self.capacity)
+        start = (self.written + n - cleared) % self.capacity
+        first = min(cleared, self.capacity - start)
+        self.ring[start:start + first] = 0
+        self.ring[:cleared - first] = 0
+        self.valid[start:start + first] = False
+        self.valid[:cleared - first] = False
+        self.written += n
+
+    def read(self, start, out, out_valid):
+        """Copy samples [start, start + len(out)) into out; samples not held are zero and invalid."""
+        n = len(out)
+        out[:] = 0
+        out_valid[:] = False
+        lo = max(start, self.written - self.capacity, 0)
+        hi = min(start + n, self.written)
+        while lo < hi:
+            at = lo % self.capacity
+            count = min(hi - lo, self.capacity - at)
+            out[lo - start:lo - start + count] = self.ring[at:at + count]
+            out_valid[lo - start:lo - start + count] = self.valid[at:at + count]
+            lo += count
+
+
+class Frame:
+    """One aligned frame. Its arrays are reused by FrameAssembler.pop()."""
+    def __init__(self, mic_len, adc_channels, adc_len):
+        self.index = 0
+        self.start_us = 0.0
+        self.channels = tuple(adc_channels)
+        self.mic = np.zeros(mic_len, dtype=np.int16)
+        self.mic_valid = np.zeros(mic_len, dtype=bool)
+        self.adc = np.zeros((len(self.channels), adc_len), dtype=np.uint16)
+        self.adc_valid = np.zeros((len(self.channels), adc_len), dtype=bool)
+        self.complete = False
+
+    def copy(self):
+        frame = Frame(len(self.mic), self.channels, self.adc.shape[1])
+        frame.index, frame.start_us, frame.complete = self.index, self.start_us, self.complete
+        frame.mic[:], frame.mic_valid[:] = self.mic, self.mic_valid
+        frame.adc[:], frame.adc_valid[:] = self.adc, self.adc_valid
+        return frame
+
+
+class FrameAssembler:
+    """Mic + per-channel ADC packets in, synchronized fixed-hop frames out."""
+    def __init__(self, mic_rate=MIC_SAMPLE_RATE, adc_rate=ADC_SAMPLE_RATE, adc_channels=ADC_CHANNELS,
+                 hop_ms=HOP_MS, frame_ms=None, max_latency_ms=MAX_LATENCY_MS, ring_ms=RING_MS,
+                 mic_channel=0, mic_offset_us=0.0, adc_offset_us=0.0):
+        """frame_ms defaults to hop_ms (frame_ms > hop_ms gives overlapping frames).
+        The offsets are added to the packet timestamps of each stream, to calibrate out
+        a constant capture latency difference between the mic and the ADC."""
+        frame_ms = hop_ms if frame_ms is None else frame_ms
+        assert frame_ms < ring_ms, "the rings must hold more than one frame"
+        self.adc_channels = tuple(adc_channels)
+        self.mic_channel = mic_channel
+        adc_channel_rate = adc_rate / len(self.adc_channels)
+        self.hop_us = hop_ms * 1000.0
+        self.frame_us = frame_ms * 1000.0
+        self.max_latency_us = max_latency_ms * 1000.0
+        self.ring_us = ring_ms * 1000.0
+        self.mic = SampleStream(mic_rate, int(mic_rate * ring_ms / 1000), np.int16, mic_offset_us)
+        self.adc = [SampleStream(adc_channel_rate, int(adc_channel_rate * ring_ms / 1000), np.uint16, adc_offset_us)
+                    for _ in self.adc_channels]
+        self.streams = [self.mic] + self.adc
+        self.frame = Frame(int(round(mic_rate * frame_ms / 1000)), self.adc_channels,
+                           int(round(adc_channel_rate * frame_ms / 1000)))
+        self.restarts = 0
+        self.reset()
+
+    @classmethod
+    def from_streams(cls, streams, **kwargs):
+        """Build from the stream capabilities of a discovery beacon (discovery.py)."""
+        for stream in streams:
+            if stream.get("kind") == "mic":
+                kwargs.setdefault("mic_rate", stream["rate"])
+            elif stream.get("kind") == "adc":
+                kwargs.setdefault("adc_rate", stream["rate"])
+                kwargs.setdefault("adc_channels", tuple(stream.get("channels", ADC_CHANNELS)))
+        return cls(**kwargs)
+
+    def reset(self):
+        for stream in self.streams:
+            stream.reset()
+        self.next_start = None
+        self.next_index = 0
+        self.frames = 0
+        self.incomplete = 0
+        self.forced = 0
+        self.skipped = 0
+        self.latency_sum = 0.0
+        self.latency_max = 0.0
+
+    def push(self, source, metadata, timestamp, payload):
+        """Feed one packet (header fields + payload bytes). Other sources are ignored."""
+        if source == SOURCE_MIC and metadata == self.mic_channel:
+            self._push(self.mic, np.frombuffer(payload, dtype="<i2"), timestamp)
+        elif source == SOURCE_MIC_MULTI and self.mic_channel < metadata:
+            self._push(self.mic, np.frombuffer(payload, dtype="<i2")[self.mic_channel::metadata], timestamp)
+        elif source == SOURCE_ADC:
+            raw = np.frombuffer(payload, dtype="<u2")
+            channel = raw >> 12
+            for stream, ch in zip(self.adc, self.adc_channels):
+                self._push(stream, raw[channel == ch] & 0x0FFF, timestamp)
+
+    def _push(self, stream, samples, timestamp):
+        if len(samples) == 0:
+            return
+        if not stream.push(samples, timestamp):
+            self.reset()
+            self.restarts += 1
+            stream.push(samples, timestamp)
+        if self.next_start is None:
+            # Frames start on the hop grid of the device clock, from the first sample seen.
+            first = stream.time_of(stream.written - len(samples))
+            self.next_start = math.ceil(first / self.hop_us) * self.hop_us
+
+    def pop(self, frame=None):
+        """Fill and return the next frame (self.frame unless one is given), or None if not due yet."""
+        if self.next_start is None:
+            return None
+        start = self.next_start
+        end = start + self.frame_us
+        newest = -math.inf
+        ready = True
+        for stream in self.streams:
+            if not stream.started:
+                ready = False
+                continue
+            newest = max(newest, stream.time_of(stream.written))
+            if round(stream.index_at(start)) + self._length(stream) > stream.written:
+                ready = False
+        if not ready and newest - end < self.max_latency_us:
+            return None
+        if newest - end > self.ring_us:
+            # The consumer fell behind the rings: jump to the oldest frame still held.
+            behind = math.floor((newest - self.ring_us - start) / self.hop_us) + 1
+            self.skipped += behind
+            self.next_start += behind * self.hop_us
+            self.next_index += behind
+            return self.pop(frame)
+
+        frame = self.frame if frame is None else frame
+        frame.index = self.next_index
+        frame.start_us = start
+        self._read(self.mic, start, frame.mic, frame.mic_valid)
+        for i, stream in enumerate(self.adc):
+            self._read(stream, start, frame.adc[i], frame.adc_valid[i])
+        frame.complete = bool(frame.mic_valid.all() and frame.adc_valid.all())
+
+        latency = max(newest - end, 0.0)
+        self.latency_sum += latency
+        self.latency_max = max(self.latency_max, latency)
+        self.frames += 1
+        self.incomplete += not frame.complete
+        self.forced += not ready
+        self.next_start += self.hop_us
+        self.next_index += 1
+        return frame
+
+    def _length(self, stream):
+        return len(self.frame.mic) if stream is self.mic else self.frame.adc.shape[1]
+
+    @staticmethod
+    def _read(stream, start, out, out_valid):
+        if stream.started:
+            stream.read(int(round(stream.index_at(start))), out, out_valid)
+        else:
+            out[:] = 0
+            out_valid[:] = False
+
+    def stats(self):
+        names = ["mic"] + [f"adc{ch}" for ch in self.adc_channels]
+        result = {
+            "frames": self.frames,
+            "incomplete": self.incomplete,
+            "forced": self.forced,
+            "skipped": self.skipped,
+            "restarts": self.restarts,
+            "latency_ms": self.latency_sum / max(self.frames, 1) / 1000.0,
+            "latency_max_ms": self.latency_max / 1000.0,
+        }
+        for name, stream in zip(names, self.streams):
+            result[f"{name}_drift_ppm"] = stream.drift_ppm()
+            result[f"{name}_jitter_us"] = stream.jitter
+            result[f"{name}_gap_samples"] = stream.gap_samples
+            result[f"{name}_resyncs"] = stream.resyncs
+        return result
+
+
+def main():
+    from burstCapture import iter_packets
+    from streamCapture import read_capture
+
+    parser = argparse.ArgumentParser(description="Assemble aligned mic/ADC frames from a raw stream capture.")
+    parser.add_argument("--input_file", "-i", required=True, help="Capture file written by live.py.")
+    parser.add_argument("--output_file", "-o", default=None, help="Write every frame to this .npz file.")
+    parser.add_argument("--hop_ms", type=float, default=HOP_MS, help="Frame hop (ms).")
+    parser.add_argument("--frame_ms", type=float, default=None, help="Frame length (ms), default: the hop.")
+    parser.add_argument("--max_latency_ms", type=float, default=MAX_LATENCY_MS,
+                        help="Emit a frame with missing parts this long after its end.")
+    args = parser.parse_args()
+
+    if not os.path.isfile(args.input_file):
+        print(f"Error: File '{args.input_file}' does not exist.")
+        return
+
+    assembler = FrameAssembler(hop_ms=args.hop_ms, frame_ms=args.frame_ms, max_latency_ms=args.max_latency_ms)
+    stream = b"".join(chunk for _, chunk in read_capture(args.input_file))
+    kept = []
+    for packet in iter_packets(stream):
+        assembler.push(*packet)
+        while (frame := assembler.pop()) is not None:
+            if args.output_file:
+                kept.append(frame.copy())
+    for key, value in assembler.stats().items():
+        print(f"{key}: {value:.3f}" if isinstance(value, float) else f"{key}: {value}")
+
+    if args.output_file and kept:
+        np.savez(args.output_file,
+                 index=np.array([f.index for f in kept]),
+                 start_us=np.array([f.start_us for f in kept]),
+                 mic=np.stack([f.mic for f in kept]), mic_valid=np.stack([f.mic_valid for f in kept]),
+                 adc=np.stack([f.adc for f in kept]), adc_valid=np.stack([f.adc_valid for f in kept]),
+                 adc_channels=np.array(assembler.adc_channels))
+        print(f"{len(kept)} frames written to {args.output_file}")
+
+
+if __name__ == "__main__":
+    main()
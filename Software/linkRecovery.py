@@ -0,0 +1,180 @@
+"""
+Link recovery acceptance test: how long the device takes to notice a dead client,
+and how long until a new connection streams again.
+
+Each trial streams for --warmup seconds, then drops the link (--mode):
+  stall   stop reading without closing the socket, like a client that left the
+          Wi-Fi. The receive buffer is kept small, so the device's sends block
+          within a few tens of ms. The device must time the send out
+          (SEND_TIMEOUT_MS) and drop the client. Detection is timed with the
+          device's own state: its discovery beacon reports "client": 0 (probed
+          every PROBE_PERIOD).
+  reset   abortive close (RST), like a crashed client. The device sees it at once.
+Then a new connection is opened:
+  recover   from the drop to the first complete packet on the new connection
+  connect   from connect() to that first packet
+  gap       device time between the last packet before the drop and the first
+            one after it (what the client missed, capture-ring flush included)
+
+The test passes when every trial detects (stall) and recovers within --max_ms.
+
+    python linkRecovery.py --ip 10.42.0.24 --mode stall --trials 10
+    python linkRecovery.py --mode reset        # device found by discovery
+"""
+
+import argparse
+import socket
+import struct
+import sys
+import time
+
+import numpy as np
+
+from discovery import DiscoveryListener, discover
+
+PORT = 5000
+HEADER_FORMAT = "<BBHQ"
+HEADER_SIZE = struct.calcsize(HEADER_FORMAT)
+PROBE_PERIOD = 0.02
+RECEIVE_BUFFER = 4096        # bytes, so a stalled reader blocks the device quickly
+
+
+def recv_exact(sock, n):
+    data = b""
+    while len(data) < n:
+        chunk = sock.recv(n - len(data))
+        if not chunk:
+            raise ConnectionError("closed by the device")
+        data += chunk
+    return data
+
+
+def read_packet(sock):
+    """(source, timestamp_us) of the next complete packet."""
+    source, _, length, ts = struct.unpack(HEADER_FORMAT, recv_exact(sock, HEADER_SIZE))
+    recv_exact(sock, 2 * length)
+    return source, ts
+
+
+def open_stream(ip, port, timeout):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, RECEIVE_BUFFER)
+    sock.settimeout(timeout)
+    sock.connect((ip, port))
+    return sock
+
+
+class ClientState:
+    """Client flag of one device, from beacons answering a probe sent every PROBE_PERIOD."""
+    def __init__(self, device_id):
+        self.device_id = device_id
+        self.listener = DiscoveryListener()
+        self.listener.start()
+
+    def wait_free(self, since, timeout):
+        """Seconds from `since` until a beacon sent after it reports no client, None on timeout."""
+        while time.time() - since < timeout:
+            self.listener.probe()
+            time.sleep(PROBE_PERIOD)
+            with self.listener.lock:
+                device = self.listener.devices.get(self.device_id)
+            if device is not None and device["last_seen"] > since and not device.get("client"):
+                # The beacon left the device at most one probe round trip before it arrived.
+                return device["last_seen"] - since
+        return None
+
+    def stop(self):
+        self.listener.stop()
+
+
+def run_trial(ip, port, mode, warmup, max_s, state=None):
+    sock = open_stream(ip, port, timeout=max(1.0, max_s))
+    end = time.time() + warmup
+    last_ts = None
+    while time.time() < end:
+        _, last_ts = read_packet(sock)
+
+    result = {"detect_ms": None}
+    dropped = time.time()
+    if mode == "reset":
+        sock.setsockopt(socket.SOL_SOCKET, socket.SO_LINGER, struct.pack("ii", 1, 0))
+        sock.close()
+    else:
+        detected = state.wait_free(dropped, max_s)
+        if detected is not None:
+            result["detect_ms"] = 1000 * detected
+        sock.close()
+
+    connect_start = time.time()
+    sock = open_stream(ip, port, timeout=max(1.0, max_s))
+    _, first_ts = read_packet(sock)
+    now = time.time()
+    sock.close()
+    result["recover_ms"] = 1000 * (now - dropped)
+    result["connect_ms"] = 1000 * (now - connect_start)
+    result["gap_ms"] = (first_ts - last_ts) / 1000 if last_ts is not None else None
+    return result
+
+
+def summarize(name, values):
+    values = np.array([v for v in values if v is not None], dtype=float)
+    if len(values) == 0:
+        return f"{name:>10}: -"
+    return (f"{name:>10}: mean {values.mean():7.1f} ms  p50 {np.percentile(values, 50):7.1f}  "
+            f"max {values.max():7.1f}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Measure dead-client detection and reconnection time.")
+    parser.add_argument("--ip", default=None, help="Device IP (default: the first device discovered).")
+    parser.add_argument("--port", type=int, default=PORT, help="Stream port.")
+    parser.add_argument("--mode", choices=["stall", "reset"], default="stall", help="How the link is dropped.")
+    parser.add_argument("--trials", type=int, default=5, help="Number of drops.")
+    parser.add_argument("--warmup", type=float, default=2.0, help="Seconds of streaming before each drop.")
+    parser.add_argument("--max_ms", type=float, default=1000.0, help="Pass threshold for detection and recovery.")
+    args = parser.parse_args()
+
+    devices = discover(timeout=1.0)
+    device = None
+    if args.ip is None:
+        if not devices:
+            print("Error: no device found; pass --ip.")
+            sys.exit(1)
+        device = next(iter(devices.values()))
+        args.ip, args.port = device["ip"], device.get("port", args.port)
+    else:
+        device = next((d for d in devices.values() if d["ip"] == args.ip), None)
+    if args.mode == "stall" and device is None:
+        print("Error: stall mode times detection with the device's beacons, but none was received from", args.ip)
+        sys.exit(1)
+
+    print(f"Device {device['id'] if device else '?'} at {args.ip}:{args.port}, mode {args.mode}, "
+          f"{args.trials} trials")
+    state = ClientState(device["id"]) if device is not None else None
+    results = []
+    try:
+        for trial in range(args.trials):
+            result = run_trial(args.ip, args.port, args.mode, args.warmup, args.max_ms / 1000, state)
+            results.append(result)
+            detect = f"{result['detect_ms']:.0f} ms" if result["detect_ms"] is not None else "-"
+            print(f"trial {trial + 1}: detect {detect}, recover {result['recover_ms']:.0f} ms, "
+                  f"connect {result['connect_ms']:.0f} ms, gap {result['gap_ms']:.0f} ms")
+    finally:
+        if state is not None:
+            state.stop()
+
+    print(summarize("detect", [r["detect_ms"] for r in results]))
+    print(summarize("recover", [r["recover_ms"] for r in results]))
+    print(summarize("connect", [r["connect_ms"] for r in results]))
+    print(summarize("gap", [r["gap_ms"] for r in results]))
+    failed = [i + 1 for i, r in enumerate(results)
+              if r["recover_ms"] > args.max_ms
+              or (args.mode == "stall" and (r["detect_ms"] is None or r["detect_ms"] > args.max_ms))]
+    if failed:
+        print(f"FAIL: trials {failed} over {args.max_ms:.0f} ms")
+        sys.exit(1)
+    print(f"PASS: all trials within {args.max_ms:.0f} ms")
+
+
+if __name__ == "__main__":
+    main()
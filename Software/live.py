@@ -4,13 +4,18 @@ import struct
 import time
 import h5py as h5
 import numpy as np
-from PyQt5.QtCore import Qt, QThread, pyqtSignal, pyqtSlot
+from PyQt5.QtCore import Qt, QThread, QTimer, pyqtSignal, pyqtSlot
 from PyQt5.QtWidgets import (
     QApplication, QMainWindow, QWidget, QVBoxLayout, QHBoxLayout, QGridLayout,
-    QPushButton, QLineEdit, QLabel, QSpinBox
+    QPushButton, QLineEdit, QLabel, QSpinBox, QCheckBox
 )
 import pyqtgraph as pg
 
+from streamCapture import CaptureWriter, TeeSocket
+from audioMonitor import AudioMonitor, QtAudioSink
+from discovery import DiscoveryListener
+from burstCapture import BurstAssembler
+
 ch2c = {
     0: "r",
     1: "c",
@@ -155,20 +160,40 @@ class DataReceiverThread(QThread):
     # For ADC (source==1), data is a dict mapping channel -> list of samples.
     newData = pyqtSignal(int, float, object)
     bytesPerSecondSignal = pyqtSignal(float)
-
-    def __init__(self, ip, parent=None):
+    # Completed high-rate ADC burst (dict, see burstCapture.py).
+    burstSignal = pyqtSignal(object)
+
+    def __init__(self, ip, capture_file=None, socket_factory=None, port=PORT, parent=None):
+        """
+        capture_file: if set, every raw chunk read from the socket is also written
+            (with its arrival time) to this file, see streamCapture.py.
+        socket_factory: callable returning the socket to read from; defaults to a
+            TCP socket. replayCapture.py passes a ReplaySocket here.
+        """
         super().__init__(parent)
         self.ip = ip
+        self.port = port
+        self.sock = None
+        self.bursts = BurstAssembler()
+        self.lost_packets = 0   # reported by the device (source 5)
+        self.capture_file = capture_file
+        self.socket_factory = socket_factory or (lambda: socket.socket(socket.AF_INET, socket.SOCK_STREAM))
         self.running = False
 
     def run(self):
         self.running = True
         bytes_received = 0
         start_time = time.time()
+        writer = None
         try:
-            with socket.socket(socket.AF_INET, socket.SOCK_STREAM) as s:
-                s.connect((self.ip, PORT))
+            with self.socket_factory() as s:
+                s.connect((self.ip, self.port))
                 s.settimeout(5.0)
+                self.sock = s
+                if self.capture_file:
+                    writer = CaptureWriter(self.capture_file)
+                    print("Capturing raw stream to", self.capture_file)
+                    s = TeeSocket(s, writer)
                 while self.running:
                     # Read the header
                     header_data = b""
@@ -197,6 +222,14 @@ class DataReceiverThread(QThread):
                     bytes_received += len(payload_data)
                     samples = struct.unpack("<" + "H" * length, payload_data)
 
+                    # Multi-mic devices: only the primary mic (index 0) is plotted and recorded.
+                    if source == 4:
+                        # Interleaved frames, metadata = number of channels.
+                        samples = samples[::max(reserved, 1)]
+                        source = 0
+                    elif source == 0 and reserved != 0:
+                        continue
+
                     # Process based on source:
                     if source == 0:
                         #! Audio: this is not well understood
@@ -211,6 +244,18 @@ class DataReceiverThread(QThread):
                             adc_channels.setdefault(ch, []).append(val)
                         # print("ADC channels:", adc_channels)
                         data = adc_channels
+                    elif source in (2, 3):
+                        burst = self.bursts.add(source, reserved, ts, payload_data)
+                        if burst is not None:
+                            self.burstSignal.emit(burst)
+                        continue
+                    elif source == 5:
+                        # Gap: the device overwrote packets this client had not read yet.
+                        lost = struct.unpack("<I", payload_data[:4])[0]
+                        self.lost_packets += lost
+                        print(f"Device dropped {lost} packets before t={ts / 1e6:.3f} s "
+                              f"(total {self.lost_packets})")
+                        continue
                     else:
                         # Ignore other sources
                         continue
@@ -226,6 +271,18 @@ class DataReceiverThread(QThread):
                         bytes_received = 0
         except Exception as e:
             print("Socket error:", e)
+        finally:
+            if writer is not None:
+                writer.close()
+                print(f"Capture closed: {writer.bytes_written} bytes in {self.capture_file}")
+
+    def request_burst(self):
+        """Ask the device to freeze a high-rate ADC burst around now."""
+        if self.sock is not None:
+            try:
+                self.sock.send(b"B")
+            except (OSError, AttributeError) as e:  # AttributeError: replayed capture
+                print("Burst request failed:", e)
 
     def stop(self):
         self.running = False
@@ -233,6 +290,7 @@ class DataReceiverThread(QThread):
 
 class MainWindow(QMainWindow):
     recordingConfigSignal = pyqtSignal(str, str, bool)
+    deviceFound = pyqtSignal(object)
     def __init__(self):
         super().__init__()
         self.setWindowTitle("Live Murmurations")
@@ -272,6 +330,16 @@ class MainWindow(QMainWindow):
         self.ip_edit = QLineEdit(ESP32_DEFAULT_IP)
         self.connect_button = QPushButton("Connect")
         self.connect_button.clicked.connect(self.toggle_connection)
+        # Discovery: the first device announcing itself fills the IP and connects.
+        self.device_port = PORT
+        self.autoconnect_check = QCheckBox("Auto-connect")
+        self.autoconnect_check.setChecked(True)
+        self.discovery_label = QLabel("Searching...")
+        self.deviceFound.connect(self.on_device_found)
+        self.ip_edit.textEdited.connect(lambda _: setattr(self, "device_port", PORT))
+        # Optional raw stream capture, replayable with replayCapture.py.
+        self.capture_edit = QLineEdit("")
+        self.capture_edit.setPlaceholderText("e.g. session.cap (empty = off)")
         
         #data recording 
         
@@ -305,13 +373,33 @@ class MainWindow(QMainWindow):
 
         # Bytes per second label.
         self.bps_label = QLabel("Bytes/sec: 0")
+        # High-rate ADC bursts (see burstCapture.py): triggered on the device or from here.
+        self.burst_button = QPushButton("Trigger Burst")
+        self.burst_button.setEnabled(False)
+        self.burst_button.clicked.connect(lambda: self.data_thread.request_burst())
+        self.burst_label = QLabel("Bursts: 0")
+        self.burst_count = 0
+
+        # Audio monitoring (mic stream played on the local output device).
+        self.audio_monitor = None
+        self.monitor_button = QPushButton("Monitor Audio")
+        self.monitor_button.clicked.connect(self.toggle_monitor)
+        self.monitor_button.setEnabled(False)
+        self.monitor_label = QLabel("Monitor: off")
+        self.monitor_timer = QTimer()
+        self.monitor_timer.setInterval(1000)
+        self.monitor_timer.timeout.connect(self.update_monitor_stats)
 
         # controls_layout = QHBoxLayout()
         controls_layout = QGridLayout()
         network_controls = QHBoxLayout()
         network_controls.addWidget(QLabel("ESP32 IP:"))
         network_controls.addWidget(self.ip_edit)
+        network_controls.addWidget(QLabel("Raw capture:"))
+        network_controls.addWidget(self.capture_edit)
         network_controls.addWidget(self.connect_button)
+        network_controls.addWidget(self.autoconnect_check)
+        network_controls.addWidget(self.discovery_label)
         controls_layout.addLayout(network_controls, 0, 0)
         recording_controls = QHBoxLayout()
         recording_controls.addWidget(QLabel("Record File:"))
@@ -326,6 +414,10 @@ class MainWindow(QMainWindow):
         display_controls.addWidget(QLabel("Decimation:"))
         display_controls.addWidget(self.decimation_spin)
         display_controls.addWidget(self.bps_label)
+        display_controls.addWidget(self.monitor_button)
+        display_controls.addWidget(self.monitor_label)
+        display_controls.addWidget(self.burst_button)
+        display_controls.addWidget(self.burst_label)
         controls_layout.addLayout(display_controls, 2, 0)
         controls_widget = QWidget()
         controls_widget.setLayout(controls_layout)
@@ -342,6 +434,17 @@ class MainWindow(QMainWindow):
         self.data_thread = None
         self.data_record_thread.start()
 
+        # Beacons arrive on the listener thread; the signal hands them to the GUI thread.
+        self.discovery_start = time.time()
+        try:
+            self.discovery = DiscoveryListener(self.deviceFound.emit)
+            self.discovery.start()
+            self.discovery.probe()
+        except OSError as e:
+            print("Discovery unavailable:", e)
+            self.discovery = None
+            self.discovery_label.setText("Discovery: off")
+
     def toggle_recording(self):
         self.recording = not self.recording
         if self.recording:
@@ -374,6 +477,7 @@ class MainWindow(QMainWindow):
             # Start connection.
             self.connect_button.setText("Disconnect")
             self.ip_edit.setEnabled(False)
+            self.capture_edit.setEnabled(False)
             # Clear previous buffers.
             self.audio_data.clear()
             self.audio_x.clear()
@@ -385,14 +489,22 @@ class MainWindow(QMainWindow):
             self.adc_plot.addLegend()
 
             ip = self.ip_edit.text()
-            self.data_thread = DataReceiverThread(ip)
+            self.data_thread = DataReceiverThread(ip, capture_file=self.capture_edit.text().strip() or None,
+                                                  port=self.device_port)
             self.data_thread.newData.connect(self.handle_new_data)
             self.data_thread.newData.connect(self.data_record_thread.addData)
             self.data_thread.bytesPerSecondSignal.connect(self.update_bps)
+            self.data_thread.burstSignal.connect(self.on_burst)
             self.data_thread.start()
+            self.burst_button.setEnabled(True)
             self.record_button.setEnabled(True)
+            self.monitor_button.setEnabled(True)
         else:
             # Disconnect.
+            if self.audio_monitor is not None:
+                self.toggle_monitor()
+            self.monitor_button.setEnabled(False)
+            self.burst_button.setEnabled(False)
             self.record_button.setEnabled(False)
             self.recording = False
             self.record_button.setText("Record")
@@ -401,8 +513,39 @@ class MainWindow(QMainWindow):
             self.recordingPID_edit.setEnabled(True)
             self.data_thread.stop()
             self.data_thread = None
+            # A manual disconnect must not be undone by the next beacon.
+            self.autoconnect_check.setChecked(False)
             self.connect_button.setText("Connect")
             self.ip_edit.setEnabled(True)
+            self.capture_edit.setEnabled(True)
+
+    def toggle_monitor(self):
+        if self.audio_monitor is None:
+            try:
+                self.audio_monitor = AudioMonitor(QtAudioSink())
+            except Exception as e:
+                print("Audio monitor unavailable:", e)
+                return
+            # Direct connection: on_data runs in the receiver thread, so packets reach
+            # the jitter buffer (locked internally) without waiting for the GUI event loop.
+            self.data_thread.newData.connect(self.audio_monitor.on_data, Qt.DirectConnection)
+            self.audio_monitor.start()
+            self.monitor_timer.start()
+            self.monitor_button.setText("Stop Monitor")
+        else:
+            self.data_thread.newData.disconnect(self.audio_monitor.on_data)
+            self.audio_monitor.stop()
+            self.audio_monitor = None
+            self.monitor_timer.stop()
+            self.monitor_button.setText("Monitor Audio")
+            self.monitor_label.setText("Monitor: off")
+
+    def update_monitor_stats(self):
+        if self.audio_monitor is not None:
+            st = self.audio_monitor.stats()
+            self.monitor_label.setText(
+                f"Monitor: {st['latency_ms']:.0f} ms (jitter {st['jitter_ms']:.1f} ms, "
+                f"drift {1e6 * (st['ratio'] - 1):+.0f} ppm, underruns {st['underruns']})")
 
     @pyqtSlot(int, float, object)
     def handle_new_data(self, source, ts, data):
@@ -433,6 +576,26 @@ class MainWindow(QMainWindow):
                     self.adc_x[ch] = self.adc_x[ch][-max_samples:]
         self.update_plots()
 
+    @pyqtSlot(object)
+    def on_burst(self, burst):
+        self.burst_count += 1
+        self.burst_label.setText(f"Bursts: {self.burst_count} (last: {burst['trigger_name']} "
+                                 f"at {burst['trigger_us'] / 1e6:.3f} s)")
+        print(f"Burst {burst['id']} ({burst['trigger_name']}): {burst['total']} samples at {burst['rate_hz']} Hz, "
+              f"trigger at {burst['trigger_us']} us")
+
+    @pyqtSlot(object)
+    def on_device_found(self, device):
+        free = not device.get("client")
+        self.discovery_label.setText(f"Found {device['id']} ({'free' if free else 'busy'})")
+        if self.data_thread is not None or not self.autoconnect_check.isChecked() or not free:
+            return
+        print(f"Discovered {device['id']} at {device['ip']}:{device.get('port', PORT)} "
+              f"after {1000 * (time.time() - self.discovery_start):.0f} ms")
+        self.ip_edit.setText(device["ip"])
+        self.device_port = device.get("port", PORT)
+        self.toggle_connection()
+
     @pyqtSlot(float)
     def update_bps(self, bps):
         if bps < 1024:
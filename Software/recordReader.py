@@ -0,0 +1,58 @@
+"""
+Reading of the HDF5 recordings, without any GUI dependency, so the recording
+inspector (recorded.py) and the headless tools (spectrogramCache.py) share it.
+
+    audio_data, adc_data = process_records(h5file[dataset_name][:])
+"""
+
+import numpy as np
+
+
+def process_records(records):
+    """
+    Given a numpy array of records (compound dtype), separate out audio and ADC data.
+    Returns:
+      audio_data: concatenated 1D np.array of audio samples.
+      adc_data: dict mapping channel -> concatenated 1D np.array of ADC samples.
+    Each record has fields:
+      'local_ts', 'data_ts', 'source', 'channels', 'data'
+    For audio (source==0), 'data' is the list of samples.
+    For ADC (source==1), 'data' is a concatenated array and 'channels' is a bytes or string
+    like "ch0:10, ch1:15" indicating sample counts per channel.
+    """
+    audio_list = []
+    adc_dict = {}  # key: channel, value: list of arrays
+    for rec in records:
+        source = rec['source']
+        if source == 0:
+            audio_list.append(rec['data'])
+        elif source == 1:
+            channels_field = rec['channels']
+            if isinstance(channels_field, bytes):
+                channels_str = channels_field.decode("utf-8")
+            else:
+                channels_str = channels_field
+            data_arr = rec['data']
+            if channels_str.strip() != "":
+                parts = channels_str.split(',')
+                idx = 0
+                for part in parts:
+                    part = part.strip()
+                    try:
+                        # Expecting a string like "ch0:10"
+                        ch_str, count_str = part.split(':')
+                        ch = int(ch_str.replace("ch", ""))
+                        count = int(count_str)
+                        samples = data_arr[idx: idx + count]
+                        idx += count
+                        if ch not in adc_dict:
+                            adc_dict[ch] = []
+                        adc_dict[ch].append(samples)
+                    except Exception as e:
+                        print("Error parsing channels info:", e)
+        else:
+            continue
+    audio_data = np.concatenate(audio_list) if audio_list else np.array([])
+    for ch in adc_dict:
+        adc_dict[ch] = np.concatenate(adc_dict[ch])
+    return audio_data, adc_dict
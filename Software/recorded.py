@@ -3,61 +3,18 @@ import h5py
 import numpy as np
 from PyQt5.QtWidgets import (
     QApplication, QMainWindow, QWidget, QVBoxLayout, QHBoxLayout,
-    QLabel, QSpinBox, QFileDialog, QComboBox
+    QLabel, QSpinBox, QFileDialog, QComboBox, QCheckBox
 )
-from PyQt5.QtCore import Qt
+from PyQt5.QtCore import Qt, QTimer, QRectF
 import pyqtgraph as pg
 
-# --- Helper functions to process recorded data ---
+from recordReader import process_records
+from spectrogramCache import SpectrogramCache, cache_path, AUDIO_SAMPLE_RATE, ADC_CHANNEL_RATE
 
-def process_records(records):
-    """
-    Given a numpy array of records (compound dtype), separate out audio and ADC data.
-    Returns:
-      audio_data: concatenated 1D np.array of audio samples.
-      adc_data: dict mapping channel -> concatenated 1D np.array of ADC samples.
-    Each record has fields:
-      'local_ts', 'data_ts', 'source', 'channels', 'data'
-    For audio (source==0), 'data' is the list of samples.
-    For ADC (source==1), 'data' is a concatenated array and 'channels' is a bytes or string
-    like "ch0:10, ch1:15" indicating sample counts per channel.
-    """
-    audio_list = []
-    adc_dict = {}  # key: channel, value: list of arrays
-    for rec in records:
-        source = rec['source']
-        if source == 0:
-            audio_list.append(rec['data'])
-        elif source == 1:
-            channels_field = rec['channels']
-            if isinstance(channels_field, bytes):
-                channels_str = channels_field.decode("utf-8")
-            else:
-                channels_str = channels_field
-            data_arr = rec['data']
-            if channels_str.strip() != "":
-                parts = channels_str.split(',')
-                idx = 0
-                for part in parts:
-                    part = part.strip()
-                    try:
-                        # Expecting a string like "ch0:10"
-                        ch_str, count_str = part.split(':')
-                        ch = int(ch_str.replace("ch", ""))
-                        count = int(count_str)
-                        samples = data_arr[idx: idx + count]
-                        idx += count
-                        if ch not in adc_dict:
-                            adc_dict[ch] = []
-                        adc_dict[ch].append(samples)
-                    except Exception as e:
-                        print("Error parsing channels info:", e)
-        else:
-            continue
-    audio_data = np.concatenate(audio_list) if audio_list else np.array([])
-    for ch in adc_dict:
-        adc_dict[ch] = np.concatenate(adc_dict[ch])
-    return audio_data, adc_dict
+SPECTROGRAM_RANGE_DB = 80    # colour scale: the loudest bin in view and this far below
+SPECTROGRAM_POLL_MS = 200    # redraw interval while tiles are being computed
+
+# --- Helper functions to process recorded data ---
 
 def get_record_boundaries(records):
     """
@@ -150,6 +107,11 @@ class InspectionMainWindow(QMainWindow):
         controls_layout.addWidget(QLabel("Decimation:"))
         controls_layout.addWidget(self.decimation_spin)
 
+        self.spectrogram_check = QCheckBox("Spectrograms")
+        self.spectrogram_check.setChecked(True)
+        self.spectrogram_check.toggled.connect(self.toggle_spectrograms)
+        controls_layout.addWidget(self.spectrogram_check)
+
         # Audio plot.
         self.audio_plot = pg.PlotWidget(title="Audio Data (Source=0)")
         self.audio_curve = self.audio_plot.plot(pen='y')
@@ -170,10 +132,25 @@ class InspectionMainWindow(QMainWindow):
         self.audio_line.sigPositionChanged.connect(self.sync_lines)
         self.adc_line.sigPositionChanged.connect(self.sync_lines)
 
+        # Spectrograms: audio, then one plot per ADC channel, sharing the x axis
+        # (sample index) of the waveform plot above them. Tiles come from the cache
+        # next to the recording and are requested for the visible range only.
+        self.spec_cache = SpectrogramCache(cache_path(self.h5file.filename))
+        self.spec_streams = {}     # name -> (TiledSpectrogram, ImageItem, PlotWidget)
+        self.spec_widget = QWidget()
+        self.spec_layout = QVBoxLayout(self.spec_widget)
+        self.spec_layout.setContentsMargins(0, 0, 0, 0)
+        self.spec_timer = QTimer()
+        self.spec_timer.setSingleShot(True)
+        self.spec_timer.timeout.connect(self.refresh_spectrograms)
+        self.audio_plot.sigXRangeChanged.connect(self.schedule_spectrograms)
+        self.adc_plot.sigXRangeChanged.connect(self.schedule_spectrograms)
+
         main_layout = QVBoxLayout()
         main_layout.addLayout(controls_layout)
         main_layout.addWidget(self.audio_plot)
         main_layout.addWidget(self.adc_plot)
+        main_layout.addWidget(self.spec_widget)
         central_widget = QWidget()
         central_widget.setLayout(main_layout)
         self.setCentralWidget(central_widget)
@@ -196,6 +173,7 @@ class InspectionMainWindow(QMainWindow):
         self.audio_boundaries, self.adc_boundaries = get_record_boundaries(records)
         print(f"Loaded dataset '{dataset_name}': audio samples={len(self.audio_data)}, ADC channels={list(self.adc_data.keys())}")
         self.update_plots()
+        self.setup_spectrograms(dataset_name)
         self.sync_lines()  # update vertical lines based on boundaries
 
     def update_plots(self):
@@ -227,6 +205,68 @@ class InspectionMainWindow(QMainWindow):
         # Re-add vertical line to audio plot.
         self.audio_plot.addItem(self.audio_line)
 
+    # --- Spectrograms ---
+
+    def setup_spectrograms(self, dataset_name):
+        for _, _, plot in self.spec_streams.values():
+            self.spec_layout.removeWidget(plot)
+            plot.deleteLater()
+        self.spec_streams = {}
+        streams = [("audio", self.audio_data, AUDIO_SAMPLE_RATE, self.audio_plot, "Audio Spectrogram")]
+        for ch, data_arr in sorted(self.adc_data.items()):
+            streams.append((f"adc{ch}", data_arr, ADC_CHANNEL_RATE, self.adc_plot, f"ADC Ch {ch} Spectrogram"))
+        lut = pg.colormap.get("viridis").getLookupTable(nPts=256)
+        for name, data_arr, rate, waveform_plot, title in streams:
+            if data_arr.size == 0:
+                continue
+            spec = self.spec_cache.stream(f"{dataset_name}/{name}", data_arr, rate)
+            plot = pg.PlotWidget(title=title)
+            plot.setLabel("left", "Hz")
+            plot.setXLink(waveform_plot)
+            plot.setMouseEnabled(x=True, y=False)
+            image = pg.ImageItem()
+            image.setLookupTable(lut)
+            plot.addItem(image)
+            plot.setYRange(0, rate / 2, padding=0)
+            self.spec_layout.addWidget(plot)
+            self.spec_streams[name] = (spec, image, plot)
+        self.spec_widget.setVisible(self.spectrogram_check.isChecked())
+        self.schedule_spectrograms()
+
+    def toggle_spectrograms(self, checked):
+        self.spec_widget.setVisible(checked)
+        self.schedule_spectrograms()
+
+    def schedule_spectrograms(self, *args):
+        # Coalesce the range changes of a pan/zoom gesture into one redraw.
+        if not self.spec_timer.isActive():
+            self.spec_timer.start(30)
+
+    def refresh_spectrograms(self):
+        if not self.spectrogram_check.isChecked():
+            return
+        pending = False
+        for spec, image, plot in self.spec_streams.values():
+            view_box = plot.getViewBox()
+            x_min, x_max = view_box.viewRange()[0]
+            img, x0, x1, complete = spec.view(max(0.0, x_min), max(1.0, x_max), int(view_box.width()) or 1000)
+            pending |= not complete
+            if np.isnan(img).all():
+                image.clear()
+                continue
+            top = float(np.nanmax(img))
+            img = np.nan_to_num(img, nan=top - SPECTROGRAM_RANGE_DB)
+            image.setImage(img, autoLevels=False, levels=(top - SPECTROGRAM_RANGE_DB, top))
+            image.setRect(QRectF(x0, 0, x1 - x0, spec.rate / 2))
+        if pending:
+            # Missing tiles are being computed in the background: draw them as they land.
+            self.spec_timer.start(SPECTROGRAM_POLL_MS)
+
+    def closeEvent(self, event):
+        self.spec_timer.stop()
+        self.spec_cache.close()
+        super().closeEvent(event)
+
     def sync_lines(self):
         # Determine which line moved.
         sender = self.sender()
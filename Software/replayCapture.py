@@ -0,0 +1,97 @@
+#!/usr/bin/env python3
+"""
+Replay a raw stream capture (recorded with the "Raw capture" field of live.py)
+into a receiver implementation.
+
+Two modes:
+  - In-process (default): the receiver class reads from a ReplaySocket, so it sees
+    exactly the recv() chunks that were captured. Use it to reproduce framing bugs
+    byte-for-byte and to benchmark parser throughput (--speed 0 = max speed).
+  - --serve PORT: act as the device on localhost and stream the capture over TCP
+    with the original pacing, e.g. to point live.py at 127.0.0.1.
+
+Usage:
+    python replayCapture.py -i session.cap --speed 0
+    python replayCapture.py -i session.cap --receiver myReceiver:FastReceiverThread
+    python replayCapture.py -i session.cap --serve 5000
+"""
+
+import argparse
+import importlib
+import os
+import time
+
+from streamCapture import read_capture, ReplaySocket, serve_capture
+
+
+def load_receiver(spec):
+    """Resolve "module:Class" into the receiver class."""
+    module_name, _, class_name = spec.partition(":")
+    module = importlib.import_module(module_name)
+    return getattr(module, class_name or "DataReceiverThread")
+
+
+def replay_in_process(chunks, receiver_cls, speed):
+    """
+    Run the receiver's run() loop synchronously on the capture and count what it emits.
+    Receivers must accept (ip, socket_factory=...) and expose a newData signal.
+    """
+    stats = {"packets": {}, "samples": 0}
+
+    def on_data(source, ts, data):
+        stats["packets"][source] = stats["packets"].get(source, 0) + 1
+        if isinstance(data, dict):
+            stats["samples"] += sum(len(v) for v in data.values())
+        else:
+            stats["samples"] += len(data)
+
+    replay = ReplaySocket(chunks, speed)
+    receiver = receiver_cls("replay", socket_factory=lambda: replay)
+    receiver.newData.connect(on_data)
+    start = time.perf_counter()
+    receiver.run()  # called directly: no thread, deterministic order
+    elapsed = time.perf_counter() - start
+    return stats, elapsed, replay
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Replay a raw TCP stream capture.")
+    parser.add_argument("--input_file", "-i", required=True,
+                        help="Capture file written by live.py.")
+    parser.add_argument("--speed", "-s", type=float, default=1.0,
+                        help="Replay speed factor (1 = original timing, 0 = as fast as possible).")
+    parser.add_argument("--receiver", "-r", default="live:DataReceiverThread",
+                        help="Receiver implementation as module:Class (default live:DataReceiverThread).")
+    parser.add_argument("--serve", type=int, default=None,
+                        help="Serve the capture on this localhost TCP port instead of replaying in-process.")
+    args = parser.parse_args()
+
+    if not os.path.isfile(args.input_file):
+        print(f"Error: File '{args.input_file}' does not exist.")
+        return
+
+    chunks = read_capture(args.input_file)
+    total_bytes = sum(len(c) for _, c in chunks)
+    duration = chunks[-1][0] - chunks[0][0] if chunks else 0.0
+    print(f"Loaded {len(chunks)} chunks, {total_bytes} bytes, {duration:.2f} s of traffic.")
+    if not chunks:
+        return
+
+    if args.serve is not None:
+        serve_capture(chunks, args.serve, args.speed)
+        return
+
+    receiver_cls = load_receiver(args.receiver)
+    stats, elapsed, replay = replay_in_process(chunks, receiver_cls, args.speed)
+    n_packets = sum(stats["packets"].values())
+    print(f"Receiver: {args.receiver}")
+    print(f"Packets per source: {stats['packets']}")
+    print(f"Samples decoded: {stats['samples']}")
+    print(f"Chunks consumed: {replay.index}/{len(chunks)}")
+    if elapsed > 0:
+        print(f"Elapsed: {elapsed:.3f} s -> {n_packets / elapsed:.0f} packets/s, "
+              f"{total_bytes / elapsed / 1024**2:.2f} MB/s")
+
+
+if __name__ == "__main__":
+    main()
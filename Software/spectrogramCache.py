@@ -0,0 +1,345 @@
+"""
+Tiled multi-resolution spectrogram cache for the recording inspector (recorded.py).
+
+Each stream of a recording (the audio, every ADC channel) gets a pyramid of
+spectrogram tiles:
+    level 0     STFT columns, one every `hop` samples (Hann window of n_fft samples)
+    level L     each column is the mean power of 2 columns of level L-1
+Every level is cut into tiles of TILE_COLUMNS columns. A view of the stream only
+touches the tiles of the coarsest level that still has about one column per
+pixel, so drawing an hour of audio costs the same as drawing a second of it.
+
+Tiles are computed on first use by a thread pool (numpy releases the GIL in
+the FFTs), a coarse tile building the finer tiles below it on the way, and
+stored as float16 dB next to the recording in `<recording>.spec.h5`:
+    /<dataset>/<stream>/level<L>    float16 [columns, n_fft // 2 + 1], chunked by tile
+    /<dataset>/<stream>/done<L>     uint8 [tiles], 1 once the tile is written
+Stream groups carry the STFT parameters and a signature of the samples; a stream
+whose samples or parameters changed is recomputed from scratch.
+
+    cache = SpectrogramCache("session.h5.spec.h5")
+    spec = cache.stream("dataset/audio", audio_data, 48000)
+    image, x0, x1, complete = spec.view(start_sample, end_sample, width_px)
+    # image: float32 dB [columns, bins], NaN where tiles are still being computed;
+    # it covers samples x0..x1. Call view() again later while complete is False.
+
+Precompute every tile of a recording and time viewport requests:
+    python spectrogramCache.py -i session.h5
+"""
+
+import argparse
+import os
+import threading
+import time
+import zlib
+from collections import OrderedDict
+from concurrent.futures import ThreadPoolExecutor
+
+import h5py
+import numpy as np
+
+from recordReader import process_records
+
+CACHE_VERSION = 1
+CACHE_SUFFIX = ".spec.h5"
+TILE_COLUMNS = 256
+MEMORY_TILES = 512           # tiles kept decoded in memory (LRU), ~0.3 MB each for audio
+POWER_FLOOR = 1e-12
+
+AUDIO_SAMPLE_RATE = 48000
+ADC_CHANNEL_RATE = 4000      # 8 kHz shared by the two channels
+AUDIO_N_FFT = 1024           # 21 ms window, 47 Hz bins
+ADC_N_FFT = 128              # 32 ms window, 31 Hz bins
+
+
+def cache_path(recording_path):
+    return recording_path + CACHE_SUFFIX
+
+
+def signal_signature(signal):
+    """Cheap fingerprint of a recording stream: its length and a CRC of ~64k samples spread over it."""
+    step = max(1, len(signal) // 65536)
+    return f"{len(signal)}:{zlib.crc32(np.ascontiguousarray(signal[::step]).tobytes()):08x}"
+
+
+def power_to_db(power):
+    return 10.0 * np.log10(np.maximum(power, POWER_FLOOR))
+
+
+def db_to_power(db):
+    return np.power(10.0, db.astype(np.float32) / 10.0)
+
+
+class TiledSpectrogram:
+    """Spectrogram pyramid of one stream. Created by SpectrogramCache.stream()."""
+
+    def __init__(self, cache, group, signal, rate, n_fft, hop):
+        self.cache = cache
+        self.group = group
+        self.signal = signal
+        self.rate = rate
+        self.n_fft = n_fft
+        self.hop = hop
+        self.bins = n_fft // 2 + 1
+        self.window = np.hanning(n_fft).astype(np.float32)
+        self.scale = 1.0 / float(np.sum(self.window ** 2))
+        # Column counts per level, down to the level where a single tile holds everything.
+        self.columns = [max(1, -(-len(signal) // hop))]
+        while self.columns[-1] > TILE_COLUMNS:
+            self.columns.append(-(-self.columns[-1] // 2))
+        self.levels = len(self.columns)
+        self.pending = {}        # (level, tile) -> future
+        self.lock = threading.Lock()
+
+    # --- Geometry ---
+
+    def tiles(self, level):
+        return -(-self.columns[level] // TILE_COLUMNS)
+
+    def samples_per_column(self, level):
+        return self.hop << level
+
+    def level_for(self, start, end, width_px):
+        """Coarsest level with at least one column per pixel over [start, end) samples."""
+        per_pixel = max(1.0, (end - start) / max(1, width_px))
+        level = 0
+        while level + 1 < self.levels and self.samples_per_column(level + 1) <= per_pixel:
+            level += 1
+        return level
+
+    def frequencies(self):
+        return np.fft.rfftfreq(self.n_fft, 1.0 / self.rate)
+
+    # --- Tiles ---
+
+    def _stft(self, tile):
+        """Level-0 tile: power spectra of TILE_COLUMNS frames, in dB."""
+        first = tile * TILE_COLUMNS
+        count = min(TILE_COLUMNS, self.columns[0] - first)
+        start = first * self.hop
+        length = (count - 1) * self.hop + self.n_fft
+        segment = np.zeros(length, dtype=np.float32)
+        available = self.signal[start:start + length]
+        segment[:len(available)] = available
+        frames = np.lib.stride_tricks.sliding_window_view(segment, self.n_fft)[::self.hop][:count]
+        spectrum = np.fft.rfft(frames * self.window, axis=1)
+        power = (spectrum.real ** 2 + spectrum.imag ** 2) * self.scale
+        return power_to_db(power).astype(np.float16)
+
+    def _pool(self, level, tile):
+        """Level-L tile from the two level L-1 tiles below it."""
+        children = [self._build(level - 1, child) for child in (2 * tile, 2 * tile + 1)
+                    if child < self.tiles(level - 1)]
+        power = db_to_power(np.concatenate(children))
+        if len(power) % 2:
+            power = np.concatenate([power, power[-1:]])
+        pooled = 0.5 * (power[0::2] + power[1::2])
+        return power_to_db(pooled).astype(np.float16)
+
+    def _build(self, level, tile):
+        data = self.cache.load_tile(self, level, tile)
+        if data is None:
+            data = self._stft(tile) if level == 0 else self._pool(level, tile)
+            self.cache.store_tile(self, level, tile, data)
+        return data
+
+    def _run(self, level, tile):
+        try:
+            return self._build(level, tile)
+        finally:
+            with self.lock:
+                self.pending.pop((level, tile), None)
+
+    def request(self, level, tile):
+        """Tile data if cached, otherwise schedule it on the pool and return None."""
+        data = self.cache.load_tile(self, level, tile)
+        if data is not None:
+            return data
+        with self.lock:
+            if (level, tile) not in self.pending:
+                self.pending[(level, tile)] = self.cache.pool.submit(self._run, level, tile)
+        return None
+
+    def tile(self, level, tile):
+        """Tile data, computing it in the calling thread if needed."""
+        return self._build(level, tile)
+
+    def busy(self):
+        with self.lock:
+            return len(self.pending)
+
+    # --- Views ---
+
+    def view(self, start, end, width_px):
+        """
+        Spectrogram of samples [start, end) at about one column per pixel.
+        Returns (image float32 dB [columns, bins], x0, x1, complete): the image spans
+        samples x0..x1, tile columns not computed yet are NaN (and scheduled).
+        """
+        level = self.level_for(start, end, width_px)
+        per_column = self.samples_per_column(level)
+        first = int(np.clip(np.floor(start / per_column), 0, self.columns[level] - 1))
+        last = int(np.clip(np.ceil(end / per_column), first + 1, self.columns[level]))
+        image = np.full((last - first, self.bins), np.nan, dtype=np.float32)
+        complete = True
+        for tile in range(first // TILE_COLUMNS, (last - 1) // TILE_COLUMNS + 1):
+            data = self.request(level, tile)
+            if data is None:
+                complete = False
+                continue
+            lo = max(first, tile * TILE_COLUMNS)
+            hi = min(last, tile * TILE_COLUMNS + len(data))
+            image[lo - first:hi - first] = data[lo - tile * TILE_COLUMNS:hi - tile * TILE_COLUMNS]
+        return image, first * per_column, last * per_column, complete
+
+    def build_all(self):
+        """Compute every tile of every level."""
+        # One job per tile of the first level with enough tiles to keep every worker busy
+        # (each job builds the tiles below it), then the levels above only pool cached tiles.
+        split = self.levels - 1
+        while split > 0 and self.tiles(split) < self.cache.workers * 4:
+            split -= 1
+        for level in (split, self.levels - 1):
+            list(self.cache.pool.map(lambda tile: self._build(level, tile), range(self.tiles(level))))
+
+
+class SpectrogramCache:
+    """
+    Spectrogram tiles of the streams of one recording, persisted in an HDF5 file.
+    HDF5 access is serialized by `io_lock`; the FFTs and pooling run in parallel.
+    """
+
+    def __init__(self, path, workers=None):
+        self.path = path
+        self.workers = workers or os.cpu_count()
+        self.pool = ThreadPoolExecutor(max_workers=self.workers)
+        self.io_lock = threading.Lock()
+        self.memory = OrderedDict()      # (group, level, tile) -> float16 tile
+        self.memory_lock = threading.Lock()
+        try:
+            self.file = h5py.File(path, "a")
+        except OSError as e:
+            # Read-only location (or file locked by another inspector): keep tiles in memory only.
+            print(f"Spectrogram cache '{path}' not persisted: {e}")
+            self.file = None
+
+    def stream(self, name, signal, rate, n_fft=None, hop=None):
+        """Pyramid of `signal` (1D samples at `rate` Hz), stored under the group `name`."""
+        if n_fft is None:
+            n_fft = AUDIO_N_FFT if rate > ADC_CHANNEL_RATE * 2 else ADC_N_FFT
+        hop = hop or n_fft // 2
+        spec = TiledSpectrogram(self, name, np.asarray(signal), rate, n_fft, hop)
+        attrs = {"version": CACHE_VERSION, "rate": rate, "n_fft": n_fft, "hop": hop,
+                 "tile_columns": TILE_COLUMNS, "signature": signal_signature(spec.signal)}
+        with self.io_lock:
+            if self.file is None:
+                return spec
+            group = self.file.get(name)
+            if group is not None and any(group.attrs.get(k) != v for k, v in attrs.items()):
+                del self.file[name]
+                group = None
+            if group is None:
+                group = self.file.create_group(name)
+                group.attrs.update(attrs)
+                for level in range(spec.levels):
+                    group.create_dataset(f"level{level}", shape=(spec.columns[level], spec.bins),
+                                         dtype=np.float16,
+                                         chunks=(min(TILE_COLUMNS, spec.columns[level]), spec.bins))
+                    group.create_dataset(f"done{level}", shape=(spec.tiles(level),), dtype=np.uint8)
+            spec.done = [group[f"done{level}"][:].astype(bool) for level in range(spec.levels)]
+        return spec
+
+    def load_tile(self, spec, level, tile):
+        key = (spec.group, level, tile)
+        with self.memory_lock:
+            data = self.memory.get(key)
+            if data is not None:
+                self.memory.move_to_end(key)
+                return data
+        if self.file is None or not spec.done[level][tile]:
+            return None
+        with self.io_lock:
+            data = self.file[spec.group][f"level{level}"][tile * TILE_COLUMNS:(tile + 1) * TILE_COLUMNS]
+        self._remember(key, data)
+        return data
+
+    def store_tile(self, spec, level, tile, data):
+        self._remember((spec.group, level, tile), data)
+        if self.file is None:
+            return
+        with self.io_lock:
+            group = self.file[spec.group]
+            group[f"level{level}"][tile * TILE_COLUMNS:tile * TILE_COLUMNS + len(data)] = data
+            group[f"done{level}"][tile] = 1
+            spec.done[level][tile] = True
+
+    def _remember(self, key, data):
+        with self.memory_lock:
+            self.memory[key] = data
+            self.memory.move_to_end(key)
+            while len(self.memory) > MEMORY_TILES:
+                self.memory.popitem(last=False)
+
+    def close(self):
+        self.pool.shutdown(wait=True, cancel_futures=True)
+        with self.io_lock:
+            if self.file is not None:
+                self.file.close()
+                self.file = None
+
+
+def recording_streams(h5file, dataset_name):
+    """(name, samples, rate) of the audio and of every ADC channel of a dataset."""
+    audio_data, adc_data = process_records(h5file[dataset_name][:])
+    streams = []
+    if audio_data.size > 0:
+        streams.append((f"{dataset_name}/audio", audio_data, AUDIO_SAMPLE_RATE))
+    for ch, data in sorted(adc_data.items()):
+        if data.size > 0:
+            streams.append((f"{dataset_name}/adc{ch}", data, ADC_CHANNEL_RATE))
+    return streams
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Precompute the spectrogram tiles of a recording (recorded.py).")
+    parser.add_argument("--input_file", "-i", required=True, help="Recording file written by live.py.")
+    parser.add_argument("--dataset", "-d", default=None, help="Dataset to process (default: all).")
+    parser.add_argument("--workers", "-w", type=int, default=None, help="Worker threads (default: all cores).")
+    parser.add_argument("--views", type=int, default=200, help="Random viewports to time after the build.")
+    args = parser.parse_args()
+
+    if not os.path.exists(args.input_file):
+        print(f"Error: File '{args.input_file}' does not exist.")
+        return
+
+    with h5py.File(args.input_file, "r") as h5file:
+        names = [args.dataset] if args.dataset else list(h5file.keys())
+        streams = [s for name in names for s in recording_streams(h5file, name)]
+
+    cache = SpectrogramCache(cache_path(args.input_file), workers=args.workers)
+    rng = np.random.default_rng(0)
+    try:
+        for name, samples, rate in streams:
+            spec = cache.stream(name, samples, rate)
+            start = time.perf_counter()
+            spec.build_all()
+            built = time.perf_counter() - start
+            tiles = sum(spec.tiles(level) for level in range(spec.levels))
+            print(f"{name}: {len(samples) / rate:.1f} s at {rate} Hz, n_fft {spec.n_fft}, "
+                  f"{spec.levels} levels, {tiles} tiles in {built:.2f} s")
+            timings = []
+            for _ in range(args.views):
+                span = len(samples) * 10 ** rng.uniform(-3, 0)
+                x0 = rng.uniform(0, max(1, len(samples) - span))
+                t = time.perf_counter()
+                spec.view(x0, x0 + span, 1600)
+                timings.append(time.perf_counter() - t)
+            if timings:
+                print(f"    view: median {np.median(timings) * 1e3:.2f} ms, max {np.max(timings) * 1e3:.2f} ms")
+    finally:
+        cache.close()
+    print(f"Cache written to '{cache_path(args.input_file)}'.")
+
+
+if __name__ == "__main__":
+    main()
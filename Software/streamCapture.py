@@ -0,0 +1,164 @@
+"""
+Raw TCP stream capture and replay.
+
+A capture file stores every chunk returned by socket.recv() in the receiver,
+together with its local arrival time, so a session can be fed back byte-for-byte
+(with the original chunk boundaries) into any receiver implementation.
+
+File layout:
+    magic        8 bytes  b"MURCAP1\\n"
+    records      repeated until EOF:
+        arrival  float64  time.time() when recv() returned
+        length   uint32   number of payload bytes
+        payload  length bytes, exactly as returned by recv()
+"""
+
+import socket
+import struct
+import time
+
+CAPTURE_MAGIC = b"MURCAP1\n"
+RECORD_FORMAT = "<dI"  # arrival time (8B), payload length (4B)
+RECORD_SIZE = struct.calcsize(RECORD_FORMAT)
+
+
+class CaptureWriter:
+    """Append-only writer for capture files."""
+    def __init__(self, filename):
+        self.filename = filename
+        self.file = open(filename, "wb")
+        self.file.write(CAPTURE_MAGIC)
+        self.bytes_written = 0
+
+    def write(self, arrival, chunk):
+        self.file.write(struct.pack(RECORD_FORMAT, arrival, len(chunk)))
+        self.file.write(chunk)
+        self.bytes_written += len(chunk)
+
+    def close(self):
+        if not self.file.closed:
+            self.file.close()
+
+
+def read_capture(filename):
+    """
+    Load a capture file.
+    Returns a list of (arrival, chunk) tuples in arrival order.
+    """
+    chunks = []
+    with open(filename, "rb") as f:
+        if f.read(len(CAPTURE_MAGIC)) != CAPTURE_MAGIC:
+            raise ValueError(f"'{filename}' is not a stream capture file")
+        while True:
+            header = f.read(RECORD_SIZE)
+            if len(header) < RECORD_SIZE:
+                break
+            arrival, length = struct.unpack(RECORD_FORMAT, header)
+            chunk = f.read(length)
+            if len(chunk) < length:
+                print(f"Warning: truncated record at end of '{filename}'")
+                break
+            chunks.append((arrival, chunk))
+    return chunks
+
+
+class TeeSocket:
+    """
+    Wraps a connected socket and copies every received chunk to a CaptureWriter.
+    Only the methods used by the receivers are forwarded.
+    """
+    def __init__(self, sock, writer):
+        self.sock = sock
+        self.writer = writer
+
+    def recv(self, bufsize):
+        chunk = self.sock.recv(bufsize)
+        if chunk:
+            self.writer.write(time.time(), chunk)
+        return chunk
+
+    def settimeout(self, value):
+        self.sock.settimeout(value)
+
+    def close(self):
+        self.writer.close()
+        self.sock.close()
+
+
+class ReplaySocket:
+    """
+    Socket stand-in that serves a capture to a receiver.
+
+    speed: 1.0 reproduces the original inter-arrival times, 2.0 replays twice as
+           fast, None (or <= 0) delivers the data as fast as the receiver reads it.
+
+    recv(n) returns at most one captured chunk, so a receiver that issues the same
+    read sizes as the one that recorded the capture sees identical boundaries
+    (including partial reads). Larger chunks are split across calls.
+    """
+    def __init__(self, chunks, speed=1.0):
+        self.chunks = chunks
+        self.speed = speed if speed and speed > 0 else None
+        self.index = 0
+        self.pending = b""
+        self.start_wall = None
+        self.start_capture = chunks[0][0] if chunks else 0.0
+
+    # Socket API used by DataReceiverThread.
+    def connect(self, address):
+        self.start_wall = time.time()
+
+    def settimeout(self, value):
+        pass
+
+    def close(self):
+        pass
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+        return False
+
+    def recv(self, bufsize):
+        if not self.pending:
+            if self.index >= len(self.chunks):
+                return b""  # EOF, like a closed peer
+            arrival, chunk = self.chunks[self.index]
+            self.index += 1
+            if self.speed is not None:
+                if self.start_wall is None:
+                    self.start_wall = time.time()
+                due = self.start_wall + (arrival - self.start_capture) / self.speed
+                delay = due - time.time()
+                if delay > 0:
+                    time.sleep(delay)
+            self.pending = chunk
+        out = self.pending[:bufsize]
+        self.pending = self.pending[bufsize:]
+        return out
+
+
+def serve_capture(chunks, port, speed=1.0, host="127.0.0.1"):
+    """
+    Act as the device: accept one TCP client on host:port and send the capture
+    with the original pacing. TCP may merge chunks, so use ReplaySocket when the
+    exact recv() boundaries matter.
+    """
+    with socket.socket(socket.AF_INET, socket.SOCK_STREAM) as server:
+        server.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        server.bind((host, port))
+        server.listen(1)
+        print(f"Serving capture on {host}:{port}, waiting for a client...")
+        conn, addr = server.accept()
+        print("Client connected:", addr)
+        with conn:
+            source = ReplaySocket(chunks, speed)
+            source.connect(None)
+            while True:
+                chunk = source.recv(1 << 20)
+                if not chunk:
+                    break
+                conn.sendall(chunk)
+    print("Capture fully sent.")